@@ -0,0 +1,439 @@
+/** @file FluidBenchmark.cpp
+ *  @brief Runs the fluid solver without a window and reports
+ *         throughput and energy drift as JSON.
+ *
+ *  Build with: python3 build.py bench
+ *  Run with:   ./bench_prog [--precision=float|double|mixed|all] [--steps=N]
+ *                           [--trace=trace.json] [--counters]
+ *                           [--assert-no-allocations[=warmupSteps]] [scene options]
+ *                           [--verify-neighbors]
+ *
+ *  Runs the interactive program's scene, with the options listed in
+ *  FluidScene.hpp, its block scaled to --grid particles per side, 40
+ *  unless given. Every precision runs in turn unless one is given.
+ *  --trace writes the profiler's zones as a Chrome trace, build with
+ *  -D SPH_PROFILE for it to record any. --counters adds hardware counters
+ *  per solver stage and step, null where the machine does not allow them.
+ *  They only count the thread that opened them, so --counters runs the
+ *  solver on one thread. Built with -D SPH_TRACK_ALLOCATIONS the
+ *  results count heap allocations per step and stage, and
+ *  --assert-no-allocations fails the run if a solver stage allocates
+ *  after the warm-up steps, 10 unless given. Each result says whether the
+ *  kernels are tabulated, and built with -D SPH_TABULATED_KERNELS how far
+ *  the tables are from the analytic kernels. --verify-neighbors runs no
+ *  benchmark, it checks the neighbor grid's pairs against comparing every
+ *  pair of particles, dense and sparse, with one level and with several,
+ *  and fails if any pair is missed or found twice.
+ */
+
+#include "AllocationTracker.hpp"
+#include "FluidScene.hpp"
+#include "IFluidSolver.hpp"
+#include "PerfCounters.hpp"
+#include "Profiler.hpp"
+#include "UniformGrid.hpp"
+
+// C++ Standard Libraries
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// The result of running one solver instantiation
+struct BenchmarkResult {
+    Precision precision;
+    std::size_t particles;
+    int steps;
+    double seconds;
+    double deltaTime;
+    SolverMode mode;
+    // Step statistics summed over the run
+    double pressureIterations;
+    double averageDensityError;
+    double maxDensityError;
+    double viscosityIterations;
+    double maxViscosityResidual;
+    double activeParticles;
+    double activeCells;
+    int finalActiveParticles;
+    // Force evaluations, and what a global step at the finest level used would have taken
+    double forceEvaluations;
+    double globalStepEvaluations;
+    std::vector<int> timeLevelCounts;
+    // Particles the emitters added and the sinks removed, and how many were left
+    double emittedParticles;
+    double removedParticles;
+    std::size_t finalParticles;
+    // Particles split and pairs merged by adaptive resolution
+    double splitParticles;
+    double mergedParticles;
+    // Rigid bodies and their mean height at the end
+    std::size_t bodies;
+    double averageBodyHeight;
+    // Whether counters were asked for, the solver threads they ran with,
+    // and what they saw per stage, empty if they could not be opened
+    bool counted;
+    int threads;
+    std::vector<PerfStageCounts> stageCounts;
+    // Heap allocations during the run, in total and per solver stage, and
+    // those made by a stage after the warm-up, if that was checked
+    AllocationCounts allocations;
+    std::vector<TagAllocations> stageAllocations;
+    bool allocationsChecked;
+    std::uint64_t hotAllocations;
+    const char* firstHotAllocation;
+    SolverDiagnostics start;
+    SolverDiagnostics end;
+    // How far the kernel tables are from the analytic kernels
+    KernelErrors kernelErrors;
+};
+
+// Runs one instantiation for the given number of steps
+BenchmarkResult RunBenchmark(SolverConfig config, const SceneOptions& scene, int steps, bool counters, int warmupSteps) {
+    std::unique_ptr<IFluidSolver> solver = CreateFluidSolver(config);
+    PopulateScene(*solver, scene);
+
+    BenchmarkResult result;
+    result.precision = config.precision;
+    result.mode = config.mode;
+    result.deltaTime = config.deltaTime;
+    result.pressureIterations = 0;
+    result.averageDensityError = 0;
+    result.maxDensityError = 0;
+    result.viscosityIterations = 0;
+    result.maxViscosityResidual = 0;
+    result.activeParticles = 0;
+    result.activeCells = 0;
+    result.finalActiveParticles = 0;
+    result.forceEvaluations = 0;
+    result.globalStepEvaluations = 0;
+    result.emittedParticles = 0;
+    result.removedParticles = 0;
+    result.splitParticles = 0;
+    result.mergedParticles = 0;
+    result.particles = solver->ParticleCount();
+    result.steps = steps;
+    result.start = solver->Diagnostics();
+    result.kernelErrors = solver->KernelTableErrors();
+    result.counted = counters;
+    result.threads = config.threadCount;
+    PerfCounters::Reset();
+    AllocationTracker::Reset();
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++) {
+        if (i == warmupSteps) AllocationTracker::SetStrict(true);
+        solver->Step();
+
+        const StepStats& stats = solver->Stats();
+        result.pressureIterations += stats.pressureIterations;
+        result.averageDensityError += stats.averageDensityError;
+        result.maxDensityError = std::max(result.maxDensityError, stats.maxDensityError);
+        result.viscosityIterations += stats.viscosityIterations;
+        result.maxViscosityResidual = std::max(result.maxViscosityResidual, stats.viscosityResidual);
+        result.activeParticles += stats.activeParticles;
+        result.activeCells += stats.activeCells;
+        result.finalActiveParticles = stats.activeParticles;
+        result.forceEvaluations += stats.forceEvaluations;
+        result.globalStepEvaluations += double(stats.activeParticles) * double(1 << stats.finestTimeLevel);
+        result.timeLevelCounts = stats.timeLevelCounts;
+        result.emittedParticles += stats.emittedParticles;
+        result.removedParticles += stats.removedParticles;
+        result.splitParticles += stats.splitParticles;
+        result.mergedParticles += stats.mergedParticles;
+    }
+    auto finish = std::chrono::steady_clock::now();
+
+    result.seconds = std::chrono::duration<double>(finish - begin).count();
+    result.stageCounts = PerfCounters::Stages();
+    AllocationTracker::SetStrict(false);
+    result.allocations = AllocationTracker::Total();
+    result.stageAllocations = AllocationTracker::Tags();
+    result.allocationsChecked = warmupSteps >= 0;
+    result.hotAllocations = AllocationTracker::Violations();
+    result.firstHotAllocation = AllocationTracker::FirstViolation();
+    result.end = solver->Diagnostics();
+    result.finalParticles = solver->ParticleCount();
+    result.bodies = solver->BodyCount();
+    result.averageBodyHeight = 0;
+    for (std::size_t i = 0; i < solver->BodyCount(); i++) {
+        result.averageBodyHeight += solver->Body(i).position.y / solver->BodyCount();
+    }
+    return result;
+}
+
+// Writes the counters of every stage, per step
+void WriteCounters(std::ostream& out, const BenchmarkResult& result) {
+    if (result.stageCounts.empty()) {
+        out << "null";
+        return;
+    }
+
+    out << "{\n";
+    out << "        \"threads\": " << result.threads << ",\n";
+    for (std::size_t s = 0; s < result.stageCounts.size(); s++) {
+        const PerfStageCounts& stage = result.stageCounts[s];
+        out << "        \"" << stage.stage << "\": {\"runsPerStep\": " << double(stage.runs) / result.steps;
+        for (int e = 0; e < int(PerfEvent::Count); e++) {
+            out << ", \"" << PerfEventName(PerfEvent(e)) << "\": ";
+            if (stage.counts.values[e] < 0) {
+                out << "null";
+            } else {
+                out << double(stage.counts.values[e]) / result.steps;
+            }
+        }
+        out << "}" << (s + 1 < result.stageCounts.size() ? ",\n" : "\n");
+    }
+    out << "      }";
+}
+
+// Writes one result as a JSON object
+void WriteResult(std::ostream& out, const BenchmarkResult& result) {
+    double energyStart = result.start.kineticEnergy + result.start.potentialEnergy;
+    double energyEnd = result.end.kineticEnergy + result.end.potentialEnergy;
+    glm::dvec3 momentumChange = result.end.momentum - result.start.momentum;
+
+    out << "    {\n";
+    out << "      \"precision\": \"" << PrecisionName(result.precision) << "\",\n";
+    out << "      \"mode\": \"" << SolverModeName(result.mode) << "\",\n";
+    out << "      \"deltaTime\": " << result.deltaTime << ",\n";
+    out << "      \"particles\": " << result.particles << ",\n";
+    out << "      \"steps\": " << result.steps << ",\n";
+    out << "      \"seconds\": " << result.seconds << ",\n";
+    out << "      \"stepsPerSecond\": " << result.steps / result.seconds << ",\n";
+    out << "      \"particleStepsPerSecond\": " << result.particles * result.steps / result.seconds << ",\n";
+    out << "      \"simulatedSecondsPerSecond\": " << result.steps * result.deltaTime / result.seconds << ",\n";
+    out << "      \"pressureIterationsPerStep\": " << result.pressureIterations / result.steps << ",\n";
+    out << "      \"averageDensityError\": " << result.averageDensityError / result.steps << ",\n";
+    out << "      \"maxDensityError\": " << result.maxDensityError << ",\n";
+    out << "      \"viscosityIterationsPerStep\": " << result.viscosityIterations / result.steps << ",\n";
+    out << "      \"maxViscosityResidual\": " << result.maxViscosityResidual << ",\n";
+    out << "      \"activeParticlesPerStep\": " << result.activeParticles / result.steps << ",\n";
+    out << "      \"activeCellsPerStep\": " << result.activeCells / result.steps << ",\n";
+    out << "      \"finalActiveParticles\": " << result.finalActiveParticles << ",\n";
+    out << "      \"forceEvaluationsPerStep\": " << result.forceEvaluations / result.steps << ",\n";
+    out << "      \"globalStepEvaluationsPerStep\": " << result.globalStepEvaluations / result.steps << ",\n";
+    out << "      \"finalTimeLevels\": [";
+    for (std::size_t level = 0; level < result.timeLevelCounts.size(); level++) {
+        out << (level > 0 ? ", " : "") << result.timeLevelCounts[level];
+    }
+    out << "],\n";
+    out << "      \"emittedParticlesPerStep\": " << result.emittedParticles / result.steps << ",\n";
+    out << "      \"removedParticlesPerStep\": " << result.removedParticles / result.steps << ",\n";
+    out << "      \"splitParticlesPerStep\": " << result.splitParticles / result.steps << ",\n";
+    out << "      \"mergedParticlesPerStep\": " << result.mergedParticles / result.steps << ",\n";
+    out << "      \"finalParticles\": " << result.finalParticles << ",\n";
+    out << "      \"bodies\": " << result.bodies << ",\n";
+    out << "      \"averageBodyHeight\": " << result.averageBodyHeight << ",\n";
+    out << "      \"energyStart\": " << energyStart << ",\n";
+    out << "      \"energyEnd\": " << energyEnd << ",\n";
+    out << "      \"energyDrift\": " << (energyEnd - energyStart) / std::abs(energyStart) << ",\n";
+    out << "      \"momentumDriftX\": " << momentumChange.x << ",\n";
+    out << "      \"tabulatedKernels\": " << (result.kernelErrors.tabulated ? "true" : "false");
+    if (result.kernelErrors.tabulated) {
+        out << ",\n      \"maxKernelDensityError\": " << result.kernelErrors.maxDensityError;
+        out << ",\n      \"maxKernelPressureGradientError\": " << result.kernelErrors.maxPressureGradientError;
+    }
+    if (AllocationTracker::enabled) {
+        out << ",\n      \"allocationsPerStep\": " << double(result.allocations.allocations) / result.steps;
+        out << ",\n      \"allocatedBytesPerStep\": " << double(result.allocations.bytes) / result.steps;
+        out << ",\n      \"stageAllocations\": {";
+        for (std::size_t s = 0; s < result.stageAllocations.size(); s++) {
+            const TagAllocations& stage = result.stageAllocations[s];
+            out << (s > 0 ? ", " : "") << "\"" << stage.tag << "\": {\"allocationsPerStep\": "
+                << double(stage.counts.allocations) / result.steps << ", \"bytesPerStep\": " << double(stage.counts.bytes) / result.steps << "}";
+        }
+        out << "}";
+        if (result.allocationsChecked) {
+            out << ",\n      \"hotAllocationsAfterWarmup\": " << result.hotAllocations;
+        }
+    }
+    if (result.counted) {
+        out << ",\n      \"counters\": ";
+        WriteCounters(out, result);
+    }
+    out << "\n    }";
+}
+
+// A layout of particles the neighbor search is checked on
+struct NeighborCase {
+    const char* name;
+    bool sparse;
+    int levels;
+    // Half extents of the box the particles are scattered over, and its center
+    double spread;
+    glm::dvec2 center;
+};
+
+// Compares the pairs the grid finds with every pair closer than the mean of
+// the two supports, on random particles moved and binned again a few times
+// so a sparse grid also reuses the cells that emptied. A pair the grid does
+// not visit is missed, one it visits twice is duplicated. A particle is
+// its own neighbor, as in the density pass. Some particles sit
+// exactly on cell borders and some in tight clusters. Returns whether every
+// case found every pair exactly once
+bool VerifyNeighbors() {
+    const double width = 2.4;
+    const double height = 2.4;
+    const double smoothing = 0.2;
+    const int count = 1200;
+    const int rounds = 3;
+    const NeighborCase cases[] = {
+        {"dense", false, 1, 2.4, {0, 0}},
+        {"dense, 3 levels", false, 3, 2.4, {0, 0}},
+        {"sparse", true, 1, 7.2, {0, 0}},
+        {"sparse, 3 levels", true, 3, 7.2, {0, 0}},
+        {"sparse, 3 levels, far from the origin", true, 3, 2.4, {-1000.3, 517.9}},
+    };
+
+    bool ok = true;
+    std::mt19937 random(2024);
+    for (const NeighborCase& test : cases) {
+        UniformGrid grid(width, height, smoothing, test.sparse, test.levels);
+        std::uniform_real_distribution<double> across(-test.spread, test.spread);
+        std::uniform_real_distribution<double> unit(0, 1);
+        std::uniform_int_distribution<int> level(0, test.levels - 1);
+
+        std::vector<glm::dvec3> positions(count);
+        std::vector<double> supports(count);
+        for (int i = 0; i < count; i++) {
+            // Anywhere from just above the next finer level's size up to this level's
+            int l = level(random);
+            double size = smoothing * std::pow(2.0, l / 2.0);
+            double finer = (l > 0) ? smoothing * std::pow(2.0, (l - 1) / 2.0) : 0.5 * smoothing;
+            supports[i] = (test.levels > 1) ? finer + unit(random) * (size - finer) : smoothing;
+        }
+
+        long long pairs = 0;
+        long long missed = 0;
+        long long duplicated = 0;
+        std::vector<int> visits(count);
+        for (int round = 0; round < rounds; round++) {
+            for (int i = 0; i < count; i++) {
+                glm::dvec2 position = test.center + glm::dvec2(across(random), across(random));
+                if (i % 10 == 0) {
+                    // On a cell border of the finest level
+                    position.x = std::round(position.x / smoothing) * smoothing;
+                } else if (i % 10 == 1) {
+                    // Close to the particle before
+                    position = glm::dvec2(positions[i - 1]) + 0.01 * smoothing * glm::dvec2(unit(random), unit(random));
+                }
+                if (!test.sparse) {
+                    position = glm::clamp(position, glm::dvec2(-width, -height), glm::dvec2(width, height));
+                }
+                positions[i] = glm::dvec3(position, 0);
+            }
+            grid.Build(positions, supports);
+
+            for (int i = 0; i < count; i++) {
+                std::fill(visits.begin(), visits.end(), 0);
+                grid.ForEachNeighbor(grid.CellOf(i), positions[i].x, positions[i].y, [&](int j) { visits[j]++; });
+                for (int j = 0; j < count; j++) {
+                    glm::dvec3 offset = positions[i] - positions[j];
+                    double reach = (supports[i] + supports[j]) / 2;
+                    bool neighbor = glm::dot(offset, offset) < reach * reach;
+                    if (neighbor) pairs++;
+                    if (neighbor && visits[j] == 0) missed++;
+                    if (visits[j] > 1) duplicated++;
+                }
+            }
+        }
+
+        std::cout << test.name << ": " << pairs << " pairs, " << missed << " missed, " << duplicated << " duplicated" << std::endl;
+        ok = ok && missed == 0 && duplicated == 0;
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    int steps = 600;
+    std::vector<Precision> precisions = {Precision::Single, Precision::Double, Precision::Mixed};
+    std::string tracePath;
+    bool counters = false;
+    int warmupSteps = -1;
+    bool verifyNeighbors = false;
+    SolverConfig config;
+    SceneOptions scene;
+    scene.grid = 40;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        // Every precision unless one is given, which the scene options take
+        if (arg == "--precision=all") {
+            continue;
+        }
+        ArgumentResult result = ParseSceneArgument(arg, config, scene);
+        if (result == ArgumentResult::Invalid) {
+            return 1;
+        } else if (result == ArgumentResult::Parsed) {
+            if (arg.rfind("--precision=", 0) == 0) {
+                precisions = {config.precision};
+            }
+            continue;
+        }
+        if (arg.rfind("--steps=", 0) == 0) {
+            if (!ParseIntArgument(arg, steps)) {
+                return 1;
+            }
+        } else if (arg == "--assert-no-allocations") {
+            warmupSteps = 10;
+        } else if (arg.rfind("--assert-no-allocations=", 0) == 0) {
+            if (!ParseIntArgument(arg, warmupSteps)) {
+                return 1;
+            }
+        } else if (arg == "--counters") {
+            counters = true;
+        } else if (arg == "--verify-neighbors") {
+            verifyNeighbors = true;
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            tracePath = arg.substr(8);
+        } else {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (verifyNeighbors) {
+        return VerifyNeighbors() ? 0 : 1;
+    }
+
+    // The interactive scene with its block scaled to --grid, 40 unless given
+    ConfigureScene(config, scene);
+
+    if (warmupSteps >= 0 && !AllocationTracker::enabled) {
+        std::cerr << "--assert-no-allocations needs a build with -D SPH_TRACK_ALLOCATIONS" << std::endl;
+        return 1;
+    }
+
+    PROFILE_THREAD("Main");
+    // Counters that cannot be opened leave the stages empty, the run goes on.
+    // They count this thread alone, so the pool's workers would go unseen
+    if (counters) {
+        if (config.threadCount != 1) {
+            std::cerr << "--counters only counts the calling thread, running the solver on one thread" << std::endl;
+            config.threadCount = 1;
+        }
+        PerfCounters::Open();
+    }
+    bool allocated = false;
+    std::cout << "{\n  \"benchmarks\": [\n";
+    for (int i = 0; i < precisions.size(); i++) {
+        config.precision = precisions[i];
+        BenchmarkResult result = RunBenchmark(config, scene, steps, counters, warmupSteps);
+        WriteResult(std::cout, result);
+        std::cout << (i + 1 < precisions.size() ? ",\n" : "\n");
+        if (result.hotAllocations > 0) {
+            std::cerr << PrecisionName(result.precision) << ": " << result.hotAllocations << " allocations in solver stages after step "
+                      << warmupSteps << ", the first in " << result.firstHotAllocation << std::endl;
+            allocated = true;
+        }
+    }
+    std::cout << "  ]\n}" << std::endl;
+
+    if (!tracePath.empty() && !Profiler::WriteChromeTrace(tracePath)) {
+        return 1;
+    }
+    return allocated ? 1 : 0;
+}
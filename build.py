@@ -1,12 +1,21 @@
 # Run with: python3 build.py
+# Or: python3 build.py bench, for the windowless solver benchmark
+# Or: python3 build.py headless, for the windowless batch runner
 import os
 import platform
+import sys
+
+# Which executable to build, "prog", "bench" or "headless"
+TARGET=sys.argv[1] if len(sys.argv) > 1 else "prog"
 
 # (1)==================== COMMON CONFIGURATION OPTIONS ======================= #
 COMPILER="g++ -g -std=c++17"   # The compiler we want to use 
                                 #(You may try g++ if you have trouble)
 SOURCE="./src/*.cpp ./src/glad.c"    # Where the source code lives
 EXECUTABLE="prog"        # Name of the final executable
+DEFINES=""               # Build options, e.g. "-D SPH_TABULATED_KERNELS" for lookup table kernels, "-D SPH_PROFILE" for profiler zones, "-D SPH_TRACK_ALLOCATIONS" to count heap allocations
+SANITIZE="-fsanitize=address"   # Runtime checks, dropped for benchmarks
+CORE_SOURCE="./src/AABBTree.cpp ./src/AllocationTracker.cpp ./src/FluidScene.cpp ./src/FluidSolver.cpp ./src/FrameArena.cpp ./src/HeadlessRunner.cpp ./src/PerfCounters.cpp ./src/Profiler.cpp ./src/RigidBody.cpp ./src/SignedDistanceField.cpp ./src/ThreadPool.cpp ./src/TrajectoryCodec.cpp ./src/TrajectoryWriter.cpp ./src/UniformGrid.cpp"   # Solver sources that need no SDL or OpenGL
 # ======================= COMMON CONFIGURATION OPTIONS ======================= #
 
 # (2)=================== Platform specific configuration ===================== #
@@ -18,7 +27,7 @@ LIBRARIES=""            # What libraries do we want to include
 if platform.system()=="Linux":
     ARGUMENTS="-D LINUX" # -D is a #define sent to preprocessor
     INCLUDE_DIR="-I ./include/ -I ./include/glm/"
-    LIBRARIES="-lSDL2 -ldl"
+    LIBRARIES="-lSDL2 -ldl -pthread"
 elif platform.system()=="Darwin":
     ARGUMENTS="-D MAC" # -D is a #define sent to the preprocessor.
     INCLUDE_DIR="-I ./include/ -I/opt/homebrew/include/SDL2 -I./../../common/thirdparty/old/glm"
@@ -30,9 +39,26 @@ elif platform.system()=="Windows":
     LIBRARIES="-lmingw32 -lSDL2main -lSDL2"
 # (2)=================== Platform specific configuration ===================== #
 
+# The benchmark and the headless runner only link the solver, so they build anywhere a compiler does
+if TARGET=="bench":
+    COMPILER="g++ -O2 -std=c++17"
+    SOURCE="./bench/*.cpp "+CORE_SOURCE
+    EXECUTABLE="bench_prog"
+    LIBRARIES="-pthread"
+    SANITIZE=""
+elif TARGET=="headless":
+    COMPILER="g++ -O2 -std=c++17"
+    SOURCE="./headless/*.cpp "+CORE_SOURCE
+    EXECUTABLE="headless_prog"
+    LIBRARIES="-pthread"
+    SANITIZE=""
+elif TARGET!="prog":
+    print("Unknown target "+TARGET+", expected prog, bench or headless")
+    exit(1)
+
 # (3)====================== Building the Executable ========================== #
 # Build a string of our compile commands that we run in the terminal
-compileString=COMPILER+" "+ARGUMENTS+" "+SOURCE+" -o "+EXECUTABLE+" "+" "+INCLUDE_DIR+" "+LIBRARIES+" -fsanitize=address"
+compileString=COMPILER+" "+ARGUMENTS+" "+DEFINES+" "+SOURCE+" -o "+EXECUTABLE+" "+" "+INCLUDE_DIR+" "+LIBRARIES+" "+SANITIZE
 # Print out the compile string
 # This is the command you can type
 print("===============================================================================")
@@ -0,0 +1,160 @@
+/** @file FluidHeadless.cpp
+ *  @brief Runs the interactive scene's fluid with no window or OpenGL,
+ *         for batch jobs on machines that cannot render.
+ *
+ *  Build with: python3 build.py headless
+ *  Run with:   ./headless_prog [--steps=N] [--duration=seconds] [--every=N]
+ *                              [--diagnostics=run.csv] [--quiet]
+ *                              [--trajectory=run.traj] [--record-every=N] [--record-buffers=N]
+ *                              [--quantize] [--velocity-step=v] [--density-step=d]
+ *                              [--keyframe-every=N] [--record-threads=N]
+ *                              [--trace=trace.json] [scene options]
+ *
+ *  Runs until --steps or --duration simulated seconds, 1000 steps if
+ *  neither is given. Every --every steps, 100 unless given, a line of
+ *  progress goes to stderr unless --quiet, and a row of diagnostics to the
+ *  --diagnostics CSV file if one is given. --trajectory records the
+ *  particles every --record-every steps, 10 unless given, on a background
+ *  thread with --record-buffers snapshot buffers, 2 unless given, and
+ *  reports the frames it wrote and dropped when the run ends. --quantize
+ *  records quantized frames instead, velocities and densities rounded to
+ *  --velocity-step and --density-step, a keyframe every --keyframe-every
+ *  frames, coded on --record-threads threads. The scene and its options
+ *  are those of the interactive program, listed in FluidScene.hpp.
+ */
+
+#include "FluidScene.hpp"
+#include "HeadlessRunner.hpp"
+#include "Profiler.hpp"
+#include "TrajectoryWriter.hpp"
+
+// C++ Standard Libraries
+#include <fstream>
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+    long long steps = 0;
+    double duration = 0;
+    int every = 100;
+    bool quiet = false;
+    std::string diagnosticsPath;
+    std::string trajectoryPath;
+    int recordEvery = 10;
+    TrajectoryOptions recordOptions;
+    std::string tracePath;
+    SolverConfig config;
+    SceneOptions scene;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        ArgumentResult result = ParseSceneArgument(arg, config, scene);
+        if (result == ArgumentResult::Invalid) {
+            return 1;
+        } else if (result == ArgumentResult::Parsed) {
+            continue;
+        }
+        if (arg.rfind("--steps=", 0) == 0) {
+            if (!ParseLongArgument(arg, steps)) {
+                return 1;
+            }
+        } else if (arg.rfind("--duration=", 0) == 0) {
+            if (!ParseDoubleArgument(arg, duration)) {
+                return 1;
+            }
+        } else if (arg.rfind("--every=", 0) == 0) {
+            if (!ParseIntArgument(arg, every)) {
+                return 1;
+            }
+        } else if (arg.rfind("--diagnostics=", 0) == 0) {
+            diagnosticsPath = arg.substr(14);
+        } else if (arg.rfind("--trajectory=", 0) == 0) {
+            trajectoryPath = arg.substr(13);
+        } else if (arg.rfind("--record-every=", 0) == 0) {
+            if (!ParseIntArgument(arg, recordEvery)) {
+                return 1;
+            }
+        } else if (arg.rfind("--record-buffers=", 0) == 0) {
+            if (!ParseIntArgument(arg, recordOptions.buffers)) {
+                return 1;
+            }
+        } else if (arg == "--quantize") {
+            recordOptions.quantize = true;
+        } else if (arg.rfind("--velocity-step=", 0) == 0) {
+            if (!ParseDoubleArgument(arg, recordOptions.velocityStep)) {
+                return 1;
+            }
+        } else if (arg.rfind("--density-step=", 0) == 0) {
+            if (!ParseDoubleArgument(arg, recordOptions.densityStep)) {
+                return 1;
+            }
+        } else if (arg.rfind("--keyframe-every=", 0) == 0) {
+            if (!ParseIntArgument(arg, recordOptions.keyframeInterval)) {
+                return 1;
+            }
+        } else if (arg.rfind("--record-threads=", 0) == 0) {
+            if (!ParseIntArgument(arg, recordOptions.threads)) {
+                return 1;
+            }
+        } else if (arg == "--quiet") {
+            quiet = true;
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            tracePath = arg.substr(8);
+        } else {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (steps <= 0 && duration <= 0) {
+        steps = 1000;
+    }
+
+    ConfigureScene(config, scene);
+    HeadlessRunner runner(config);
+    PopulateScene(runner.Solver(), scene);
+
+    if (!quiet) {
+        runner.AddHook(every, ProgressHook(std::cerr));
+    }
+    std::ofstream diagnostics;
+    if (!diagnosticsPath.empty()) {
+        diagnostics.open(diagnosticsPath);
+        if (!diagnostics) {
+            std::cerr << "Could not open diagnostics file " << diagnosticsPath << std::endl;
+            return 1;
+        }
+        runner.AddHook(every, DiagnosticsHook(diagnostics));
+    }
+
+    TrajectoryWriter trajectory;
+    if (!trajectoryPath.empty()) {
+        if (!trajectory.Open(trajectoryPath, config, recordOptions)) {
+            return 1;
+        }
+        runner.AddHook(recordEvery, [&trajectory](const IFluidSolver& solver, const RunProgress& progress) {
+            trajectory.Capture(solver, progress.step, progress.time);
+        });
+    }
+
+    PROFILE_THREAD("Main");
+    runner.Run(steps, duration);
+
+    if (trajectory.IsOpen()) {
+        bool closed = trajectory.Close();
+        TrajectoryStats stats = trajectory.Stats();
+        std::cerr << "Trajectory: " << stats.written << " of " << stats.captured << " frames written, " << stats.dropped << " dropped, "
+                  << "queue depth at most " << stats.maxQueueDepth << ", " << stats.bytesWritten / 1e6 << " MB in "
+                  << stats.writeSeconds << "s of writing" << std::endl;
+        if (recordOptions.quantize && stats.bytesWritten > 0) {
+            std::cerr << "Trajectory: " << double(stats.rawBytes) / stats.bytesWritten << " times smaller than raw frames" << std::endl;
+        }
+        if (!closed) {
+            return 1;
+        }
+    }
+
+    if (!tracePath.empty() && !Profiler::WriteChromeTrace(tracePath)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef AABBTREE_HPP
+#define AABBTREE_HPP
+
+// Third party libraries
+#include <glm/glm.hpp>
+
+// C++ Standard Libraries
+#include <vector>
+
+// Purpose:
+// A dynamic bounding volume hierarchy of axis aligned boxes, for finding
+// which of many moving objects overlap a point or a box.
+//
+// Leaves hold each object's box grown by a margin, so an object that moves
+// less than the margin in a step leaves the tree untouched. One that
+// escapes its box is taken out and inserted again next to the sibling that
+// grows the least, and the boxes above it are refit on the way up.
+// Queries walk down from the root and skip every subtree whose box misses.
+class AABBTree {
+public:
+    // Constructor, margin is how far a leaf box reaches past its object
+    AABBTree(double margin = 0.1);
+
+    // Adds an object's box, returns the leaf that holds it
+    int Insert(glm::dvec2 lower, glm::dvec2 upper, int item);
+    // Removes a leaf
+    void Remove(int leaf);
+    // Moves a leaf to a new box, returns whether the tree changed
+    bool Update(int leaf, glm::dvec2 lower, glm::dvec2 upper);
+
+    // Calls f(item) for every leaf whose box overlaps [lower, upper]
+    template <typename F>
+    void Query(glm::dvec2 lower, glm::dvec2 upper, F&& f) const;
+
+    // Whether the tree holds no leaves
+    bool Empty() const { return root < 0; }
+
+private:
+    struct Node {
+        glm::dvec2 lower;
+        glm::dvec2 upper;
+        int parent = -1;
+        // Children, -1 for a leaf
+        int left = -1;
+        int right = -1;
+        // The object of a leaf, or the next free node
+        int item = -1;
+
+        bool IsLeaf() const { return left < 0; }
+    };
+
+    // Take a node from the free list, or grow the pool
+    int Allocate();
+    // Return a node to the free list
+    void Free(int node);
+    // Link a leaf in next to the sibling whose box grows the least
+    void InsertLeaf(int leaf);
+    // Unlink a leaf, its parent is freed and its sibling takes its place
+    void RemoveLeaf(int leaf);
+    // Recompute the boxes from node up to the root
+    void Refit(int node);
+
+    // Node pool
+    std::vector<Node> nodes;
+    int root = -1;
+    int freeList = -1;
+    double margin;
+    // Nodes left to visit by Query, kept to avoid allocating per query
+    mutable std::vector<int> stack;
+};
+
+template <typename F>
+void AABBTree::Query(glm::dvec2 lower, glm::dvec2 upper, F&& f) const {
+    if (root < 0) return;
+
+    stack.clear();
+    stack.push_back(root);
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (node.upper.x < lower.x || node.lower.x > upper.x || node.upper.y < lower.y || node.lower.y > upper.y) continue;
+        if (node.IsLeaf()) {
+            f(node.item);
+        } else {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef ALLOCATIONTRACKER_HPP
+#define ALLOCATIONTRACKER_HPP
+
+// C++ Standard Libraries
+#include <cstdint>
+#include <vector>
+
+// Heap allocations made and bytes asked for
+struct AllocationCounts {
+    std::uint64_t allocations = 0;
+    std::uint64_t bytes = 0;
+};
+
+// The allocations made under one tag
+struct TagAllocations {
+    const char* tag;
+    AllocationCounts counts;
+};
+
+// Purpose:
+// Counts every heap allocation, to find the code that allocates per frame
+// or per step when it could reuse memory.
+//
+// With SPH_TRACK_ALLOCATIONS defined, AllocationTracker.cpp replaces the
+// global operator new. Each allocation adds to its thread's counters and,
+// if the thread is inside a tagged scope, to the tag's. Counters are
+// atomics owned by one thread, so counting takes no lock and allocates
+// nothing. Tags are set by AllocationScope, and by every COUNT_STAGE, so
+// the solver's stages are tagged with their names.
+//
+// In strict mode an allocation under any tag is a violation. Callers turn
+// strict mode on once the run has warmed up, and fail if Violations is not
+// zero, to keep hot stages free of allocations.
+//
+// Without SPH_TRACK_ALLOCATIONS nothing is counted, every count reads zero
+// and tags cost nothing.
+class AllocationTracker {
+public:
+    // Whether this build counts allocations
+#ifdef SPH_TRACK_ALLOCATIONS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    // Allocations made by the calling thread
+    static AllocationCounts Thread();
+    // Allocations made by every thread
+    static AllocationCounts Total();
+    // Allocations made under each tag by every thread, in order of first use
+    static std::vector<TagAllocations> Tags();
+    // Zero every count, call while no other thread allocates
+    static void Reset();
+
+    // Make tag the calling thread's tag, nullptr for none, and return the one it replaces
+#ifdef SPH_TRACK_ALLOCATIONS
+    static const char* SetTag(const char* tag);
+#else
+    static const char* SetTag(const char*) { return nullptr; }
+#endif
+
+    // Count allocations under a tag as violations
+    static void SetStrict(bool strict);
+    // Allocations under a tag since strict mode was turned on
+    static std::uint64_t Violations();
+    // Tag of the first violation, nullptr if there was none
+    static const char* FirstViolation();
+};
+
+// Tags the calling thread's allocations from its construction to its destruction
+class AllocationScope {
+public:
+    explicit AllocationScope(const char* tag) : previous(AllocationTracker::SetTag(tag)) { }
+    ~AllocationScope() { AllocationTracker::SetTag(previous); }
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+    const char* previous;
+};
+
+#endif
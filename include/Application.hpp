@@ -5,6 +5,9 @@
 #include "Line.hpp"
 #include "Circle.hpp"
 #include "Camera.hpp"
+#include "FrameArena.hpp"
+#include "GpuTimer.hpp"
+#include "PerformanceOverlay.hpp"
 
 // glm libraries
 #define GLM_ENABLE_EXPERIMENTAL
@@ -14,6 +17,7 @@
 
 // C++ Standard Libraries
 #include <iostream>
+#include <memory_resource>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -22,6 +26,7 @@
 #include <thread>
 
 class Simulation;
+struct ParticleView;
 
 class Application{
 public:
@@ -35,8 +40,16 @@ public:
     void PreLoop();
     // Gets the compute shader
     GLuint& getComputeShader();
+    // Gets the timer for GPU work, to time dispatches
+    GpuTimer& getGpuTimer();
+    // Gets the arena for memory that is only needed until the next frame is rendered
+    FrameArena& getFrameArena();
+    // Gets the width of the window in pixels
+    int getWindowWidth() const;
     // Adds objects to the scene
     void AddObject(std::shared_ptr<IObject> object);
+    // Removes an object from the scene, searching from the most recently added
+    void RemoveObject(std::shared_ptr<IObject> object);
     // Adds a simulation to the scene
     void AddSimulation(Simulation* sim);
     // Handles input
@@ -46,10 +59,21 @@ public:
     // Renders objects
     void Render();
     // Draws an object
-    void Draw(std::vector<GLint> &indices);
+    void Draw(const std::pmr::vector<GLint> &indices);
+    // Draws an object with the given matrix instead of the camera's
+    void Draw(const std::pmr::vector<GLint> &indices, const glm::mat4& MVP);
 
 private:
 
+    // Resets the frame arena, with the lists in it emptied first
+    void ResetFrameArena();
+    // Gives a batch's vertices and indices to the GPU
+    void Upload(const std::pmr::vector<GLfloat>& vertices, const std::pmr::vector<GLint>& indices);
+    // Draws the performance overlay over the scene
+    void DrawOverlay();
+    // Appends a disc per particle of a simulation to the circle lists, after the circles before it
+    void AppendParticles(const ParticleView& particles, int firstCircle);
+
     // The program we are running
     SDLGraphicsProgram& program;
     // We use a VAO
@@ -68,17 +92,33 @@ private:
     std::vector<Simulation*> simulations;
 
     // RENDER ALL OBJECTS AT ONCE
+    // Memory for the vertex and index lists, which are rebuilt every frame
+    FrameArena frameArena{256 * 1024};
     // Triangles in scene
     std::vector<std::shared_ptr<Triangle>> triangles;
-    std::vector<GLfloat> triangleVertices;
-    std::vector<GLint> triangleIndices;
+    std::pmr::vector<GLfloat> triangleVertices{&frameArena};
+    std::pmr::vector<GLint> triangleIndices{&frameArena};
     // Lines in scene
     std::vector<std::shared_ptr<Line>> lines;
-    std::vector<GLfloat> lineVertices;
-    std::vector<GLint> lineIndices;
+    std::pmr::vector<GLfloat> lineVertices{&frameArena};
+    std::pmr::vector<GLint> lineIndices{&frameArena};
     // Circles in scene
     std::vector<std::shared_ptr<Circle>> circles;
-    std::vector<GLfloat> circleVertices;
-    std::vector<GLint> circleIndices;
+    std::pmr::vector<GLfloat> circleVertices{&frameArena};
+    std::pmr::vector<GLint> circleIndices{&frameArena};
+    // A unit disc's outline and indices, shared by the particles simulations draw without circles
+    std::vector<glm::vec2> particleOutline;
+    std::vector<GLuint> particleIndices;
+
+    // PERFORMANCE OVERLAY
+    // Times the draws on the GPU
+    GpuTimer gpuTimer;
+    PerformanceOverlay overlay;
+    // Toggled with F3
+    bool showOverlay = false;
+    // Counted while rendering, recorded at the start of the next frame
+    FrameStats frameStats;
+    std::pmr::vector<GLfloat> overlayVertices{&frameArena};
+    std::pmr::vector<GLint> overlayIndices{&frameArena};
 
 };
\ No newline at end of file
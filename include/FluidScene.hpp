@@ -0,0 +1,70 @@
+#ifndef FLUIDSCENE_HPP
+#define FLUIDSCENE_HPP
+
+#include "IFluidSolver.hpp"
+
+// C++ Standard Libraries
+#include <string>
+
+// What the scene holds beyond the solver's own options
+struct SceneOptions {
+    // Particles per side of the starting block. The interactive block is
+    // 12 x 12, other sizes scale the particles to fill the same block
+    int grid = 12;
+    // Time step, 0 for the mode's default: the explicit step of 1/120 s
+    // scaled with the particles, 4 times that for PCISPH, and 1/60 s for
+    // Position Based Fluids whatever the grid
+    double deltaTime = 0;
+    // A nozzle high on the left and a drain in the bottom right corner
+    bool inflow = false;
+    // Drop a light ball, a box and a wedge onto the fluid
+    bool bodies = false;
+    // Drop this many circles, boxes and triangles on a grid above the fluid instead
+    int bodyCount = 0;
+};
+
+// How ParseSceneArgument took an argument
+enum class ArgumentResult {
+    // A scene or solver option, now set
+    Parsed,
+    // Not one of them, for the program to handle
+    Unknown,
+    // One of them with a value it cannot use, the error is already printed
+    Invalid
+};
+
+// Purpose:
+// The scene every program runs: a block of particles in the middle of the
+// tank, with optional inflow and rigid bodies, and the command line
+// options that set it and the solver up.
+//
+// The interactive program, the headless runner and the benchmark all read
+// their solver options through ParseSceneArgument, then ConfigureScene
+// fills in the tank and PopulateScene adds the particles and bodies to the
+// solver. Nothing here depends on SDL or OpenGL.
+//
+// Options: --precision=float|double|mixed, --mode=explicit|pcisph|pbf,
+// --mu=viscosity, --implicit-viscosity, --sleep, --adaptive, --levels=N,
+// --courant=fraction, --sparse-grid, --adaptive-resolution,
+// --merge-levels=N, --boundary=shapes.txt, --threads=N, --grid=N,
+// --dt=seconds, --inflow, --bodies and --bodies=N.
+
+// Read the value of a "--flag=value" argument, all of it. A value that is
+// not a number, or does not fit, prints an error naming the flag and
+// returns false with value untouched
+bool ParseIntArgument(const std::string& arg, int& value);
+bool ParseLongArgument(const std::string& arg, long long& value);
+bool ParseDoubleArgument(const std::string& arg, double& value);
+
+// Read one command line argument into config and scene
+ArgumentResult ParseSceneArgument(const std::string& arg, SolverConfig& config, SceneOptions& scene);
+
+// Set the tank, the particle size and the time step for the scene, and add
+// the nozzle and drain if it has inflow. Call once, after the arguments
+void ConfigureScene(SolverConfig& config, const SceneOptions& scene);
+
+// Add the starting block of particles and the bodies to a solver created
+// from the configured config
+void PopulateScene(IFluidSolver& solver, const SceneOptions& scene);
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef FLUIDSOLVER_HPP
+#define FLUIDSOLVER_HPP
+
+#include "AABBTree.hpp"
+#include "FrameArena.hpp"
+#include "IFluidSolver.hpp"
+#include "Integrators.hpp"
+#include "Kernels.hpp"
+#include "PairBuffer.hpp"
+#include "ParticleStore.hpp"
+#include "TabulatedKernel.hpp"
+#include "ThreadPool.hpp"
+#include "UniformGrid.hpp"
+
+// C++ Standard Libraries
+#include <vector>
+
+// Purpose:
+// The SPH fluid solver, with no dependency on SDL or OpenGL.
+//
+// Scalar is the type particle state is stored and integrated in, PairScalar
+// the type pair interactions (kernels, densities, forces) are computed in.
+// Offsets between particles are taken in Scalar before being narrowed, so
+// the mixed instantiation keeps the precision of double positions while
+// running the neighbor loops in float.
+//
+// The member definitions live in FluidSolver.cpp, which instantiates the
+// three supported combinations.
+template <typename Scalar, typename PairScalar>
+class FluidSolver: public IFluidSolver {
+public:
+    using Vec = glm::vec<3, Scalar>;
+    using PairVec = glm::vec<3, PairScalar>;
+    using Integrator = SemiImplicitEuler<Scalar>;
+
+    // The kernels the solver runs with, picked at compile time.
+    // Build with -D SPH_TABULATED_KERNELS to use lookup tables instead.
+#ifdef SPH_TABULATED_KERNELS
+    using Kernels = SPHKernelSet<
+        TabulatedKernel<SpikyKernel<2, PairScalar>>,
+        TabulatedKernel<SharpSpikyKernel<2, PairScalar>>,
+        TabulatedKernel<SpikyKernel<2, PairScalar>>,
+        TabulatedKernel<SharpSpikyKernel<2, PairScalar>>,
+        ViscosityKernel<2, PairScalar>
+    >;
+#else
+    using Kernels = SPHKernelSet<
+        SpikyKernel<2, PairScalar>,
+        SharpSpikyKernel<2, PairScalar>,
+        SpikyKernel<2, PairScalar>,
+        SharpSpikyKernel<2, PairScalar>,
+        ViscosityKernel<2, PairScalar>
+    >;
+#endif
+
+    // Constructor
+    FluidSolver(const SolverConfig& config);
+    // Destructor
+    ~FluidSolver();
+
+    /* HELPER METHODS */
+
+    // Used to calculate the shared pressure
+    PairScalar CalculateSharedPressure(PairScalar density1, PairScalar density2) const;
+    // Calculates density and near density in one sweep over the neighbors,
+    // recording every pair inside the support in the pair buffer
+    void CalculateDensity(int index);
+    // Calculates the pressure and viscosity acceleration on a given particle from its recorded pairs
+    PairVec CalculateForces(int index) const;
+    // Calculates the viscosity acceleration alone
+    PairVec CalculateViscosity(int index) const;
+    // Calculates the near pressure acceleration alone
+    PairVec CalculateNearPressure(int index) const;
+    // Rest density and constraint softness of a particle inside a perfect lattice,
+    // and the density profile of the tank walls
+    void CalculateRestDensity();
+    // Density a wall at a given distance adds, and its derivative along the wall normal
+    PairScalar WallDensity(PairScalar distance, PairScalar& slope) const;
+    // Density all walls add at a position, and its gradient
+    PairScalar CalculateWallDensity(const Vec& position, PairVec& gradient) const;
+    // Move a position that left the fluid back onto the nearest boundary, returns whether it moved
+    bool ProjectToBoundary(Vec& position) const;
+    // Compression of the current densities against the rest density
+    void MeasureDensityError();
+
+    /* HELPER METHODS */
+
+    /* UPDATE LOOP */
+
+    // Apply gravitational forces and predict positions
+    void ApplyGravitationalForces();
+    // Bin the predicted positions into the grid
+    void CreateHashTable();
+    // Calculate the densities of all particles and fill the pair buffer
+    void CalculateDensities();
+    // Apply the pressure and viscosity forces
+    void ApplyPressureForces();
+    // Update positions of all particles
+    void UpdatePositions();
+    // Handle collisions between walls
+    void HandleCollisions(int index);
+    // Explicit equation of state step
+    void StepExplicit();
+
+    /* UPDATE LOOP */
+
+    /* PCISPH */
+
+    // Predictive-corrective step, pressure is iterated until the density error is within tolerance
+    void StepPCISPH();
+    // Gravity, viscosity and near pressure, which stay fixed during the pressure iterations
+    void CalculateExternalAccelerations();
+    // Predict positions from the current pressure accelerations
+    void PredictPCISPHPositions();
+    // Update pressures from the predicted densities, returns the average density error
+    PairScalar CorrectPCISPHPressures();
+    // Add the accelerations of the pressure changes of the last correction
+    void CalculatePressureAccelerations();
+
+    /* PCISPH */
+
+    /* POSITION BASED FLUIDS */
+
+    // Position based step, density constraints are projected on the predicted positions
+    void StepPBF();
+    // Scale factors of the density constraints at the predicted positions
+    void CalculateLambdas();
+    // Move the predicted positions by the constraint corrections, one Jacobi iteration
+    void ApplyPositionCorrections();
+    // Blend each velocity towards its neighbors'
+    void ApplyXSPHViscosity();
+
+    /* POSITION BASED FLUIDS */
+
+    /* IMPLICIT VISCOSITY */
+
+    // Solve (M + dt K) v = M v* for the velocities, K being the viscosity
+    // operator over the neighbor graph, with Jacobi preconditioned conjugate gradients
+    void SolveImplicitViscosity();
+    // result = (M + dt K) x, without assembling the matrix, split over threads by grid cell
+    void MultiplyViscosity(const std::vector<Vec>& x, std::vector<Vec>& result);
+
+    /* IMPLICIT VISCOSITY */
+
+    /* MULTIPLE TIME STEPPING */
+
+    // Explicit step split into 2^maxTimeLevels substeps, a particle is only
+    // updated on the substeps where its own step ends
+    void StepMultiRate();
+    // Level of a particle from its speed and acceleration, the CFL condition
+    int CalculateTimeLevel(int index) const;
+
+    /* MULTIPLE TIME STEPPING */
+
+    /* SLEEPING */
+
+    // Count resting steps per cell, put cells that rested long enough to
+    // sleep and wake the ones next to motion, then flag the particles
+    void UpdateSleeping();
+
+    /* SLEEPING */
+
+    /* RIGID BODIES */
+
+    // Push a particle out of the bodies it entered, trading an impulse with each
+    void CollideWithBodies(int index);
+    // Integrate the bodies with the impulses of the step, keep them in the tank and refit the tree
+    void StepRigidBodies();
+
+    /* RIGID BODIES */
+
+    /* EMITTERS AND SINKS */
+
+    // Lay down the rows of particles the emitters owe for this step
+    void EmitParticles();
+    // Remove the particles that ended the step inside a sink
+    void DrainParticles();
+
+    /* EMITTERS AND SINKS */
+
+    /* ADAPTIVE RESOLUTION */
+
+    // Split coarse particles near the surface or in shear, merge calm interior pairs
+    void AdaptResolution();
+    // Kernel support of a particle of a merge level
+    Scalar LevelSmoothing(int level) const;
+
+    /* ADAPTIVE RESOLUTION */
+
+    // IFluidSolver
+    int AddParticle(const glm::dvec3& position, const glm::dvec3& velocity, double mass) override;
+    void RemoveParticle(std::size_t index) override;
+    void Step() override;
+    void WakeRegion(const glm::dvec3& position, double radius) override;
+    int AddBody(const RigidBody& body) override;
+    std::size_t BodyCount() const override;
+    RigidBody& Body(std::size_t index) override;
+    std::size_t ParticleCount() const override;
+    glm::vec3 Position(std::size_t index) const override;
+    glm::vec3 Velocity(std::size_t index) const override;
+    float Density(std::size_t index) const override;
+    int ParticleId(std::size_t index) const override;
+    SolverDiagnostics Diagnostics() const override;
+    const SolverConfig& Config() const override;
+    const StepStats& Stats() const override;
+    KernelErrors KernelTableErrors() const override;
+
+    // Kernels, exposed for error reporting
+    const Kernels& GetKernels() const { return kernels; }
+
+private:
+    // The configuration the solver was built from
+    SolverConfig config;
+    // Particle state
+    ParticleStore<Scalar> particles;
+    // Accelerations from the force pass
+    std::vector<Vec> accelerations;
+    // Neighbor pairs from the density pass
+    PairBuffer<PairScalar> pairs;
+    // PCISPH pressures, the accelerations they cause and how much each
+    // pressure changed in the last correction
+    std::vector<PairScalar> pressures;
+    std::vector<Vec> pressureAccelerations;
+    std::vector<PairScalar> pressureChanges;
+    // Position Based Fluids constraint scale factors and the position corrections they cause
+    std::vector<PairScalar> lambdas;
+    std::vector<Vec> corrections;
+    // Gradient of every recorded pair, of the density for PCISPH and of the
+    // density constraint for Position Based Fluids
+    std::vector<PairVec> pairGradients;
+    // Implicit viscosity solution of the last step, the first guess of the next,
+    // and the conjugate gradient work vectors
+    std::vector<Vec> viscousVelocities;
+    std::vector<Vec> viscosityResidual;
+    std::vector<Vec> viscosityDirection;
+    std::vector<Vec> viscosityProduct;
+    std::vector<Vec> viscosityPreconditioned;
+    std::vector<Scalar> viscosityDiagonal;
+    // Time level of each particle, the substep its current step ends on,
+    // the level it asks for, and whether it is updated on this substep
+    std::vector<int> timeLevels;
+    std::vector<long long> stepEnds;
+    std::vector<int> timeLevelTargets;
+    std::vector<unsigned char> stepDue;
+    // Particles updated on this substep
+    std::vector<int> dueParticles;
+    // Substeps taken since the start
+    long long substepClock = 0;
+    // Velocities at the end of the last step, to tell resting particles by their change of speed
+    std::vector<Vec> sleepVelocities;
+    // Per cell: steps all its particles rested, whether it sleeps, how many
+    // particles it held when it fell asleep, and whether anything in it moved
+    // or changed speed this step
+    std::vector<int> cellRestSteps;
+    std::vector<unsigned char> cellAsleep;
+    std::vector<int> cellSleepCounts;
+    std::vector<unsigned char> cellMoving;
+    std::vector<unsigned char> cellRestless;
+    // Statistics of the last step
+    StepStats stats;
+    // Cells to efficiently find neighbors
+    UniformGrid grid;
+    // Precomputed smoothing kernels
+    Kernels kernels;
+    // Workers for the parallel passes
+    ThreadPool threads;
+    // Config values narrowed to the types they are used in
+    Scalar width;
+    Scalar height;
+    Scalar gravity;
+    Scalar dampeningConstant;
+    Scalar deltaTime;
+    PairScalar mu;
+    PairScalar targetDensity;
+    PairScalar stiffness;
+    PairScalar nearStiffness;
+    // Density of a particle inside a perfect lattice at the rest spacing
+    PairScalar restDensity;
+    // Softening added to the density constraint gradients
+    PairScalar constraintSoftness;
+    // Density of a wall filled with particles at the rest spacing, sampled by distance
+    std::vector<PairScalar> wallDensities;
+    std::vector<PairScalar> wallSlopes;
+    PairScalar wallSampleSpacing;
+    // The tank and its obstacles, empty when the tank has no obstacles
+    SignedDistanceField boundary;
+    // Rigid bodies, the tree leaf of each, and the tree particles look them up in
+    std::vector<RigidBody> bodies;
+    std::vector<int> bodyLeaves;
+    AABBTree bodyTree;
+    // Distance each emitter's last row has moved since it was laid down
+    std::vector<double> emitterDistances;
+    // Particles found inside the sinks
+    std::vector<int> drained;
+    // Scratch that lives one step, reset at the start of each Step
+    FrameArena stepArena{4 * 1024};
+    // Steps until the next split and merge pass
+    int refinementCountdown = 0;
+    // Per particle for the split and merge pass: 2 on or next to the free
+    // surface, 1 half way there, the shear rate, and whether it was already
+    // split or merged this pass
+    std::vector<unsigned char> surfaceBand;
+    std::vector<Scalar> shearRates;
+    std::vector<unsigned char> refined;
+    // Merged particles to remove once the pass is over
+    std::vector<int> mergedAway;
+};
+
+#endif
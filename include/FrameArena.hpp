@@ -0,0 +1,71 @@
+#ifndef FRAMEARENA_HPP
+#define FRAMEARENA_HPP
+
+// C++ Standard Libraries
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Purpose:
+// Memory for data that lives one frame or one solver step, handed out by
+// bumping a pointer and taken back all at once by Reset.
+//
+// The arena is a std::pmr::memory_resource, so standard containers use it
+// through a std::pmr::vector or any other pmr container. Freeing does
+// nothing; the memory comes back only when Reset is called. Nothing
+// allocated before a Reset can be used after it.
+//
+// The arena holds its memory in blocks taken from the heap. When a block
+// runs out, the next one is used, or a new block twice as large is made.
+// A Reset that finds more than one block in use swaps them for a single
+// block big enough for all of them. After a few frames, one block holds a
+// whole frame, so each Reset only rewinds a pointer and a frame makes no
+// heap allocations.
+class FrameArena : public std::pmr::memory_resource {
+public:
+    // Constructor, the first block is made on first use
+    explicit FrameArena(std::size_t initialBytes = 64 * 1024);
+    // Destructor, frees every block
+    ~FrameArena() override;
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Take back everything handed out
+    void Reset();
+    // Bytes handed out since the last Reset, padding included
+    std::size_t Used() const;
+    // Bytes held in blocks
+    std::size_t Capacity() const { return capacity; }
+    // The most bytes used between two Resets
+    std::size_t HighWater() const { return highWater; }
+
+private:
+    // One block of memory, used from the front
+    struct Block {
+        char* memory;
+        std::size_t size;
+    };
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void*, std::size_t, std::size_t) override { }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    // Add a block of at least the given size after the last one
+    void AddBlock(std::size_t minimum);
+    // Free every block
+    void Release();
+
+    std::size_t initialBytes;
+    // The blocks in order of use, current is the one being bumped
+    std::vector<Block> blocks;
+    std::size_t current = 0;
+    // Bytes of the current block handed out
+    std::size_t offset = 0;
+    // Bytes of the blocks before the current one, counted as used
+    std::size_t usedBefore = 0;
+    std::size_t capacity = 0;
+    std::size_t highWater = 0;
+};
+
+#endif
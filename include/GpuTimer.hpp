@@ -0,0 +1,73 @@
+#ifndef GPUTIMER_HPP
+#define GPUTIMER_HPP
+
+// Third party libraries
+#include <glad/glad.h> // The glad library helps setup OpenGL extensions.
+
+// C++ Standard Libraries
+#include <cstdint>
+#include <vector>
+
+// Purpose:
+// Measures how long the GPU spends on draws and dispatches.
+//
+// A CPU zone around a draw call only times handing the commands to the
+// driver. Here Begin and End each write a GL_TIMESTAMP query, which the
+// GPU fills in when it gets to that point of the command stream. Asking
+// for a result right away would wait for the GPU to catch up, so the
+// queries of a frame are read back framesInFlight frames later, when they
+// are normally long done; a frame whose results are still not there is
+// dropped rather than waited for.
+//
+// Timestamps, unlike GL_TIME_ELAPSED queries, may nest. Results go to the
+// profiler's "GPU" track, moved onto the CPU clock, and the total of the
+// outermost zones of the last read frame to FrameMilliseconds.
+class GpuTimer {
+public:
+    // Frames between issuing a query and reading it
+    static constexpr int framesInFlight = 4;
+    // Zones timed per frame, later ones are not timed
+    static constexpr int zonesPerFrame = 32;
+
+    // Destructor
+    ~GpuTimer();
+
+    // Create the query pool, once there is a GL context
+    void Init();
+    // Read back the oldest frame and start timing a new one
+    void BeginFrame();
+    // Time the commands issued until the matching End
+    void Begin(const char* name);
+    void End();
+
+    // GPU time of the outermost zones of the last frame read back
+    double FrameMilliseconds() const { return frameMilliseconds; }
+    // Frames whose results were not ready in time
+    int DroppedFrames() const { return droppedFrames; }
+
+private:
+    // One timed zone of a frame
+    struct Zone {
+        const char* name;
+        // Zones it is nested in
+        int depth;
+    };
+
+    // Map GL_TIMESTAMP onto the profiler's clock
+    void Calibrate();
+
+    // Two queries per zone, zonesPerFrame zones per frame in flight
+    std::vector<GLuint> queries;
+    // The zones begun in each frame in flight
+    std::vector<Zone> zones[framesInFlight];
+    // Zones of the current frame that are still open, -1 for one that is not timed
+    std::vector<int> open;
+    // Frames begun so far, the current one is frame % framesInFlight
+    std::uint64_t frame = 0;
+    // Profiler clock minus GPU clock, in nanoseconds
+    std::int64_t clockOffset = 0;
+    double frameMilliseconds = 0;
+    int droppedFrames = 0;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef HEADLESSRUNNER_HPP
+#define HEADLESSRUNNER_HPP
+
+#include "IFluidSolver.hpp"
+
+// C++ Standard Libraries
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+// Where a run is, as told to the hooks
+struct RunProgress {
+    // Steps taken so far, 0 before the first
+    long long step = 0;
+    // Simulated seconds, steps times the time step
+    double time = 0;
+    // Wall clock seconds since the run started
+    double wallSeconds = 0;
+    // Whether this is the last call of the run
+    bool last = false;
+};
+
+// Purpose:
+// Runs a fluid solver with no window, OpenGL context or Application, for
+// batch jobs on machines that cannot render.
+//
+// The runner owns the solver. Callers fill it through Solver() before the
+// run, then Run steps it as fast as it goes, for a number of steps or of
+// simulated seconds, whichever comes first. Output goes through hooks:
+// each is called with the solver and the progress before the first step,
+// after every so many steps, and once more after the last step if its
+// stride did not land there. A hook may call Stop to end the run early.
+//
+// Nothing here depends on SDL or OpenGL, so a program embedding the solver
+// links this with the solver sources alone, the way the benchmark does.
+class HeadlessRunner {
+public:
+    // Called with the solver between steps, it must not step the solver itself
+    using Hook = std::function<void(const IFluidSolver& solver, const RunProgress& progress)>;
+
+    // Constructor
+    HeadlessRunner(const SolverConfig& config);
+
+    // The solver, to add particles and bodies to before the run
+    IFluidSolver& Solver() { return *solver; }
+    // Calls hook before the first step and after every stride steps
+    void AddHook(int stride, Hook hook);
+    // Steps until steps were taken or duration simulated seconds passed, 0
+    // for no limit on either, returning the steps taken. Runs until Stop is
+    // called if neither is limited
+    long long Run(long long steps, double duration);
+    // Ends the run after the current step, callable from a hook or another thread
+    void Stop() { stopping = true; }
+
+private:
+    // A hook and how many steps apart it is called
+    struct HookEntry {
+        int stride;
+        Hook hook;
+        // Step the hook was last called at, -1 before the run
+        long long calledAt = -1;
+    };
+
+    // Call every hook due at this progress
+    void CallHooks(const RunProgress& progress);
+
+    std::unique_ptr<IFluidSolver> solver;
+    std::vector<HookEntry> hooks;
+    std::atomic<bool> stopping{false};
+};
+
+// A hook writing one line of progress per call: step, simulated time,
+// particles, total energy and the steps per second since the last call
+HeadlessRunner::Hook ProgressHook(std::ostream& out);
+// A hook writing the diagnostics as CSV, with a header on the first call
+HeadlessRunner::Hook DiagnosticsHook(std::ostream& out);
+
+#endif
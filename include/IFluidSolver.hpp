@@ -0,0 +1,254 @@
+#ifndef IFLUIDSOLVER_HPP
+#define IFLUIDSOLVER_HPP
+
+#include "RigidBody.hpp"
+#include "SignedDistanceField.hpp"
+
+// Third party libraries
+#include <glm/glm.hpp>
+
+// C++ Standard Libraries
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Purpose:
+// The interface between a fluid solver and whatever drives it.
+//
+// The solver itself is a template over its scalar types (see FluidSolver.hpp)
+// and never touches SDL or OpenGL. Callers pick an instantiation once at
+// startup through CreateFluidSolver and talk to it through this interface,
+// so the only virtual call is per step or per particle read back, never in
+// the neighbor loops.
+
+// The scalar types a solver is instantiated with
+enum class Precision {
+    Single, // float everywhere
+    Double, // double everywhere
+    Mixed   // double positions and velocities, float pair interactions
+};
+
+// How pressure is resolved
+enum class SolverMode {
+    Explicit,     // Equation of state pressure, one pass per step
+    PCISPH,       // Predictive-corrective pressure iterations to a density error tolerance
+    PositionBased // Position Based Fluids, a fixed number of density constraint iterations
+};
+
+// A nozzle particles flow into the tank through
+struct ParticleEmitter {
+    // Center of the nozzle opening
+    glm::dvec2 position = {0, 0};
+    // Velocity of the emitted particles, the nozzle faces along it
+    glm::dvec2 velocity = {0, -1};
+    // Width of the opening, a row of particles spans it
+    double width = 0.4;
+};
+
+// Everything needed to set up a solver
+struct SolverConfig {
+    // Half width of the tank
+    double width = 2.4;
+    // Half height of the tank
+    double height = 2.4;
+    // The smoothing distance between particles
+    double smoothingDistance = 0.4;
+    // Gravity
+    double gravity = 10;
+    // Dampening constant for collisions against walls
+    double dampeningConstant = 0.6;
+    // Time control
+    double deltaTime = 1.0 / 120.0;
+    // Viscoscity factor
+    double mu = 0.1;
+    // Target density, for the 2D kernel normalization
+    double targetDensity = 5.33;
+    // Pressure per unit of density error, the default matches a per step impulse at 120Hz
+    double stiffness = 120;
+    // Near pressure per unit of near density, keeps particles from clumping
+    double nearStiffness = 12;
+    // Scalar types of the solver
+    Precision precision = Precision::Single;
+    // Pressure solver
+    SolverMode mode = SolverMode::Explicit;
+    // Spacing of the particles at rest, which sets the rest density the
+    // incompressible solvers drive towards and every mode is measured against
+    double particleSpacing = 2.4 / 11;
+    // Mass of a particle
+    double particleMass = 1;
+    // PCISPH stops once the average compression is below this fraction of the rest density
+    double densityErrorTolerance = 0.01;
+    // PCISPH iteration bounds per step
+    int minPressureIterations = 3;
+    int maxPressureIterations = 50;
+    // Position Based Fluids constraint iterations per step
+    int constraintIterations = 4;
+    // Softens the density constraints, as a fraction of their stiffness inside a lattice
+    double constraintRelaxation = 0.01;
+    // XSPH velocity smoothing, the fraction of the velocity difference to the neighbors removed per step
+    double xsphViscosity = 0.05;
+    // Solve viscosity implicitly instead of as a force, for thick fluids with a high mu
+    bool implicitViscosity = false;
+    // The implicit solve stops once the residual is below this fraction of the right hand side
+    double viscosityTolerance = 1e-4;
+    // Implicit viscosity iteration limit per step
+    int maxViscosityIterations = 100;
+    // Threads for the parallel passes, 0 uses every hardware thread
+    int threadCount = 0;
+    // Hash the neighbor grid's cells instead of covering the tank with them,
+    // for big tanks the fluid fills little of
+    bool sparseGrid = false;
+    // Let resting cells fall asleep, skipping their particles until something wakes them
+    bool sleeping = false;
+    // A particle counts as resting below this speed and this change of speed per second
+    double sleepVelocity = 0.1;
+    double sleepAcceleration = 1.0;
+    // Steps every particle in a cell has to rest before the cell falls asleep
+    int sleepSteps = 60;
+    // Explicit mode only: give each particle its own step, deltaTime / 2^level,
+    // with deltaTime the coarsest step
+    bool adaptiveTimeSteps = false;
+    // Finest level, deltaTime / 2^maxTimeLevels is the smallest step
+    int maxTimeLevels = 3;
+    // Fraction of the smoothing distance a particle may travel in one step
+    double courantNumber = 0.4;
+    // Explicit mode only: merge pairs of calm interior particles into one of
+    // twice the mass, and split them again near the free surface or in shear
+    bool adaptiveResolution = false;
+    // A particle stands for at most 2^maxMergeLevels particles of particleMass
+    int maxMergeLevels = 1;
+    // Steps between passes that split and merge
+    int refinementInterval = 10;
+    // Particles whose density gradient over one support, walls counted, is
+    // more than this fraction of their density are on the free surface
+    double surfaceThreshold = 0.5;
+    // Particles split above this velocity gradient, in 1/s, and only merge below half of it
+    double splitShearRate = 10.0;
+    // Solid obstacles inside the tank. With any, the tank and the obstacles
+    // are baked into a signed distance field that collisions and wall
+    // density are looked up in
+    std::vector<BoundaryShape> obstacles;
+    // Node spacing of the field, 0 uses a quarter of the smoothing distance
+    double boundaryCellSize = 0;
+    // Nozzles that add a row of particles every time the last row moved one particle spacing
+    std::vector<ParticleEmitter> emitters;
+    // Drains, particles that end a step inside one are removed
+    std::vector<BoundaryShape> sinks;
+    // Emitters stop at this many particles, 0 for no limit. Storage for
+    // this many is reserved up front, so emitting never reallocates
+    int maxParticles = 0;
+};
+
+// What the last step did
+struct StepStats {
+    // Pressure solver iterations
+    int pressureIterations = 0;
+    // Average compression relative to the rest density
+    double averageDensityError = 0;
+    // Largest compression relative to the rest density
+    double maxDensityError = 0;
+    // Implicit viscosity conjugate gradient iterations
+    int viscosityIterations = 0;
+    // Implicit viscosity residual relative to the right hand side
+    double viscosityResidual = 0;
+    // Particles and occupied cells the passes did not skip
+    int activeParticles = 0;
+    int activeCells = 0;
+    // Pairs the last density pass stored, and the most any one particle had
+    int neighborPairs = 0;
+    int maxNeighbors = 0;
+    // Particles per time level at the end of the step, level 0 being deltaTime
+    std::vector<int> timeLevelCounts;
+    // Finest level any particle stepped at
+    int finestTimeLevel = 0;
+    // Particle force evaluations during the step
+    int forceEvaluations = 0;
+    // Particles the emitters added and the sinks removed at the end of the step
+    int emittedParticles = 0;
+    int removedParticles = 0;
+    // Particles split into two and pairs merged into one at the end of the step
+    int splitParticles = 0;
+    int mergedParticles = 0;
+};
+
+// How far the kernel lookup tables are from the analytic kernels
+struct KernelErrors {
+    // Whether the solver was built with -D SPH_TABULATED_KERNELS
+    bool tabulated = false;
+    // Largest absolute error of the density kernel and of the pressure
+    // kernel's derivative, 0 unless tabulated
+    double maxDensityError = 0;
+    double maxPressureGradientError = 0;
+};
+
+// Conserved quantities, always accumulated in double
+struct SolverDiagnostics {
+    // Sum of 1/2 m v^2
+    double kineticEnergy = 0;
+    // Sum of m g y, measured from the bottom of the tank
+    double potentialEnergy = 0;
+    // Sum of m v
+    glm::dvec3 momentum = {0, 0, 0};
+};
+
+class IFluidSolver {
+public:
+    // Constructor
+    IFluidSolver() {}
+    // Destructor
+    virtual ~IFluidSolver() {}
+
+    // Adds a particle and returns its index
+    virtual int AddParticle(const glm::dvec3& position, const glm::dvec3& velocity, double mass) = 0;
+    // Removes a particle, the last particle takes its index
+    virtual void RemoveParticle(std::size_t index) = 0;
+    // Advances the simulation by one time step
+    virtual void Step() = 0;
+    // Wakes every sleeping cell within radius of a position, for anything that
+    // pushes the fluid from outside the solver
+    virtual void WakeRegion(const glm::dvec3& position, double radius) = 0;
+    // Adds a rigid body the fluid collides with and returns its index
+    virtual int AddBody(const RigidBody& body) = 0;
+    // Number of rigid bodies in the solver
+    virtual std::size_t BodyCount() const = 0;
+    // A rigid body, writable so kinematic bodies can be driven between steps
+    virtual RigidBody& Body(std::size_t index) = 0;
+
+    // Number of particles in the solver
+    virtual std::size_t ParticleCount() const = 0;
+    // Position of a particle, narrowed for rendering
+    virtual glm::vec3 Position(std::size_t index) const = 0;
+    // Velocity of a particle, narrowed for rendering
+    virtual glm::vec3 Velocity(std::size_t index) const = 0;
+    // Density of a particle from the last step
+    virtual float Density(std::size_t index) const = 0;
+    // Id of a particle, which unlike its index stays the same until it is removed
+    virtual int ParticleId(std::size_t index) const = 0;
+
+    // Energy and momentum of the current state
+    virtual SolverDiagnostics Diagnostics() const = 0;
+    // Statistics of the last step
+    virtual const StepStats& Stats() const = 0;
+    // The configuration the solver was created with
+    virtual const SolverConfig& Config() const = 0;
+    // Errors of the kernel lookup tables, measured when the solver was created
+    virtual KernelErrors KernelTableErrors() const = 0;
+};
+
+// Creates the solver instantiation matching config.precision
+std::unique_ptr<IFluidSolver> CreateFluidSolver(const SolverConfig& config);
+
+// Fills the box between lower and upper with a steps x steps grid of particles
+void SpawnParticleGrid(IFluidSolver& solver, glm::dvec3 lower, glm::dvec3 upper, int steps, double mass);
+
+// Reads a precision from "float", "double" or "mixed"
+bool ParsePrecision(const std::string& name, Precision& precision);
+// The name ParsePrecision accepts for a precision
+const char* PrecisionName(Precision precision);
+// Reads a solver mode from "explicit", "pcisph" or "pbf"
+bool ParseSolverMode(const std::string& name, SolverMode& mode);
+// The name ParseSolverMode accepts for a mode
+const char* SolverModeName(SolverMode mode);
+
+#endif
@@ -6,6 +6,7 @@
 
 // C++ Standard Libraries
 #include <iostream>
+#include <memory>
 #include <variant>
 #include <string>
 #include <sstream>
@@ -0,0 +1,34 @@
+#ifndef INTEGRATORS_HPP
+#define INTEGRATORS_HPP
+
+// Third party libraries
+#include <glm/glm.hpp>
+
+// Purpose:
+// Time integration of particle state, templated on the scalar type the
+// state is kept in.
+
+// Semi implicit (symplectic) Euler: velocity first, then position with the
+// new velocity. Cheap, and its energy error stays bounded for the
+// oscillating systems SPH produces.
+template <typename Scalar>
+struct SemiImplicitEuler {
+    using Vec = glm::vec<3, Scalar>;
+
+    // Applies an acceleration to a velocity
+    static void Kick(Vec& velocity, const Vec& acceleration, Scalar deltaTime) {
+        velocity += acceleration * deltaTime;
+    }
+
+    // Moves a position along a velocity
+    static void Drift(Vec& position, const Vec& velocity, Scalar deltaTime) {
+        position += velocity * deltaTime;
+    }
+
+    // Where a particle would be after a drift, without moving it
+    static Vec Predict(const Vec& position, const Vec& velocity, Scalar deltaTime) {
+        return position + velocity * deltaTime;
+    }
+};
+
+#endif
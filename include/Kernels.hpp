@@ -0,0 +1,463 @@
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+// Purpose:
+// The family of SPH smoothing kernels used by the fluid solver.
+//
+// Every kernel is a small value type templated on the spatial dimension
+// and the scalar type. The dimension picks the normalization constant
+// through a specialization of KernelConstants, and everything that only
+// depends on the smoothing distance h is folded into the kernel when it
+// is constructed. Evaluating a kernel is then a handful of multiplies,
+// with no glm::pow and no branching on the kernel type.
+//
+// All kernels expose the same interface so the solver can take them as
+// template parameters:
+//   - Value(r)        W(r)
+//   - Derivative(r)   dW/dr, the magnitude of the gradient along r
+//   - Laplacian(r)    laplacian of W
+//   - Support()       the radius past which the kernel is zero
+// and the squared distance forms ValueSquared(r2) and DerivativeSquared(r2),
+// which let a density pass skip the sqrt when the kernel allows it.
+
+// C++ Standard Libraries
+#include <cmath>
+
+// Pi as a compile time constant, glm::pi is not constexpr on every version
+template <typename Scalar>
+constexpr Scalar KernelPi = Scalar(3.14159265358979323846264338327950288);
+
+// Integer power usable in constant expressions
+template <typename Scalar>
+constexpr Scalar IntPow(Scalar base, int exponent) {
+    Scalar result = 1;
+    for (int i = 0; i < exponent; i++) {
+        result *= base;
+    }
+    return result;
+}
+
+// Kernel tags used to look up normalization constants
+struct Poly6Tag {};
+struct SpikyTag {};
+struct SharpSpikyTag {};
+struct ViscosityTag {};
+struct CubicSplineTag {};
+struct WendlandC2Tag {};
+struct WendlandC4Tag {};
+
+// Normalization constants per kernel and dimension.
+// sigma is the dimensionless factor, and the full normalization is
+// sigma / h^hPower.
+template <typename Tag, int Dim>
+struct KernelConstants;
+
+template <> struct KernelConstants<Poly6Tag, 2> {
+    static constexpr double sigma = 4.0 / KernelPi<double>;
+    static constexpr int hPower = 8;
+};
+template <> struct KernelConstants<Poly6Tag, 3> {
+    static constexpr double sigma = 315.0 / (64.0 * KernelPi<double>);
+    static constexpr int hPower = 9;
+};
+
+template <> struct KernelConstants<SpikyTag, 2> {
+    static constexpr double sigma = 10.0 / KernelPi<double>;
+    static constexpr int hPower = 5;
+};
+template <> struct KernelConstants<SpikyTag, 3> {
+    static constexpr double sigma = 15.0 / KernelPi<double>;
+    static constexpr int hPower = 6;
+};
+
+template <> struct KernelConstants<SharpSpikyTag, 2> {
+    static constexpr double sigma = 15.0 / KernelPi<double>;
+    static constexpr int hPower = 6;
+};
+template <> struct KernelConstants<SharpSpikyTag, 3> {
+    static constexpr double sigma = 105.0 / (4.0 * KernelPi<double>);
+    static constexpr int hPower = 7;
+};
+
+// The viscosity kernel is only ever used through its laplacian,
+// so the constants here normalize the laplacian rather than W
+template <> struct KernelConstants<ViscosityTag, 2> {
+    static constexpr double sigma = 40.0 / KernelPi<double>;
+    static constexpr int hPower = 5;
+};
+template <> struct KernelConstants<ViscosityTag, 3> {
+    static constexpr double sigma = 45.0 / KernelPi<double>;
+    static constexpr int hPower = 6;
+};
+
+template <> struct KernelConstants<CubicSplineTag, 2> {
+    static constexpr double sigma = 40.0 / (7.0 * KernelPi<double>);
+    static constexpr int hPower = 2;
+};
+template <> struct KernelConstants<CubicSplineTag, 3> {
+    static constexpr double sigma = 8.0 / KernelPi<double>;
+    static constexpr int hPower = 3;
+};
+
+template <> struct KernelConstants<WendlandC2Tag, 2> {
+    static constexpr double sigma = 7.0 / KernelPi<double>;
+    static constexpr int hPower = 2;
+};
+template <> struct KernelConstants<WendlandC2Tag, 3> {
+    static constexpr double sigma = 21.0 / (2.0 * KernelPi<double>);
+    static constexpr int hPower = 3;
+};
+
+template <> struct KernelConstants<WendlandC4Tag, 2> {
+    static constexpr double sigma = 9.0 / KernelPi<double>;
+    static constexpr int hPower = 2;
+};
+template <> struct KernelConstants<WendlandC4Tag, 3> {
+    static constexpr double sigma = 495.0 / (32.0 * KernelPi<double>);
+    static constexpr int hPower = 3;
+};
+
+// Normalization of a kernel for a given smoothing distance
+template <typename Tag, int Dim, typename Scalar>
+constexpr Scalar KernelNormalization(Scalar h) {
+    using Constants = KernelConstants<Tag, Dim>;
+    return Scalar(Constants::sigma) / IntPow(h, Constants::hPower);
+}
+
+// Supplies the squared distance forms for kernels that are written in r.
+// A kernel that is cheaper in r^2 hides these with its own versions.
+template <typename Derived, typename Scalar>
+class KernelBase {
+public:
+    Scalar ValueSquared(Scalar r2) const {
+        return static_cast<const Derived*>(this)->Value(std::sqrt(r2));
+    }
+
+    Scalar DerivativeSquared(Scalar r2) const {
+        return static_cast<const Derived*>(this)->Derivative(std::sqrt(r2));
+    }
+};
+
+// Poly6 kernel, W = sigma (h^2 - r^2)^3
+// Smooth at the origin, a good fit for density estimation
+template <int Dim, typename Scalar = float>
+class Poly6Kernel : public KernelBase<Poly6Kernel<Dim, Scalar>, Scalar> {
+public:
+    static constexpr int dimension = Dim;
+    using ScalarType = Scalar;
+
+    // Constructor
+    constexpr explicit Poly6Kernel(Scalar h)
+        : h(h), h2(h * h), norm(KernelNormalization<Poly6Tag, Dim>(h)) { }
+
+    Scalar Value(Scalar r) const {
+        if (r >= h) return 0;
+        Scalar x = h2 - r * r;
+        return norm * x * x * x;
+    }
+
+    Scalar Derivative(Scalar r) const {
+        if (r >= h) return 0;
+        Scalar x = h2 - r * r;
+        return Scalar(-6) * norm * r * x * x;
+    }
+
+    // Poly6 only depends on r^2, so no sqrt is needed
+    Scalar ValueSquared(Scalar r2) const {
+        if (r2 >= h2) return 0;
+        Scalar x = h2 - r2;
+        return norm * x * x * x;
+    }
+
+    Scalar Laplacian(Scalar r) const {
+        if (r >= h) return 0;
+        Scalar r2 = r * r;
+        Scalar x = h2 - r2;
+        // (d - 1) / r * dW/dr + d^2W/dr^2 collapses to this for poly6
+        return Scalar(-6) * norm * x * (Scalar(Dim) * x - Scalar(4) * r2);
+    }
+
+    constexpr Scalar Support() const { return h; }
+
+private:
+    Scalar h;
+    Scalar h2;
+    Scalar norm;
+};
+
+// Spiky kernel, W = sigma (h - r)^3
+// Its gradient does not vanish at the origin, so particles are kept apart
+template <int Dim, typename Scalar = float>
+class SpikyKernel : public KernelBase<SpikyKernel<Dim, Scalar>, Scalar> {
+public:
+    static constexpr int dimension = Dim;
+    using ScalarType = Scalar;
+
+    // Constructor
+    constexpr explicit SpikyKernel(Scalar h)
+        : h(h), norm(KernelNormalization<SpikyTag, Dim>(h)) { }
+
+    Scalar Value(Scalar r) const {
+        if (r >= h) return 0;
+        Scalar x = h - r;
+        return norm * x * x * x;
+    }
+
+    Scalar Derivative(Scalar r) const {
+        if (r >= h) return 0;
+        Scalar x = h - r;
+        return Scalar(-3) * norm * x * x;
+    }
+
+    Scalar Laplacian(Scalar r) const {
+        if (r >= h) return 0;
+        Scalar x = h - r;
+        // Undefined at r == 0, where the kernel has a cusp
+        if (r <= 0) return 0;
+        return Scalar(6) * norm * x - Scalar(3) * norm * Scalar(Dim - 1) * x * x / r;
+    }
+
+    constexpr Scalar Support() const { return h; }
+
+private:
+    Scalar h;
+    Scalar norm;
+};
+
+// Sharper spiky kernel, W = sigma (h - r)^4
+// Weighs close neighbors even more, used for the near density of
+// double density relaxation
+template <int Dim, typename Scalar = float>
+class SharpSpikyKernel : public KernelBase<SharpSpikyKernel<Dim, Scalar>, Scalar> {
+public:
+    static constexpr int dimension = Dim;
+    using ScalarType = Scalar;
+
+    // Constructor
+    constexpr explicit SharpSpikyKernel(Scalar h)
+        : h(h), norm(KernelNormalization<SharpSpikyTag, Dim>(h)) { }
+
+    Scalar Value(Scalar r) const {
+        if (r >= h) return 0;
+        Scalar x = h - r;
+        Scalar x2 = x * x;
+        return norm * x2 * x2;
+    }
+
+    Scalar Derivative(Scalar r) const {
+        if (r >= h) return 0;
+        Scalar x = h - r;
+        return Scalar(-4) * norm * x * x * x;
+    }
+
+    Scalar Laplacian(Scalar r) const {
+        if (r >= h || r <= 0) return 0;
+        Scalar x = h - r;
+        return Scalar(12) * norm * x * x - Scalar(4) * norm * Scalar(Dim - 1) * x * x * x / r;
+    }
+
+    constexpr Scalar Support() const { return h; }
+
+private:
+    Scalar h;
+    Scalar norm;
+};
+
+// Viscosity kernel of Mueller et al., only its laplacian is needed,
+// laplacian W = sigma (h - r), which stays positive over the support
+template <int Dim, typename Scalar = float>
+class ViscosityKernel {
+public:
+    static constexpr int dimension = Dim;
+    using ScalarType = Scalar;
+
+    // Constructor
+    constexpr explicit ViscosityKernel(Scalar h)
+        : h(h), norm(KernelNormalization<ViscosityTag, Dim>(h)) { }
+
+    Scalar Laplacian(Scalar r) const {
+        if (r >= h) return 0;
+        return norm * (h - r);
+    }
+
+    constexpr Scalar Support() const { return h; }
+
+private:
+    Scalar h;
+    Scalar norm;
+};
+
+// Cubic B-spline of Monaghan with compact support h, q = r / h
+//   W = sigma (6(q^3 - q^2) + 1)    for q <= 1/2
+//   W = sigma 2(1 - q)^3            for q <= 1
+template <int Dim, typename Scalar = float>
+class CubicSplineKernel : public KernelBase<CubicSplineKernel<Dim, Scalar>, Scalar> {
+public:
+    static constexpr int dimension = Dim;
+    using ScalarType = Scalar;
+
+    // Constructor
+    constexpr explicit CubicSplineKernel(Scalar h)
+        : h(h), invH(Scalar(1) / h), norm(KernelNormalization<CubicSplineTag, Dim>(h)) { }
+
+    Scalar Value(Scalar r) const {
+        Scalar q = r * invH;
+        if (q >= 1) return 0;
+        if (q <= Scalar(0.5)) {
+            return norm * (Scalar(6) * (q * q * q - q * q) + Scalar(1));
+        }
+        Scalar x = Scalar(1) - q;
+        return norm * Scalar(2) * x * x * x;
+    }
+
+    Scalar Derivative(Scalar r) const {
+        Scalar q = r * invH;
+        if (q >= 1) return 0;
+        if (q <= Scalar(0.5)) {
+            return norm * invH * Scalar(6) * (Scalar(3) * q * q - Scalar(2) * q);
+        }
+        Scalar x = Scalar(1) - q;
+        return norm * invH * Scalar(-6) * x * x;
+    }
+
+    Scalar Laplacian(Scalar r) const {
+        Scalar q = r * invH;
+        if (q >= 1 || r <= 0) return 0;
+        Scalar second = (q <= Scalar(0.5))
+            ? norm * invH * invH * Scalar(6) * (Scalar(6) * q - Scalar(2))
+            : norm * invH * invH * Scalar(12) * (Scalar(1) - q);
+        return second + Scalar(Dim - 1) * Derivative(r) / r;
+    }
+
+    constexpr Scalar Support() const { return h; }
+
+private:
+    Scalar h;
+    Scalar invH;
+    Scalar norm;
+};
+
+// Wendland C2 kernel, W = sigma (1 - q)^4 (1 + 4q)
+template <int Dim, typename Scalar = float>
+class WendlandC2Kernel : public KernelBase<WendlandC2Kernel<Dim, Scalar>, Scalar> {
+public:
+    static constexpr int dimension = Dim;
+    using ScalarType = Scalar;
+
+    // Constructor
+    constexpr explicit WendlandC2Kernel(Scalar h)
+        : h(h), invH(Scalar(1) / h), norm(KernelNormalization<WendlandC2Tag, Dim>(h)) { }
+
+    Scalar Value(Scalar r) const {
+        Scalar q = r * invH;
+        if (q >= 1) return 0;
+        Scalar x = Scalar(1) - q;
+        Scalar x2 = x * x;
+        return norm * x2 * x2 * (Scalar(1) + Scalar(4) * q);
+    }
+
+    Scalar Derivative(Scalar r) const {
+        Scalar q = r * invH;
+        if (q >= 1) return 0;
+        Scalar x = Scalar(1) - q;
+        return norm * invH * Scalar(-20) * q * x * x * x;
+    }
+
+    Scalar Laplacian(Scalar r) const {
+        Scalar q = r * invH;
+        if (q >= 1) return 0;
+        Scalar x = Scalar(1) - q;
+        // The q in dW/dr cancels the 1 / r of the first order term
+        Scalar second = norm * invH * invH * Scalar(-20) * x * x * (Scalar(1) - Scalar(4) * q);
+        Scalar first = norm * invH * invH * Scalar(-20) * x * x * x * Scalar(Dim - 1);
+        return second + first;
+    }
+
+    constexpr Scalar Support() const { return h; }
+
+private:
+    Scalar h;
+    Scalar invH;
+    Scalar norm;
+};
+
+// Wendland C4 kernel, W = sigma (1 - q)^6 (1 + 6q + 35/3 q^2)
+template <int Dim, typename Scalar = float>
+class WendlandC4Kernel : public KernelBase<WendlandC4Kernel<Dim, Scalar>, Scalar> {
+public:
+    static constexpr int dimension = Dim;
+    using ScalarType = Scalar;
+
+    // Constructor
+    constexpr explicit WendlandC4Kernel(Scalar h)
+        : h(h), invH(Scalar(1) / h), norm(KernelNormalization<WendlandC4Tag, Dim>(h)) { }
+
+    Scalar Value(Scalar r) const {
+        Scalar q = r * invH;
+        if (q >= 1) return 0;
+        Scalar x = Scalar(1) - q;
+        Scalar x2 = x * x;
+        Scalar x6 = x2 * x2 * x2;
+        return norm * x6 * (Scalar(1) + Scalar(6) * q + Scalar(35.0 / 3.0) * q * q);
+    }
+
+    Scalar Derivative(Scalar r) const {
+        Scalar q = r * invH;
+        if (q >= 1) return 0;
+        Scalar x = Scalar(1) - q;
+        Scalar x2 = x * x;
+        Scalar x5 = x2 * x2 * x;
+        return norm * invH * Scalar(-56.0 / 3.0) * q * x5 * (Scalar(1) + Scalar(5) * q);
+    }
+
+    Scalar Laplacian(Scalar r) const {
+        Scalar q = r * invH;
+        if (q >= 1) return 0;
+        Scalar x = Scalar(1) - q;
+        Scalar x2 = x * x;
+        Scalar x4 = x2 * x2;
+        Scalar scale = norm * invH * invH * Scalar(-56.0 / 3.0);
+        // d/dq of q (1 - q)^5 (1 + 5q) is (1 - q)^4 (1 + 4q - 35q^2)
+        Scalar second = scale * x4 * (Scalar(1) + Scalar(4) * q - Scalar(35) * q * q);
+        Scalar first = scale * x4 * x * (Scalar(1) + Scalar(5) * q) * Scalar(Dim - 1);
+        return second + first;
+    }
+
+    constexpr Scalar Support() const { return h; }
+
+private:
+    Scalar h;
+    Scalar invH;
+    Scalar norm;
+};
+
+// The set of kernels a solver runs with.
+// Each role is a template parameter, so picking a different kernel is a
+// change of type and the calls in the neighbor loops stay inlined.
+template <typename DensityKernelT, typename NearDensityKernelT, typename PressureKernelT,
+          typename NearPressureKernelT, typename ViscosityKernelT>
+struct SPHKernelSet {
+    using DensityKernel = DensityKernelT;
+    using NearDensityKernel = NearDensityKernelT;
+    using PressureKernel = PressureKernelT;
+    using NearPressureKernel = NearPressureKernelT;
+    using ViscosityKernel = ViscosityKernelT;
+
+    // Constructor
+    template <typename Scalar>
+    constexpr explicit SPHKernelSet(Scalar h)
+        : density(h), nearDensity(h), pressure(h), nearPressure(h), viscosity(h) { }
+
+    // Used to turn neighbor distances into densities
+    DensityKernel density;
+    // Used for the near density of double density relaxation
+    NearDensityKernel nearDensity;
+    // Used for the pressure gradient
+    PressureKernel pressure;
+    // Used for the near pressure gradient
+    NearPressureKernel nearPressure;
+    // Used for the viscosity laplacian
+    ViscosityKernel viscosity;
+};
+
+#endif
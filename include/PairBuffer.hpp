@@ -0,0 +1,76 @@
+#ifndef PAIRBUFFER_HPP
+#define PAIRBUFFER_HPP
+
+// Third party libraries
+#include <glm/glm.hpp>
+
+// C++ Standard Libraries
+#include <cstddef>
+#include <vector>
+
+// Purpose:
+// The neighbor pairs found by the density pass, kept for the force pass.
+//
+// The density pass is the only one that walks the grid. For every neighbor
+// inside the support it stores the direction and the kernel terms the force
+// pass needs, so forces are a linear walk over this buffer with no distance
+// or kernel recomputed. Pairs are grouped by particle, like a CSR matrix:
+// the pairs of particle i are [offsets[i], offsets[i + 1]).
+
+// One neighbor of a particle
+template <typename Scalar>
+struct NeighborPair {
+    using Vec = glm::vec<3, Scalar>;
+
+    // Index of the neighbor
+    int index;
+    // Distance to the neighbor
+    Scalar dist;
+    // Unit vector from the neighbor to the particle
+    Vec dir;
+    // Pressure kernel derivative at dist
+    Scalar slope;
+    // Near pressure kernel derivative at dist
+    Scalar nearSlope;
+    // Viscosity kernel laplacian at dist
+    Scalar viscositySlope;
+};
+
+template <typename Scalar>
+class PairBuffer {
+public:
+    using Pair = NeighborPair<Scalar>;
+
+    // Forget the pairs of the last step, keeping the memory
+    void Clear(std::size_t particleCount) {
+        pairs.clear();
+        offsets.resize(particleCount + 1);
+        offsets[0] = 0;
+    }
+
+    // Append a pair of the particle currently being filled
+    void Add(const Pair& pair) {
+        pairs.push_back(pair);
+    }
+
+    // Close the pairs of a particle, particles must be filled in index order
+    void EndParticle(int index) {
+        offsets[index + 1] = static_cast<int>(pairs.size());
+    }
+
+    // Pairs of a particle
+    const Pair* Begin(int index) const { return pairs.data() + offsets[index]; }
+    const Pair* End(int index) const { return pairs.data() + offsets[index + 1]; }
+    // Number of neighbors of a particle
+    int Count(int index) const { return offsets[index + 1] - offsets[index]; }
+    // Number of pairs in the buffer
+    std::size_t Size() const { return pairs.size(); }
+
+private:
+    // All pairs, grouped by particle
+    std::vector<Pair> pairs;
+    // Where the pairs of each particle start
+    std::vector<int> offsets;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef PARTICLESTORE_HPP
+#define PARTICLESTORE_HPP
+
+// Third party libraries
+#include <glm/glm.hpp>
+
+// C++ Standard Libraries
+#include <cstddef>
+#include <vector>
+
+// Purpose:
+// Per particle state of the fluid, one array per property.
+//
+// Every array has one entry per particle and index i refers to the same
+// particle in all of them, so a pass only streams the properties it uses.
+// Removing a particle moves the last one into its slot, so the arrays stay
+// dense and, once reserved, adding and removing never reallocate. Ids are
+// pooled: a removed particle's id goes on a free list for the next one added.
+template <typename Scalar>
+struct ParticleStore {
+    using Vec = glm::vec<3, Scalar>;
+
+    // Number of particles
+    std::size_t Size() const { return positions.size(); }
+
+    // Reserve space so adding particles does not reallocate
+    void Reserve(std::size_t count) {
+        positions.reserve(count);
+        velocities.reserve(count);
+        predictedPositions.reserve(count);
+        masses.reserve(count);
+        densities.reserve(count);
+        nearDensities.reserve(count);
+        ids.reserve(count);
+        awake.reserve(count);
+        smoothingLengths.reserve(count);
+        levels.reserve(count);
+        idIndices.reserve(count);
+        freeIds.reserve(count);
+    }
+
+    // Appends a particle and returns its index
+    int Add(const Vec& position, const Vec& velocity, Scalar mass, Scalar smoothingLength, int level = 0) {
+        int index = static_cast<int>(positions.size());
+        int id;
+        if (freeIds.empty()) {
+            id = static_cast<int>(idIndices.size());
+            idIndices.push_back(index);
+        } else {
+            id = freeIds.back();
+            freeIds.pop_back();
+            idIndices[id] = index;
+        }
+
+        positions.push_back(position);
+        velocities.push_back(velocity);
+        predictedPositions.push_back(position);
+        masses.push_back(mass);
+        densities.push_back(0);
+        nearDensities.push_back(0);
+        ids.push_back(id);
+        awake.push_back(1);
+        smoothingLengths.push_back(smoothingLength);
+        levels.push_back(static_cast<unsigned char>(level));
+        return index;
+    }
+
+    // Removes a particle, the last particle takes its index
+    void Remove(int index) {
+        idIndices[ids[index]] = -1;
+        freeIds.push_back(ids[index]);
+        if (index != static_cast<int>(positions.size()) - 1) {
+            MoveLast(positions, index);
+            MoveLast(velocities, index);
+            MoveLast(predictedPositions, index);
+            MoveLast(masses, index);
+            MoveLast(densities, index);
+            MoveLast(nearDensities, index);
+            MoveLast(ids, index);
+            MoveLast(awake, index);
+            MoveLast(smoothingLengths, index);
+            MoveLast(levels, index);
+            idIndices[ids[index]] = index;
+        }
+
+        positions.pop_back();
+        velocities.pop_back();
+        predictedPositions.pop_back();
+        masses.pop_back();
+        densities.pop_back();
+        nearDensities.pop_back();
+        ids.pop_back();
+        awake.pop_back();
+        smoothingLengths.pop_back();
+        levels.pop_back();
+    }
+
+    // Index of the particle with an id, -1 once it was removed
+    int IndexOf(int id) const { return idIndices[id]; }
+
+    // Moves the last entry of an array into index, leaving the last for pop_back
+    template <typename T>
+    static void MoveLast(std::vector<T>& values, int index) {
+        values[index] = values.back();
+    }
+
+    // Positions at the start of the step
+    std::vector<Vec> positions;
+    // Velocities
+    std::vector<Vec> velocities;
+    // Positions predicted from the velocity after external forces
+    std::vector<Vec> predictedPositions;
+    // Masses
+    std::vector<Scalar> masses;
+    // Densities from the last density pass
+    std::vector<Scalar> densities;
+    // Near densities from the last density pass
+    std::vector<Scalar> nearDensities;
+    // Stable ids, unlike indices these never change
+    std::vector<int> ids;
+    // Zero while the particle's cell sleeps, the passes leave it where it is
+    std::vector<unsigned char> awake;
+    // Support radius of each particle's kernels, pairs use the mean of theirs
+    std::vector<Scalar> smoothingLengths;
+    // Merge level, a particle of level k stands for 2^k particles of the base mass
+    std::vector<unsigned char> levels;
+    // Index of each id, -1 for ids on the free list
+    std::vector<int> idIndices;
+    // Ids of removed particles, handed out again before new ones
+    std::vector<int> freeIds;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef PERFCOUNTERS_HPP
+#define PERFCOUNTERS_HPP
+
+#include "AllocationTracker.hpp"
+
+// C++ Standard Libraries
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The hardware events counted, in this order
+enum class PerfEvent { Cycles, Instructions, L1DataMisses, LastLevelMisses, BranchMisses, Count };
+
+// Name of an event as written in the benchmark JSON
+const char* PerfEventName(PerfEvent event);
+
+// Counts of every event, -1 for one the machine could not count
+struct PerfCounts {
+    std::int64_t values[int(PerfEvent::Count)] = {-1, -1, -1, -1, -1};
+};
+
+// What the counters saw during one stage, summed over every time it ran
+struct PerfStageCounts {
+    const char* stage;
+    // Times the stage ran
+    std::int64_t runs = 0;
+    PerfCounts counts;
+};
+
+// Purpose:
+// Hardware performance counters, split by solver stage.
+//
+// Open asks Linux's perf_event_open for one group of counters on the
+// calling thread, user space only, so it works at the default
+// perf_event_paranoid level. Not every machine has every event, a virtual
+// machine often has none; events that fail to open stay at -1 and if the
+// cycle counter itself fails Open returns false and says why, and every
+// COUNT_STAGE is a no op. On other systems Open always fails.
+//
+// COUNT_STAGE("name") reads the group when it is entered and left and adds
+// the difference to the named stage. The counters follow the thread that
+// opened them, work handed to the thread pool's workers is not counted,
+// run with one thread for the full picture. A stage inside another counts
+// toward both. The stage also tags the allocations made inside it, see
+// AllocationTracker.
+class PerfCounters {
+public:
+    // Start counting on the calling thread, false if the counters could not be opened
+    static bool Open();
+    // Whether Open succeeded
+    static bool IsOpen() { return open; }
+    // Current totals of every event, scaled up if the kernel had to share the counters
+    static PerfCounts Read();
+    // Add counts to a stage
+    static void Add(const char* stage, const PerfCounts& before, const PerfCounts& after);
+    // Every stage that ran since the last Reset, in order of first appearance
+    static const std::vector<PerfStageCounts>& Stages() { return stages; }
+    // Forget the stage totals, the counters stay open
+    static void Reset() { stages.clear(); }
+
+private:
+    static bool open;
+    static std::vector<PerfStageCounts> stages;
+};
+
+// Counts from its construction to its destruction as one run of a stage
+class PerfStage {
+public:
+    explicit PerfStage(const char* u_stage) : stage(u_stage), allocations(u_stage) {
+        if (PerfCounters::IsOpen()) before = PerfCounters::Read();
+    }
+    ~PerfStage() {
+        if (PerfCounters::IsOpen()) PerfCounters::Add(stage, before, PerfCounters::Read());
+    }
+
+    PerfStage(const PerfStage&) = delete;
+    PerfStage& operator=(const PerfStage&) = delete;
+
+private:
+    const char* stage;
+    PerfCounts before;
+    AllocationScope allocations;
+};
+
+#define PERF_CONCAT_INNER(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_INNER(a, b)
+#define COUNT_STAGE(name) PerfStage PERF_CONCAT(perfStage, __LINE__)(name)
+
+#endif
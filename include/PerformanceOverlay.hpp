@@ -0,0 +1,99 @@
+#ifndef PERFORMANCEOVERLAY_HPP
+#define PERFORMANCEOVERLAY_HPP
+
+// Third party libraries
+#include <glad/glad.h> // The glad library helps setup OpenGL extensions.
+#include <glm/glm.hpp>
+
+// C++ Standard Libraries
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// The numbers of one frame the overlay cannot measure itself
+struct FrameStats {
+    // Particles on screen, summed over the simulations
+    int particles = 0;
+    // Neighbor pairs of the last density pass, and the most one particle had
+    int neighborPairs = 0;
+    int maxNeighbors = 0;
+    // GPU time of the draws and dispatches of a recent frame, see GpuTimer
+    double gpuMilliseconds = 0;
+    // glDrawElements calls and bytes given to glBufferData by the last render
+    int drawCalls = 0;
+    std::size_t uploadedBytes = 0;
+};
+
+// Purpose:
+// Rolling graphs of where the frames go, drawn over the scene.
+//
+// Every frame Record adds one sample to each graph and Build turns the
+// graphs into triangles in the vertex layout of Line and Triangle, in
+// window pixels, for the application to draw with an orthographic matrix.
+// There is no font, the newest value of each graph is drawn as seven
+// segment digits beside it and the graphs are told apart by color, from
+// the top:
+//   white   frame time (ms)
+//   yellow  solver step (ms)
+//   cyan    neighbor search, binning and the density pass (ms)
+//   orange  pressure solve (ms)
+//   magenta render (ms)
+//   teal    GPU time of the draws and dispatches (ms)
+//   green   particles
+//   blue    mean neighbors per particle
+//   violet  most neighbors of one particle
+//   red     draw calls
+//   grey    uploaded kilobytes
+//   peach   heap allocations
+// Stage times are the profiler's zones, which are only recorded in builds
+// with SPH_PROFILE, and allocations are only counted in builds with
+// SPH_TRACK_ALLOCATIONS, otherwise those graphs stay at zero.
+class PerformanceOverlay {
+public:
+    // Samples kept per graph
+    static constexpr int historyLength = 120;
+
+    // Constructor
+    PerformanceOverlay();
+
+    // Add the frame that ended now, stage times are the zones that ended since the last call
+    void Record(const FrameStats& frame);
+    // Append the graphs' triangles, anchored at the top left of a window of the given size
+    void Build(float windowWidth, float windowHeight, std::pmr::vector<GLfloat>& vertices, std::pmr::vector<GLint>& indices) const;
+
+private:
+    // The graphs from top to bottom
+    enum GraphIndex { FrameTime, StepTime, NeighborTime, PressureTime, RenderTime, GpuTime, Particles, MeanNeighbors, MaxNeighbors, DrawCalls, UploadedKilobytes, Allocations, GraphCount };
+
+    // One rolling graph
+    struct Graph {
+        glm::vec3 color;
+        // Profiler zones summed into the sample, empty for graphs fed by FrameStats
+        std::vector<const char*> zones;
+        // Ring of samples, the newest at (next - 1)
+        std::vector<float> samples;
+    };
+
+    /* GEOMETRY */
+
+    // A quad between two corners at depth z
+    static void AddQuad(glm::vec2 low, glm::vec2 high, float z, glm::vec3 color, std::pmr::vector<GLfloat>& vertices, std::pmr::vector<GLint>& indices);
+    // A segment as thick as a Line, laid out like one
+    static void AddSegment(glm::vec2 start, glm::vec2 end, float thickness, glm::vec3 color, std::pmr::vector<GLfloat>& vertices, std::pmr::vector<GLint>& indices);
+    // A number as seven segment digits, the top left of the first one at corner
+    static void AddNumber(float value, glm::vec2 corner, float height, glm::vec3 color, std::pmr::vector<GLfloat>& vertices, std::pmr::vector<GLint>& indices);
+
+    /* GEOMETRY */
+
+    // One per GraphIndex
+    std::vector<Graph> graphs;
+    // Where the next sample goes in every graph's ring
+    int next = 0;
+    // When Record was last called, 0 before the first call
+    std::int64_t lastRecord = 0;
+    // Allocations made by every thread when Record was last called
+    std::uint64_t lastAllocations = 0;
+};
+
+#endif
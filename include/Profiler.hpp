@@ -0,0 +1,72 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+// C++ Standard Libraries
+#include <cstdint>
+#include <string>
+
+// Purpose:
+// Scoped timing zones, to see where a frame or a solver step spends its time.
+//
+// PROFILE_ZONE("name") times the rest of the enclosing block. Every thread
+// records into a ring buffer of its own, so a zone takes two clock reads
+// and no lock; only a thread's first zone allocates. Once a ring is full
+// its oldest zones are overwritten. WriteChromeTrace writes the zones of
+// every thread as Chrome trace events, for chrome://tracing or Perfetto.
+// It reads the rings without locking them, so call it while no other
+// thread is inside a zone, e.g. between steps or at exit.
+//
+// Work timed elsewhere than on a CPU thread, like the GPU, goes on a track
+// of its own with RecordTrack, already converted to Now's clock.
+//
+// Zone, thread and track names are kept as pointers, pass string literals.
+// Without SPH_PROFILE defined the macros compile to nothing.
+class Profiler {
+public:
+    // Whether this build records zones
+#ifdef SPH_PROFILE
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    // Nanoseconds on a steady clock
+    static std::int64_t Now();
+    // Record a zone that ran on the calling thread
+    static void Record(const char* name, std::int64_t start, std::int64_t end);
+    // Record a zone on a named track instead of the calling thread's, one thread per track
+    static void RecordTrack(const char* track, const char* name, std::int64_t start, std::int64_t end);
+    // Name the calling thread in the trace
+    static void SetThreadName(const char* name);
+    // Nanoseconds spent in the zones named name that the calling thread ended after since
+    static std::int64_t ThreadTotal(const char* name, std::int64_t since);
+    // Write every recorded zone as Chrome trace events, false if the file could not be written
+    static bool WriteChromeTrace(const std::string& path);
+};
+
+// Records the time from its construction to its destruction as one zone
+class ProfileZone {
+public:
+    explicit ProfileZone(const char* u_name) : name(u_name), start(Profiler::Now()) { }
+    ~ProfileZone() { Profiler::Record(name, start, Profiler::Now()); }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char* name;
+    std::int64_t start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef SPH_PROFILE
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::SetThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+#endif
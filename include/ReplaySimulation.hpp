@@ -0,0 +1,103 @@
+#ifndef REPLAYSIMULATION_HPP
+#define REPLAYSIMULATION_HPP
+
+#include "Simulation.hpp"
+#include "TrajectoryReader.hpp"
+
+// C++ Standard Libraries
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Purpose:
+// Plays back a recorded trajectory file instead of running a solver.
+//
+// Playback follows the wall clock at any speed, backwards too, and loops
+// or stops at the ends; the frame shown is the last one recorded at or
+// before the playback time. A decoder thread reads frames off the mapped
+// file, so a slow disk or a large frame costs the display frames of the
+// recording, never frames of the window: the decoder always takes the
+// newest frame wanted and skips those it fell behind on. Three frame
+// buffers pass between the threads, the one drawn, the one decoded last
+// and the one being decoded, swapped under a lock. The drawn frame's
+// positions go straight to the renderer as discs.
+//
+// Controls: Space pauses, Left and Right step a frame, Page Up and Page
+// Down jump a tenth of the recording, Home and End go to its ends, Up and
+// Down double and halve the speed, R reverses, L toggles looping, and
+// dragging with the left mouse button scrubs across the recording.
+class ReplaySimulation: public Simulation {
+public:
+    // Constructor
+    ReplaySimulation(Application& u_app);
+    // Destructor, stops the decoder
+    ~ReplaySimulation();
+
+    // Open the trajectory to play, false if it cannot be read or has no frames
+    bool Open(const std::string& path);
+    // Set the playback speed, negative plays backwards
+    void SetSpeed(double u_speed);
+    // Set whether playback loops or stops at the ends
+    void SetLooping(bool u_looping);
+
+    // Initial call
+    void Render() override;
+    // Advance playback and show the newest decoded frame
+    void Update() override;
+    // Particle count of the frame shown
+    void CollectStats(FrameStats& stats) const override;
+    // The frame shown
+    ParticleView Particles() const override;
+    // Playback controls
+    void HandleEvent(const SDL_Event& e) override;
+
+private:
+    // Draw the borders of the recorded tank
+    void DrawBorders();
+    // Move playback to a simulated time, wrapping or stopping at the ends
+    void Seek(double time);
+    // Move playback to a fraction of the way through the recording
+    void SeekFraction(double fraction);
+    // Step playback to a neighbouring frame and pause
+    void StepFrames(int frames);
+    // Print the playback state after a control changed it
+    void PrintState() const;
+    // Loop run by the decoder thread
+    void DecoderLoop();
+
+    TrajectoryReader reader;
+    // The instance of the application we are using
+    Application& app;
+
+    // Simulated time of the first and last frames, and the time shown
+    double startTime = 0;
+    double endTime = 0;
+    double playbackTime = 0;
+    // Simulated seconds per wall clock second, negative plays backwards
+    double speed = 1;
+    bool paused = false;
+    bool looping = true;
+    // Whether the left mouse button is held on the window
+    bool scrubbing = false;
+    std::chrono::steady_clock::time_point lastUpdate;
+
+    // The frame drawn, only touched by the main thread
+    TrajectoryFrame shown;
+
+    std::thread decoder;
+    // Guards everything below
+    std::mutex frameMutex;
+    // Wakes the decoder when a new frame is wanted, or to stop
+    std::condition_variable wake;
+    // The frame decoded last, waiting to be shown, and the decoder's own
+    TrajectoryFrame ready;
+    TrajectoryFrame decoding;
+    bool readyFresh = false;
+    // The frame wanted, and the last the decoder tried
+    std::size_t requested = 0;
+    std::size_t attempted = 0;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef RIGIDBODY_HPP
+#define RIGIDBODY_HPP
+
+#include "SignedDistanceField.hpp"
+
+// Third party libraries
+#include <glm/glm.hpp>
+
+// C++ Standard Libraries
+#include <vector>
+
+// Purpose:
+// A moving solid the fluid collides with and pushes on.
+//
+// The shape is described in the body's own frame, centered on its center
+// of mass, and placed in the tank by position and angle. Particles that
+// end up inside are pushed out and exchange an impulse with the body; the
+// impulses are summed over a step and the body integrates them at its end.
+// A body with zero mass is kinematic: the fluid cannot push it and it moves
+// with whatever velocity it is given.
+struct RigidBody {
+    // Circle, box or polygon around the origin, polygons convex and counterclockwise
+    BoundaryShape shape;
+    // Center of mass
+    glm::dvec2 position = {0, 0};
+    glm::dvec2 velocity = {0, 0};
+    // Rotation in radians, counterclockwise
+    double angle = 0;
+    double angularVelocity = 0;
+    // Mass and moment of inertia about the center of mass, zero for kinematic bodies
+    double mass = 0;
+    double inertia = 0;
+    // Impulses the particles applied during the current step
+    glm::dvec2 impulse = {0, 0};
+    double angularImpulse = 0;
+};
+
+// A body of the given shape and areal density with its center of mass at a
+// position, the shape's own center is ignored and polygons are recentered
+RigidBody MakeRigidBody(const BoundaryShape& shape, glm::dvec2 position, double density);
+// Distance from a point in the tank to the body's surface, negative inside,
+// and the surface normal pointing out of the body
+double BodyDistance(const RigidBody& body, glm::dvec2 point, glm::dvec2& normal);
+// Box around the body in the tank
+void BodyBounds(const RigidBody& body, glm::dvec2& lower, glm::dvec2& upper);
+// Outline of the body in the tank, counterclockwise, allocated from memory
+std::pmr::vector<glm::dvec2> BodyOutline(const RigidBody& body, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+#endif
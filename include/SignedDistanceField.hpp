@@ -0,0 +1,76 @@
+#ifndef SIGNEDDISTANCEFIELD_HPP
+#define SIGNEDDISTANCEFIELD_HPP
+
+// Third party libraries
+#include <glm/glm.hpp>
+
+// C++ Standard Libraries
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// A solid obstacle inside the tank
+struct BoundaryShape {
+    enum class Kind {
+        Circle,  // center and radius
+        Box,     // center and half extents
+        Polygon, // closed outline through points, solid inside
+        Polyline // open wall through points, thickness wide
+    };
+
+    Kind kind = Kind::Circle;
+    glm::dvec2 center = {0, 0};
+    double radius = 0;
+    glm::dvec2 halfExtents = {0, 0};
+    std::vector<glm::dvec2> points;
+    double thickness = 0;
+};
+
+// Purpose:
+// The distance to the nearest boundary of the fluid, baked once on a grid.
+//
+// The fluid is the tank minus every obstacle. Distances are positive in the
+// fluid and negative inside walls and obstacles, and each node also stores
+// the gradient, the normal pointing into the fluid. A lookup is a bilinear
+// blend of the four nodes around a position, so collisions cost the same
+// however many shapes went into the field. Features thinner than two cells
+// are blurred away, so the cell size has to resolve the thinnest wall.
+class SignedDistanceField {
+public:
+    // Constructor, an empty field
+    SignedDistanceField() {}
+    // Bakes the tank [-width, width] x [-height, height] minus the shapes
+    SignedDistanceField(double width, double height, double cellSize, const std::vector<BoundaryShape>& shapes);
+
+    // Whether a field was baked
+    bool Empty() const { return distances.empty(); }
+    // Distance to the nearest boundary at a position, and the unit normal there
+    double Sample(double x, double y, glm::dvec2& normal) const;
+
+private:
+    // Node spacing
+    double cellSize = 0;
+    // Position of node (0, 0)
+    glm::dvec2 origin = {0, 0};
+    // Node counts
+    int cols = 0;
+    int rows = 0;
+    // Distance and normal per node, row by row
+    std::vector<float> distances;
+    std::vector<glm::vec2> normals;
+};
+
+// Distance from a point to a shape, negative inside it
+double ShapeDistance(const BoundaryShape& shape, glm::dvec2 point);
+// Line segments outlining a shape, two points per segment, for drawing,
+// allocated from memory, a FrameArena for outlines used once
+std::pmr::vector<glm::dvec2> ShapeOutline(const BoundaryShape& shape, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+// Reads shapes from a text file, one per line:
+//   circle x y radius
+//   box x y halfWidth halfHeight
+//   polygon x1 y1 x2 y2 x3 y3 ...
+//   polyline thickness x1 y1 x2 y2 ...
+// Empty lines and lines starting with # are skipped
+bool LoadBoundaryShapes(const std::string& path, std::vector<BoundaryShape>& shapes);
+
+#endif
@@ -7,19 +7,39 @@
 #include <glm/glm.hpp>
 
 // C++ Standard Libraries
+#include <cstddef>
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <fstream>
 
 class Application;
+struct FrameStats;
+union SDL_Event;
+
+// Particles a simulation hands straight to the renderer, drawn as discs
+// with no Circle object each
+struct ParticleView {
+    // x, y pairs, count of them
+    const float* positions = nullptr;
+    std::size_t count = 0;
+    GLfloat radius = 0;
+};
 
 class Simulation {
 public:
+    // Destructor
+    virtual ~Simulation() { }
     // Initial call of the simulation
     virtual void Render() = 0;
     // What to update on every subsequent step of the simulation
     virtual void Update() = 0;
+    // Add what the overlay shows about this simulation
+    virtual void CollectStats(FrameStats& stats) const { }
+    // Particles to draw from the simulation's own buffer, none by default
+    virtual ParticleView Particles() const { return ParticleView(); }
+    // React to an input event, ignored by default
+    virtual void HandleEvent(const SDL_Event& e) { }
 };
 
 #endif
\ No newline at end of file
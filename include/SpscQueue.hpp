@@ -0,0 +1,66 @@
+#ifndef SPSCQUEUE_HPP
+#define SPSCQUEUE_HPP
+
+// C++ Standard Libraries
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Purpose:
+// A bounded queue between exactly one producer thread and one consumer
+// thread, without locks.
+//
+// The producer only writes the tail and the consumer only writes the head,
+// each publishing with a release store the other reads with an acquire
+// load, so neither ever waits for the other. Push fails when the queue is
+// full and Pop when it is empty; what to do then is the caller's choice.
+// The two indices sit on separate cache lines so the threads do not fight
+// over one.
+template <typename T>
+class SpscQueue {
+public:
+    // Constructor, capacity is rounded up to a power of two
+    explicit SpscQueue(std::size_t capacity = 16) {
+        std::size_t size = 2;
+        while (size < capacity) size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer: add a value, false if the queue is full
+    bool Push(const T& value) {
+        std::size_t tailNow = tail.load(std::memory_order_relaxed);
+        if (tailNow - head.load(std::memory_order_acquire) > mask) return false;
+        slots[tailNow & mask] = value;
+        tail.store(tailNow + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: take the oldest value, false if the queue is empty
+    bool Pop(T& value) {
+        std::size_t headNow = head.load(std::memory_order_relaxed);
+        if (headNow == tail.load(std::memory_order_acquire)) return false;
+        value = slots[headNow & mask];
+        head.store(headNow + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Values waiting, a moment old on any thread but the two using the queue
+    std::size_t Size() const {
+        // The head is read first, it can only have moved toward the tail since
+        std::size_t headNow = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - headNow;
+    }
+    std::size_t Capacity() const { return mask + 1; }
+
+private:
+    std::vector<T> slots;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> head{0};
+    alignas(64) std::atomic<std::size_t> tail{0};
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef TABULATEDKERNEL_HPP
+#define TABULATEDKERNEL_HPP
+
+// Purpose:
+// Lookup table version of any analytic kernel from Kernels.hpp.
+//
+// W and dW/dr are sampled at construction on an even grid over the squared
+// distance [0, h^2]. Evaluating the kernel is then an index and a linear
+// interpolation between two table entries, so the density pass never needs
+// a sqrt and kernels with many terms (Wendland, splines) cost the same as
+// the cheapest one. The tables are laid out as two separate, cache line
+// aligned arrays with one padding entry at the end, so a vectorized caller
+// can gather i and i + 1 without bounds checks.
+
+#include "Kernels.hpp"
+
+// C++ Standard Libraries
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Allocator handing out memory aligned to the given boundary
+template <typename T, std::size_t Alignment>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) { }
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, std::size_t) {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+// Wraps an analytic kernel with a table of Resolution intervals over [0, h^2]
+template <typename Kernel, int Resolution = 4096>
+class TabulatedKernel {
+public:
+    using AnalyticKernel = Kernel;
+    using Scalar = typename Kernel::ScalarType;
+    using ScalarType = Scalar;
+    using Table = std::vector<Scalar, AlignedAllocator<Scalar, 64>>;
+    static constexpr int dimension = Kernel::dimension;
+    static constexpr int resolution = Resolution;
+
+    // Constructor
+    explicit TabulatedKernel(Scalar h) : analytic(h) {
+        h2 = h * h;
+        step = h2 / Resolution;
+        invStep = Scalar(Resolution) / h2;
+
+        // One extra sample past the end and one padding zero for the gather
+        values.assign(Resolution + 2, Scalar(0));
+        derivatives.assign(Resolution + 2, Scalar(0));
+        for (int i = 0; i <= Resolution; i++) {
+            Scalar r = std::sqrt(Scalar(i) * step);
+            values[i] = analytic.Value(r);
+            derivatives[i] = analytic.Derivative(r);
+        }
+
+        MeasureError();
+    }
+
+    Scalar ValueSquared(Scalar r2) const {
+        return Interpolate(values, r2);
+    }
+
+    Scalar DerivativeSquared(Scalar r2) const {
+        return Interpolate(derivatives, r2);
+    }
+
+    Scalar Value(Scalar r) const {
+        return Interpolate(values, r * r);
+    }
+
+    Scalar Derivative(Scalar r) const {
+        return Interpolate(derivatives, r * r);
+    }
+
+    // The laplacian is not tabulated, it goes straight to the analytic kernel
+    Scalar Laplacian(Scalar r) const {
+        return analytic.Laplacian(r);
+    }
+
+    Scalar Support() const { return analytic.Support(); }
+
+    // Largest absolute difference from the analytic kernel, measured at construction
+    Scalar MaxValueError() const { return maxValueError; }
+    Scalar MaxDerivativeError() const { return maxDerivativeError; }
+
+    // Raw tables for vectorized callers
+    const Table& Values() const { return values; }
+    const Table& Derivatives() const { return derivatives; }
+
+private:
+    // Linear interpolation between the two samples around r^2
+    Scalar Interpolate(const Table& table, Scalar r2) const {
+        if (r2 >= h2) return 0;
+        Scalar u = r2 * invStep;
+        int i = static_cast<int>(u);
+        Scalar t = u - Scalar(i);
+        return table[i] + t * (table[i + 1] - table[i]);
+    }
+
+    // Compare against the analytic kernel at the midpoint of every interval,
+    // which is where linear interpolation is furthest from the curve
+    void MeasureError() {
+        maxValueError = 0;
+        maxDerivativeError = 0;
+        for (int i = 0; i < Resolution; i++) {
+            Scalar r2 = (Scalar(i) + Scalar(0.5)) * step;
+            Scalar r = std::sqrt(r2);
+            maxValueError = std::max(maxValueError, std::abs(ValueSquared(r2) - analytic.Value(r)));
+            maxDerivativeError = std::max(maxDerivativeError, std::abs(DerivativeSquared(r2) - analytic.Derivative(r)));
+        }
+    }
+
+    // The kernel the table was sampled from
+    Kernel analytic;
+    // Squared support radius
+    Scalar h2;
+    // Spacing between samples in r^2
+    Scalar step;
+    Scalar invStep;
+    // W and dW/dr sampled over r^2
+    Table values;
+    Table derivatives;
+    // Error against the analytic kernel
+    Scalar maxValueError;
+    Scalar maxDerivativeError;
+};
+
+#endif
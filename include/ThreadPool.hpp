@@ -0,0 +1,63 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+// C++ Standard Libraries
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Purpose:
+// A fixed set of worker threads that split a loop between them.
+//
+// The threads are started once and sleep between jobs, so a parallel loop
+// costs a wake up rather than a thread creation. One job runs at a time and
+// ParallelFor blocks until every chunk of it is done. The calling thread
+// takes the first chunk itself. The loop body is passed by reference, not
+// wrapped in a std::function, so starting a job never allocates.
+class ThreadPool {
+public:
+    // Constructor, threadCount 0 uses one thread per hardware thread
+    ThreadPool(int threadCount = 0);
+    // Destructor, joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads a loop is split between, including the caller
+    int ThreadCount() const { return int(workers.size()) + 1; }
+
+    // Calls f(begin, end) on ThreadCount() contiguous chunks of [0, count)
+    template <typename F>
+    void ParallelFor(int count, const F& f) {
+        Run(count, &f, [](const void* body, int begin, int end) { (*static_cast<const F*>(body))(begin, end); });
+    }
+
+private:
+    // ParallelFor with the loop body erased to a pointer and a function calling it
+    void Run(int count, const void* body, void (*call)(const void*, int, int));
+    // Loop run by every worker
+    void WorkerLoop(int chunk);
+
+    // Worker threads, chunk k + 1 belongs to workers[k]
+    std::vector<std::thread> workers;
+    // Guards everything below
+    std::mutex mutex;
+    // Signals workers that a job started, or that they should exit
+    std::condition_variable jobReady;
+    // Signals the caller that a worker finished its chunk
+    std::condition_variable jobDone;
+    // The current job
+    const void* job = nullptr;
+    void (*jobCall)(const void*, int, int) = nullptr;
+    int jobCount = 0;
+    // Incremented per job, so a worker runs each job once
+    unsigned generation = 0;
+    // Workers still running the current job
+    int pending = 0;
+    // Set when the pool is destroyed
+    bool stopping = false;
+};
+
+#endif
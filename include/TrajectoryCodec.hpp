@@ -0,0 +1,90 @@
+#ifndef TRAJECTORYCODEC_HPP
+#define TRAJECTORYCODEC_HPP
+
+#include "ThreadPool.hpp"
+
+// C++ Standard Libraries
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct TrajectoryFrame;
+
+// How values are rounded before they are stored
+struct TrajectoryQuantization {
+    // Half extents of the tank, positions are stored as 16 bit fractions of
+    // [-width, width] and [-height, height]
+    double width = 1;
+    double height = 1;
+    // Velocities and densities are stored as whole multiples of these
+    double velocityStep = 1e-3;
+    double densityStep = 1e-2;
+};
+
+// A frame with every value rounded to an integer, the state deltas are
+// taken against. Streams are x, y, vx, vy, density and id, one value per
+// particle each
+struct QuantizedFrame {
+    static constexpr int streamCount = 6;
+    double time = 0;
+    std::vector<std::int32_t> streams[streamCount];
+    std::size_t Size() const { return streams[0].size(); }
+};
+
+// Purpose:
+// Encodes trajectory frames as quantized, delta coded, Rice coded blocks,
+// and decodes them again.
+//
+// Every value is first rounded to an integer. A position becomes a 16 bit
+// fraction of the tank, with an error of at most width / 65535 in x and
+// height / 65535 in y. A velocity or density becomes the nearest multiple
+// of its step, with an error of at most half that step. Everything after
+// rounding is lossless, so every frame stays within these bounds, however
+// far it is from its keyframe.
+//
+// Each value is stored as a residual against a prediction. A keyframe
+// predicts each particle from the particle before it. A delta frame
+// predicts it from the same index in its keyframe, a position moved on by
+// the keyframe's velocity over the time between them, or from the
+// particle before it past the end of the keyframe. Residuals are zigzag mapped and
+// Rice coded, in runs of 64 values that each pick their own Rice
+// parameter, like FLAC's partitions. Small residuals, such as slow
+// particles against a recent keyframe, take a few bits each.
+//
+// Particles are cut into blocks that are coded independently, so both
+// directions run in parallel over the blocks on the codec's thread pool.
+class TrajectoryCodec {
+public:
+    // Constructor, threadCount as for ThreadPool
+    TrajectoryCodec(const TrajectoryQuantization& u_quantization, int u_blockParticles = 4096, int threadCount = 0);
+
+    // Round a frame's values
+    void Quantize(const TrajectoryFrame& frame, QuantizedFrame& quantized) const;
+    // Turn rounded values back into a frame's
+    void Dequantize(const QuantizedFrame& quantized, TrajectoryFrame& frame) const;
+
+    // Append the blocks of a frame to payload, against key or, if key is nullptr, as a keyframe
+    void Encode(const QuantizedFrame& frame, const QuantizedFrame* key, std::vector<unsigned char>& payload);
+    // Decode count particles of the frame at time from blocks written by
+    // Encode with the same key, false if the blocks are cut short or malformed
+    bool Decode(const unsigned char* blocks, std::size_t bytes, std::size_t count, double time, const QuantizedFrame* key, QuantizedFrame& frame);
+
+    const TrajectoryQuantization& Quantization() const { return quantization; }
+
+private:
+    // Position steps a quantized velocity moves a particle over elapsed
+    // seconds, along x and y
+    void DriftScales(double elapsed, double scales[2]) const;
+    // Encode or decode the particles of one block
+    void EncodeBlock(const QuantizedFrame& frame, const QuantizedFrame* key, std::size_t begin, std::size_t end, std::vector<unsigned char>& out) const;
+    bool DecodeBlock(const unsigned char* data, std::size_t bytes, const QuantizedFrame* key, std::size_t begin, std::size_t end, QuantizedFrame& frame) const;
+
+    TrajectoryQuantization quantization;
+    int blockParticles;
+    std::unique_ptr<ThreadPool> pool;
+    // Each block's bytes while a frame is encoded, kept between frames
+    std::vector<std::vector<unsigned char>> blockBytes;
+};
+
+#endif
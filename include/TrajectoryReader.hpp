@@ -0,0 +1,104 @@
+#ifndef TRAJECTORYREADER_HPP
+#define TRAJECTORYREADER_HPP
+
+#include "TrajectoryWriter.hpp"
+
+// C++ Standard Libraries
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Purpose:
+// Reads frames of a trajectory file (see TrajectoryWriter.hpp) in any
+// order, without loading the file.
+//
+// The file is mapped into memory rather than read, so opening it costs
+// nothing however large it is, and only the pages of the frames read are
+// ever loaded; the OS drops them again when memory runs short. A frame is
+// found through the index at the end of the file, one lookup, and a
+// quantized frame decodes from its own chunk and its keyframe's, so any
+// frame is as quick to reach as the next one. A file whose writer never
+// closed it has no index; its chunk headers are walked once on Open
+// instead. Frame headers can be read from any thread, ReadFrame from one
+// thread at a time.
+class TrajectoryReader {
+public:
+    // Constructor
+    TrajectoryReader();
+    // Destructor, unmaps the file
+    ~TrajectoryReader();
+
+    TrajectoryReader(const TrajectoryReader&) = delete;
+    TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+    // Map a file and check its header and index, false if it is not a trajectory
+    bool Open(const std::string& path);
+    // Unmap the file
+    void Close();
+    // Whether a file is open
+    bool IsOpen() const { return data != nullptr; }
+
+    // Frames in the file
+    std::size_t FrameCount() const { return frameCount; }
+    // The SolverConfig the file was recorded with
+    double Width() const { return width; }
+    double Height() const { return height; }
+    double DeltaTime() const { return deltaTime; }
+    // Encoding of the frames, Trajectory::rawEncoding or quantizedEncoding
+    std::uint32_t Encoding() const { return encoding; }
+
+    // Step, simulated time and particle count of a frame, read from its chunk alone
+    long long FrameStep(std::size_t index) const;
+    double FrameTime(std::size_t index) const;
+    std::size_t FrameParticles(std::size_t index) const;
+    // The last frame at or before a simulated time, the first if there is none
+    std::size_t FrameAt(double time) const;
+
+    // Read a frame, false if its chunk is cut short or malformed
+    bool ReadFrame(std::size_t index, TrajectoryFrame& frame);
+    // Ask the OS to start loading a frame's pages, so reading it later does not wait on the disk
+    void Prefetch(std::size_t index) const;
+
+private:
+    // File offset of a frame's chunk
+    std::uint64_t FrameOffset(std::size_t index) const;
+    // Offset of a field of a frame's payload, 0 if the frame's chunk does not hold it
+    std::uint64_t FrameField(std::size_t index, std::uint64_t field) const;
+    // Copy a value out of the mapping, which keeps no alignment
+    template <typename T>
+    T Load(std::uint64_t offset) const;
+    // Whether a chunk at offset lies inside the file, and the size of its payload
+    bool ChunkBytes(std::uint64_t offset, std::uint64_t& bytes) const;
+    // Find the frame chunks of a file that has no index
+    void ScanFrames(std::uint64_t begin);
+    // Decode a quantized frame chunk, against key unless it is a keyframe
+    bool DecodeQuantized(std::uint64_t offset, const QuantizedFrame* key, QuantizedFrame& target);
+
+    // The mapped file, which stays mapped after the file itself is closed
+    const unsigned char* data = nullptr;
+    std::size_t size = 0;
+
+    // Header fields
+    std::uint32_t encoding = Trajectory::rawEncoding;
+    double width = 0;
+    double height = 0;
+    double deltaTime = 0;
+
+    // Frame offsets: the index chunk's entries in the mapping, or, for a
+    // file with no index, those found by ScanFrames
+    std::size_t frameCount = 0;
+    std::uint64_t indexEntries = 0;
+    std::vector<std::uint64_t> scannedOffsets;
+
+    // Quantized frames: the codec, and the last keyframe decoded and where
+    // it starts, kept since the frames after it are usually read next
+    std::unique_ptr<TrajectoryCodec> codec;
+    QuantizedFrame keyframe;
+    std::uint64_t keyframeOffset = 0;
+    bool keyframeValid = false;
+    QuantizedFrame quantized;
+};
+
+#endif
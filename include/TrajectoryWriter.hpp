@@ -0,0 +1,209 @@
+#ifndef TRAJECTORYWRITER_HPP
+#define TRAJECTORYWRITER_HPP
+
+#include "IFluidSolver.hpp"
+#include "SpscQueue.hpp"
+#include "TrajectoryCodec.hpp"
+
+// C++ Standard Libraries
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The trajectory file format, every number in the machine's byte order
+// (little endian everywhere this builds):
+//
+//   header   char magic[8]      "SPHTRAJ" and a zero
+//            uint32 version     1
+//            uint32 encoding    0, raw float32 frames, or 1, quantized frames
+//            double width, height, deltaTime   of the SolverConfig
+//            double velocityStep, densityStep  only with encoding 1
+//   chunks   uint32 tag         what the chunk holds
+//            uint32 flags       1 marks a keyframe, otherwise 0
+//            uint64 bytes       size of the payload that follows
+//            payload
+//   trailer  uint64 indexOffset where the index chunk starts
+//            char magic[8]      "SPHTEND" and a zero
+//
+// A frame chunk, tag "FRAM", holds one snapshot of n particles:
+//   int64 step, double time, uint32 n, uint32 0,
+//   float32 positions[2n], velocities[2n] as x, y pairs, densities[n],
+//   int32 ids[n]
+// With encoding 1 frames are quantized frame chunks, tag "QFRM":
+//   int64 step, double time, uint32 n, uint32 0,
+//   uint64 keyOffset    file offset of the keyframe chunk it is coded
+//                       against, its own offset if it is a keyframe
+//   blocks              as written by TrajectoryCodec::Encode
+// Quantized values are within width / 65535 and height / 65535 of the
+// recorded positions, velocityStep / 2 of the velocities and
+// densityStep / 2 of the densities, up to float32 rounding when they are
+// read back; ids are exact. TrajectoryCodec describes the coding. Any
+// frame decodes from itself and its keyframe.
+//
+// The index chunk, tag "INDX", is written on Close and holds uint64 frame
+// count and the file offset of every frame chunk in order. A file whose
+// writer never closed it has no index or trailer, but its chunks can
+// still be read one after another; a reader skips tags it does not know.
+namespace Trajectory {
+    const char fileMagic[8] = {'S', 'P', 'H', 'T', 'R', 'A', 'J', 0};
+    const char endMagic[8] = {'S', 'P', 'H', 'T', 'E', 'N', 'D', 0};
+    const std::uint32_t version = 1;
+    // Encodings of the frames
+    const std::uint32_t rawEncoding = 0;
+    const std::uint32_t quantizedEncoding = 1;
+    // Chunk flag of a keyframe
+    const std::uint32_t keyframeFlag = 1;
+    // Chunk tags, the four characters read in file order
+    const std::uint32_t frameTag = 'F' | ('R' << 8) | ('A' << 16) | (std::uint32_t('M') << 24);
+    const std::uint32_t quantizedFrameTag = 'Q' | ('F' << 8) | ('R' << 16) | (std::uint32_t('M') << 24);
+    const std::uint32_t indexTag = 'I' | ('N' << 8) | ('D' << 16) | (std::uint32_t('X') << 24);
+}
+
+// One snapshot of the particles, the solver's 2D state narrowed to float
+struct TrajectoryFrame {
+    long long step = 0;
+    double time = 0;
+    std::vector<float> positions;
+    std::vector<float> velocities;
+    std::vector<float> densities;
+    std::vector<std::int32_t> ids;
+};
+
+// How a trajectory is recorded
+struct TrajectoryOptions {
+    // Snapshot buffers between the solver and the writer thread
+    int buffers = 2;
+    // Write quantized frames, encoding 1, rather than raw ones
+    bool quantize = false;
+    // Precision of quantized velocities and densities
+    double velocityStep = 1e-3;
+    double densityStep = 1e-2;
+    // Frames from one keyframe to the next
+    int keyframeInterval = 10;
+    // Particles per independently coded block, and threads coding them,
+    // 0 for one per hardware thread
+    int blockParticles = 4096;
+    int threads = 0;
+};
+
+// What the writer has done, readable from any thread while it runs
+struct TrajectoryStats {
+    // Frames handed to Capture, written to disk, and dropped because
+    // every snapshot buffer was still waiting to be written
+    std::uint64_t captured = 0;
+    std::uint64_t written = 0;
+    std::uint64_t dropped = 0;
+    // Frames waiting for the writer now, and the most that ever waited
+    std::size_t queueDepth = 0;
+    std::size_t maxQueueDepth = 0;
+    std::uint64_t bytesWritten = 0;
+    // What the same frames take as raw float32 frame chunks
+    std::uint64_t rawBytes = 0;
+    // Seconds the writer thread spent writing rather than waiting
+    double writeSeconds = 0;
+};
+
+// Purpose:
+// Records snapshots of a run to a trajectory file without the solver ever
+// waiting on the disk.
+//
+// Capture copies the particles into a free snapshot buffer and queues it;
+// a background thread writes queued buffers out and hands them back. The
+// two threads pass buffer numbers through a pair of lock-free queues, so
+// Capture never waits on the writer; it only signals it, taking the
+// writer's mutex for an instant so the signal cannot slip in just before
+// the writer sleeps on its condition variable. The writer sleeps until
+// there is something to write. With two buffers, the default, the solver fills one
+// while the other is written. When every buffer is still queued, the disk
+// has fallen behind and Capture drops the frame rather than wait, counting
+// it in the stats. The buffers keep their memory, so once they have held
+// the largest frame recording allocates nothing.
+//
+// With TrajectoryOptions::quantize the writer thread also quantizes and
+// codes each frame, every keyframeInterval frames a keyframe and the rest
+// deltas against it, splitting the coding over its own thread pool.
+class TrajectoryWriter {
+public:
+    // Constructor
+    TrajectoryWriter();
+    // Destructor, closes the file
+    ~TrajectoryWriter();
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    // Create the file, write its header and start the writer thread, false
+    // if the file could not be created
+    bool Open(const std::string& path, const SolverConfig& config, const TrajectoryOptions& u_options = TrajectoryOptions());
+    // Whether a file is open
+    bool IsOpen() const { return file != nullptr; }
+    // Snapshot the solver from the thread stepping it, false if the frame was dropped
+    bool Capture(const IFluidSolver& solver, long long step, double time);
+    // Write every queued frame, the index and the trailer, and close the file
+    bool Close();
+    // What the writer has done so far
+    TrajectoryStats Stats() const;
+
+    // Most snapshot buffers a writer can have
+    static constexpr int maxBuffers = 64;
+
+private:
+    // Loop run by the writer thread
+    void WriterLoop();
+    // Signal the writer that a frame is queued or the file is closing
+    void Wake();
+    // Write one frame's chunk at the end of the file
+    bool WriteFrame(const TrajectoryFrame& frame);
+    // Write one frame's quantized chunk at the end of the file
+    bool WriteQuantizedFrame(const TrajectoryFrame& frame);
+    // Payload size of a raw frame chunk of count particles
+    static std::uint64_t RawFrameBytes(std::size_t count);
+    // Write a chunk's tag, flags and payload size
+    bool WriteChunkHeader(std::uint32_t tag, std::uint64_t bytes, std::uint32_t flags = 0);
+    // Write raw bytes, counting them
+    bool WriteBytes(const void* data, std::size_t size);
+
+    std::FILE* file = nullptr;
+    // Offset the file has reached, and where each frame chunk starts,
+    // only touched by the writer thread while it runs
+    std::uint64_t offset = 0;
+    std::vector<std::uint64_t> frameOffsets;
+
+    // Quantized frames: the codec, the last keyframe and where it starts,
+    // frames written since it, and the frame and payload being coded
+    TrajectoryOptions options;
+    std::unique_ptr<TrajectoryCodec> codec;
+    QuantizedFrame keyframe;
+    std::uint64_t keyframeOffset = 0;
+    int sinceKeyframe = 0;
+    QuantizedFrame quantized;
+    std::vector<unsigned char> payload;
+
+    // The snapshot buffers, passed between the threads by number
+    std::vector<TrajectoryFrame> frames;
+    SpscQueue<int> freeFrames{maxBuffers};
+    SpscQueue<int> queuedFrames{maxBuffers};
+
+    std::thread writer;
+    // Wakes the writer when a frame is queued or the file is closing
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::atomic<bool> closing{false};
+    std::atomic<bool> failed{false};
+
+    std::atomic<std::uint64_t> captured{0};
+    std::atomic<std::uint64_t> written{0};
+    std::atomic<std::uint64_t> dropped{0};
+    std::atomic<std::size_t> maxQueueDepth{0};
+    std::atomic<std::uint64_t> bytesWritten{0};
+    std::atomic<std::uint64_t> rawBytes{0};
+    std::atomic<std::int64_t> writeNanoseconds{0};
+};
+
+#endif
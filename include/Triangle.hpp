@@ -23,7 +23,6 @@ public:
             pos3 = trianglePos.pos3;
 
             createVertices();
-            std::cout << "Triangle position updated.\n";
         } else {
             std::cerr << "Error: Invalid position type for Triangle.\n";
         }
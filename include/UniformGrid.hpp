@@ -0,0 +1,394 @@
+#ifndef UNIFORMGRID_HPP
+#define UNIFORMGRID_HPP
+
+// C++ Standard Libraries
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Purpose:
+// Grid of square cells used to find neighboring particles.
+//
+// Cells are at least one smoothing distance wide, so every neighbor of a
+// particle is in the 3x3 block of cells around it. The grid is rebuilt
+// every step with a counting sort: particle indices end up grouped by cell
+// in one array.
+//
+// A dense grid covers the tank with one cell per cell index, and the
+// particles of a row of cells are one contiguous range. A sparse grid has
+// no bounds: integer cell coordinates are hashed into an open addressing
+// table and only occupied cells get an index, so memory follows the
+// particles rather than the domain. A cell keeps its index for as long as
+// it stays occupied, and an index freed by a cell that emptied is handed to
+// the next new cell, which is reported through CreatedCells.
+//
+// Particles with different supports are binned on levels, the cells of
+// each level sqrt(2) times wider than those of the level below. A particle
+// goes to the finest level whose cells are as wide as its support, and the
+// cell indices of all levels share one range, finest first. A pair
+// interacts within the mean of its two supports, so at another level the
+// cells searched are those within the mean of the two cell sizes: each
+// particle of a pair finds the other, and no search is widened to the
+// largest support in the grid.
+class UniformGrid {
+public:
+
+    // Constructor, a dense grid covers [-width, width] x [-height, height]
+    UniformGrid(double width, double height, double smoothingDistance, bool sparse = false, int levels = 1);
+
+    // Number of cell indices in use, free indices of a sparse grid count as empty cells
+    int CellCount() const { return sparse ? int(slotKeys.size()) : denseCells; }
+    // Number of levels
+    int LevelCount() const { return int(levels.size()); }
+    // The level particles of a support are binned at, the coarsest if none is wide enough
+    int LevelFor(double support) const;
+    // Calculate the cell a position is in at a level. Positions outside a dense
+    // grid are clamped to the border cells, a sparse grid gives -1 for unoccupied cells
+    int CalculatePosition(double x, double y, int level = 0) const;
+    // The cell a particle was binned into by the last Build
+    int CellOf(int index) const { return particleCells[index]; }
+    // Number of particles in a cell as of the last Build
+    int CountInCell(int cell) const { return cellStart[cell + 1] - cellStart[cell]; }
+    // The k-th particle in cell order, walking k visits particles cell by cell
+    int ParticleAt(int k) const { return sortedIndices[k]; }
+    // Sparse cell indices given to new cells since the last ClearCreatedCells
+    const std::vector<int>& CreatedCells() const { return createdCells; }
+    // Forget the created cells once their state was reset
+    void ClearCreatedCells() { createdCells.clear(); }
+
+    // Bin all positions into their cells on the first level
+    template <typename Vec>
+    void Build(const std::vector<Vec>& positions);
+    // Bin every position on the level of its support
+    template <typename Vec, typename Scalar>
+    void Build(const std::vector<Vec>& positions, const std::vector<Scalar>& supports);
+    // Calls f(index) for every particle in the cells that may hold a neighbor
+    // of a particle at (x, y) binned in cell: the 3x3 block around it on its
+    // own level, and on the others the cells within the mean of the two sizes
+    template <typename F>
+    void ForEachNeighbor(int cell, double x, double y, F&& f) const;
+    // Calls f(cell) for every cell that may hold a neighbor of a particle in cell
+    template <typename F>
+    void ForEachNeighborCell(int cell, F&& f) const;
+    // Calls f(cell) for every cell overlapping a box, only occupied ones in a sparse grid
+    template <typename F>
+    void ForEachCellInRegion(double lowerX, double lowerY, double upperX, double upperY, F&& f) const;
+    // Calls f(index) for every particle in the cells overlapping a box
+    template <typename F>
+    void ForEachInRegion(double lowerX, double lowerY, double upperX, double upperY, F&& f) const;
+
+private:
+    // Cell layout of one level
+    struct Level {
+        // Support the level is for, its cells are at least this wide
+        double size;
+        // Size of a cell along each axis
+        double cellWidth;
+        double cellHeight;
+        // Dense grid: dimensions and the first cell index of the level
+        int cols;
+        int rows;
+        int offset;
+        // Particles binned on the level by the last Build
+        int count;
+    };
+
+    // One slot of the sparse hash table, slot -1 when empty
+    struct Entry {
+        long long key;
+        int slot = -1;
+        int level = 0;
+    };
+
+    // Integer cell coordinates of a sparse cell packed into one key
+    static long long Key(int col, int row) {
+        return static_cast<long long>((static_cast<unsigned long long>(static_cast<unsigned int>(row)) << 32) | static_cast<unsigned int>(col));
+    }
+    static int KeyCol(long long key) { return static_cast<int>(static_cast<unsigned int>(key)); }
+    static int KeyRow(long long key) { return static_cast<int>(static_cast<unsigned int>(static_cast<unsigned long long>(key) >> 32)); }
+    // The level a cell index belongs to
+    int LevelOf(int cell) const;
+    // Lower left corner of a cell
+    void CellCorner(int cell, double& x, double& y) const;
+    // Table position a key probes from
+    int Home(long long key, int level) const;
+    // Cell index of a key, -1 if it is not in the table
+    int Find(long long key, int level) const;
+    // Cell index of a key, taking a new one if it is not in the table
+    int FindOrInsert(long long key, int level);
+    // Take a key out of the table, shifting back the entries probing past it
+    void Erase(long long key, int level);
+    // Double the table and insert every key again
+    void Grow();
+    // Bin the positions on the levels in particleLevels
+    template <typename Vec>
+    void BuildLevels(const std::vector<Vec>& positions);
+    // Bin the positions into a sparse grid
+    template <typename Vec>
+    void BuildSparse(const std::vector<Vec>& positions);
+    // Prefix sums and the scatter, shared by both kinds of grid
+    void SortParticles(int cells);
+    // Calls f(cell) for every cell of one level overlapping a box
+    template <typename F>
+    void ForEachCellInLevel(int level, double lowerX, double lowerY, double upperX, double upperY, F&& f) const;
+    // Calls f(cell) for every cell on the other levels that may hold a neighbor
+    // of a particle in the box, which is inside a cell of level own
+    template <typename F>
+    void ForEachCellOnOtherLevels(int own, double lowerX, double lowerY, double upperX, double upperY, F&& f) const;
+
+    // Whether cells are hashed instead of covering the tank
+    bool sparse;
+    // Half extents of the grid
+    double width;
+    double height;
+    // The levels, finest first
+    std::vector<Level> levels;
+    // Dense grid: cells on all levels
+    int denseCells;
+    // The level each particle is binned on
+    std::vector<unsigned char> particleLevels;
+    // First entry of each cell in sortedIndices, with one extra entry at the end
+    std::vector<int> cellStart;
+    // Write cursor per cell used while building
+    std::vector<int> cellCursor;
+    // The cell each particle is in
+    std::vector<int> particleCells;
+    // Particle indices grouped by cell
+    std::vector<int> sortedIndices;
+    // Sparse grid: the hash table, a power of two in size
+    std::vector<Entry> table;
+    // Sparse grid: key and level of each cell index, whether it is in use, and the free indices
+    std::vector<long long> slotKeys;
+    std::vector<unsigned char> slotLevels;
+    std::vector<unsigned char> slotLive;
+    std::vector<int> freeSlots;
+    // Sparse grid: the 3x3 block of cell indices around each cell on its level, -1 where unoccupied
+    std::vector<int> neighborSlots;
+    // Sparse grid: cell indices handed out since the last ClearCreatedCells
+    std::vector<int> createdCells;
+};
+
+template <typename Vec>
+void UniformGrid::Build(const std::vector<Vec>& positions) {
+    particleLevels.assign(positions.size(), 0);
+    BuildLevels(positions);
+}
+
+template <typename Vec, typename Scalar>
+void UniformGrid::Build(const std::vector<Vec>& positions, const std::vector<Scalar>& supports) {
+    particleLevels.resize(positions.size());
+    for (std::size_t i = 0; i < positions.size(); i++) {
+        particleLevels[i] = static_cast<unsigned char>((levels.size() > 1) ? LevelFor(double(supports[i])) : 0);
+    }
+    BuildLevels(positions);
+}
+
+template <typename Vec>
+void UniformGrid::BuildLevels(const std::vector<Vec>& positions) {
+    int count = static_cast<int>(positions.size());
+    for (Level& level : levels) {
+        level.count = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        levels[particleLevels[i]].count++;
+    }
+
+    if (sparse) {
+        BuildSparse(positions);
+        return;
+    }
+
+    particleCells.resize(count);
+    for (int i = 0; i < count; i++) {
+        particleCells[i] = CalculatePosition(positions[i].x, positions[i].y, particleLevels[i]);
+    }
+    SortParticles(CellCount());
+}
+
+template <typename Vec>
+void UniformGrid::BuildSparse(const std::vector<Vec>& positions) {
+    int count = static_cast<int>(positions.size());
+    particleCells.resize(count);
+    for (int i = 0; i < count; i++) {
+        const Level& level = levels[particleLevels[i]];
+        int col = int(std::floor(positions[i].x / level.cellWidth));
+        int row = int(std::floor(positions[i].y / level.cellHeight));
+        particleCells[i] = FindOrInsert(Key(col, row), particleLevels[i]);
+    }
+    SortParticles(CellCount());
+
+    // Cells nobody is in any more give their index back
+    for (int slot = 0; slot < CellCount(); slot++) {
+        if (slotLive[slot] && CountInCell(slot) == 0) {
+            Erase(slotKeys[slot], slotLevels[slot]);
+            slotLive[slot] = 0;
+            freeSlots.push_back(slot);
+        }
+    }
+
+    // Look the neighbors up once per cell rather than once per particle
+    neighborSlots.resize(9 * CellCount());
+    std::fill(neighborSlots.begin(), neighborSlots.end(), -1);
+    for (int slot = 0; slot < CellCount(); slot++) {
+        if (!slotLive[slot]) continue;
+        int col = KeyCol(slotKeys[slot]);
+        int row = KeyRow(slotKeys[slot]);
+        for (int k = 0; k < 9; k++) {
+            neighborSlots[9 * slot + k] = Find(Key(col + k % 3 - 1, row + k / 3 - 1), slotLevels[slot]);
+        }
+    }
+}
+
+template <typename F>
+void UniformGrid::ForEachNeighbor(int cell, double x, double y, F&& f) const {
+    if (sparse) {
+        // Bottom to top, left to right, like the dense rows
+        for (int k = 0; k < 9; k++) {
+            int other = neighborSlots[9 * cell + k];
+            if (other < 0) continue;
+            for (int j = cellStart[other]; j < cellStart[other + 1]; j++) {
+                f(sortedIndices[j]);
+            }
+        }
+    } else {
+        const Level& level = levels[LevelOf(cell)];
+        int local = cell - level.offset;
+        int row = local / level.cols;
+        int col = local % level.cols;
+        int firstCol = std::max(col - 1, 0);
+        int lastCol = std::min(col + 1, level.cols - 1);
+
+        for (int r = std::max(row - 1, 0); r <= std::min(row + 1, level.rows - 1); r++) {
+            // Neighboring cells in a row are contiguous, and so are their particles
+            int begin = cellStart[level.offset + r * level.cols + firstCol];
+            int end = cellStart[level.offset + r * level.cols + lastCol + 1];
+            for (int k = begin; k < end; k++) {
+                f(sortedIndices[k]);
+            }
+        }
+    }
+
+    if (levels.size() == 1) return;
+    int own = LevelOf(cell);
+    for (int level = 0; level < int(levels.size()); level++) {
+        if (level == own || levels[level].count == 0) continue;
+        double reach = (levels[own].size + levels[level].size) / 2;
+        if (sparse) {
+            ForEachCellInLevel(level, x - reach, y - reach, x + reach, y + reach, [&](int other) {
+                for (int k = cellStart[other]; k < cellStart[other + 1]; k++) {
+                    f(sortedIndices[k]);
+                }
+            });
+            continue;
+        }
+
+        // The cells of a row are contiguous here as well
+        const Level& cells = levels[level];
+        int first = CalculatePosition(x - reach, y - reach, level) - cells.offset;
+        int last = CalculatePosition(x + reach, y + reach, level) - cells.offset;
+        for (int row = first / cells.cols; row <= last / cells.cols; row++) {
+            int begin = cellStart[cells.offset + row * cells.cols + first % cells.cols];
+            int end = cellStart[cells.offset + row * cells.cols + last % cells.cols + 1];
+            for (int k = begin; k < end; k++) {
+                f(sortedIndices[k]);
+            }
+        }
+    }
+}
+
+template <typename F>
+void UniformGrid::ForEachNeighborCell(int cell, F&& f) const {
+    if (sparse) {
+        for (int k = 0; k < 9; k++) {
+            int other = neighborSlots[9 * cell + k];
+            if (other >= 0) f(other);
+        }
+    } else {
+        const Level& level = levels[LevelOf(cell)];
+        int local = cell - level.offset;
+        int row = local / level.cols;
+        int col = local % level.cols;
+        for (int r = std::max(row - 1, 0); r <= std::min(row + 1, level.rows - 1); r++) {
+            for (int c = std::max(col - 1, 0); c <= std::min(col + 1, level.cols - 1); c++) {
+                f(level.offset + r * level.cols + c);
+            }
+        }
+    }
+
+    if (levels.size() == 1) return;
+    int own = LevelOf(cell);
+    double lowerX, lowerY;
+    CellCorner(cell, lowerX, lowerY);
+    ForEachCellOnOtherLevels(own, lowerX, lowerY, lowerX + levels[own].cellWidth, lowerY + levels[own].cellHeight, f);
+}
+
+// Particles of two levels interact within the mean of their supports, which
+// is at most the mean of the two levels' sizes
+template <typename F>
+void UniformGrid::ForEachCellOnOtherLevels(int own, double lowerX, double lowerY, double upperX, double upperY, F&& f) const {
+    for (int level = 0; level < int(levels.size()); level++) {
+        if (level == own || levels[level].count == 0) continue;
+        double reach = (levels[own].size + levels[level].size) / 2;
+        ForEachCellInLevel(level, lowerX - reach, lowerY - reach, upperX + reach, upperY + reach, f);
+    }
+}
+
+template <typename F>
+void UniformGrid::ForEachCellInRegion(double lowerX, double lowerY, double upperX, double upperY, F&& f) const {
+    for (int level = 0; level < int(levels.size()); level++) {
+        // Nothing to find on a level no particle was binned on, the first is always searched
+        if (level > 0 && levels[level].count == 0) continue;
+        ForEachCellInLevel(level, lowerX, lowerY, upperX, upperY, f);
+    }
+}
+
+template <typename F>
+void UniformGrid::ForEachCellInLevel(int level, double lowerX, double lowerY, double upperX, double upperY, F&& f) const {
+    const Level& cells = levels[level];
+    if (sparse) {
+        double firstCol = std::floor(lowerX / cells.cellWidth);
+        double lastCol = std::floor(upperX / cells.cellWidth);
+        double firstRow = std::floor(lowerY / cells.cellHeight);
+        double lastRow = std::floor(upperY / cells.cellHeight);
+
+        // Probe every cell of a small box, walk the occupied cells for a big one
+        if ((lastCol - firstCol + 1) * (lastRow - firstRow + 1) <= double(CellCount())) {
+            for (int row = int(firstRow); row <= int(lastRow); row++) {
+                for (int col = int(firstCol); col <= int(lastCol); col++) {
+                    int slot = Find(Key(col, row), level);
+                    if (slot >= 0) f(slot);
+                }
+            }
+        } else {
+            for (int slot = 0; slot < CellCount(); slot++) {
+                if (!slotLive[slot] || slotLevels[slot] != level) continue;
+                double col = KeyCol(slotKeys[slot]);
+                double row = KeyRow(slotKeys[slot]);
+                if (col >= firstCol && col <= lastCol && row >= firstRow && row <= lastRow) f(slot);
+            }
+        }
+        return;
+    }
+
+    int first = CalculatePosition(lowerX, lowerY, level) - cells.offset;
+    int last = CalculatePosition(upperX, upperY, level) - cells.offset;
+    for (int row = first / cells.cols; row <= last / cells.cols; row++) {
+        for (int col = first % cells.cols; col <= last % cells.cols; col++) {
+            f(cells.offset + row * cells.cols + col);
+        }
+    }
+}
+
+template <typename F>
+void UniformGrid::ForEachInRegion(double lowerX, double lowerY, double upperX, double upperY, F&& f) const {
+    // Nothing was binned yet
+    if (cellStart.empty()) return;
+
+    ForEachCellInRegion(lowerX, lowerY, upperX, upperY, [&](int cell) {
+        for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+            f(sortedIndices[k]);
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "AABBTree.hpp"
+
+#include <algorithm>
+
+// Perimeter of a box, the cost an insertion minimizes
+static double Perimeter(glm::dvec2 lower, glm::dvec2 upper) {
+    return 2 * ((upper.x - lower.x) + (upper.y - lower.y));
+}
+
+// Constructor
+AABBTree::AABBTree(double u_margin) {
+    margin = u_margin;
+}
+
+int AABBTree::Allocate() {
+    if (freeList < 0) {
+        nodes.emplace_back();
+        return int(nodes.size()) - 1;
+    }
+
+    int node = freeList;
+    freeList = nodes[node].item;
+    nodes[node] = Node();
+    return node;
+}
+
+void AABBTree::Free(int node) {
+    nodes[node].item = freeList;
+    nodes[node].left = -1;
+    freeList = node;
+}
+
+int AABBTree::Insert(glm::dvec2 lower, glm::dvec2 upper, int item) {
+    int leaf = Allocate();
+    nodes[leaf].lower = lower - margin;
+    nodes[leaf].upper = upper + margin;
+    nodes[leaf].item = item;
+    InsertLeaf(leaf);
+    return leaf;
+}
+
+void AABBTree::Remove(int leaf) {
+    RemoveLeaf(leaf);
+    Free(leaf);
+}
+
+bool AABBTree::Update(int leaf, glm::dvec2 lower, glm::dvec2 upper) {
+    Node& node = nodes[leaf];
+    if (node.lower.x <= lower.x && node.lower.y <= lower.y && upper.x <= node.upper.x && upper.y <= node.upper.y) {
+        return false;
+    }
+
+    RemoveLeaf(leaf);
+    nodes[leaf].lower = lower - margin;
+    nodes[leaf].upper = upper + margin;
+    InsertLeaf(leaf);
+    return true;
+}
+
+// Walk down towards the child whose box grows the least, stopping where
+// pairing with the current node is cheaper than going further
+void AABBTree::InsertLeaf(int leaf) {
+    if (root < 0) {
+        root = leaf;
+        nodes[leaf].parent = -1;
+        return;
+    }
+
+    glm::dvec2 lower = nodes[leaf].lower;
+    glm::dvec2 upper = nodes[leaf].upper;
+    int sibling = root;
+    while (!nodes[sibling].IsLeaf()) {
+        const Node& node = nodes[sibling];
+        double area = Perimeter(node.lower, node.upper);
+        double combined = Perimeter(glm::min(node.lower, lower), glm::max(node.upper, upper));
+        // Pairing here makes a new parent, going down grows this node either way
+        double cost = 2 * combined;
+        double inheritance = 2 * (combined - area);
+
+        auto descendCost = [&](int child) {
+            const Node& c = nodes[child];
+            double grown = Perimeter(glm::min(c.lower, lower), glm::max(c.upper, upper));
+            return c.IsLeaf() ? grown + inheritance : grown - Perimeter(c.lower, c.upper) + inheritance;
+        };
+        double leftCost = descendCost(node.left);
+        double rightCost = descendCost(node.right);
+
+        if (cost < leftCost && cost < rightCost) break;
+        sibling = (leftCost < rightCost) ? node.left : node.right;
+    }
+
+    // A new parent for the sibling and the leaf
+    int oldParent = nodes[sibling].parent;
+    int parent = Allocate();
+    nodes[parent].parent = oldParent;
+    nodes[parent].left = sibling;
+    nodes[parent].right = leaf;
+    nodes[sibling].parent = parent;
+    nodes[leaf].parent = parent;
+
+    if (oldParent < 0) {
+        root = parent;
+    } else if (nodes[oldParent].left == sibling) {
+        nodes[oldParent].left = parent;
+    } else {
+        nodes[oldParent].right = parent;
+    }
+    Refit(parent);
+}
+
+void AABBTree::RemoveLeaf(int leaf) {
+    if (leaf == root) {
+        root = -1;
+        return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+    nodes[sibling].parent = grandParent;
+    if (grandParent < 0) {
+        root = sibling;
+    } else {
+        if (nodes[grandParent].left == parent) {
+            nodes[grandParent].left = sibling;
+        } else {
+            nodes[grandParent].right = sibling;
+        }
+        Refit(grandParent);
+    }
+    Free(parent);
+}
+
+void AABBTree::Refit(int node) {
+    while (node >= 0) {
+        Node& n = nodes[node];
+        n.lower = glm::min(nodes[n.left].lower, nodes[n.right].lower);
+        n.upper = glm::max(nodes[n.left].upper, nodes[n.right].upper);
+        node = n.parent;
+    }
+}
@@ -0,0 +1,222 @@
+#include "AllocationTracker.hpp"
+
+#ifdef SPH_TRACK_ALLOCATIONS
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Threads with counters of their own, later threads share the last ones
+static const int maxThreads = 64;
+// Tags per thread, allocations under later tags only count toward the thread
+static const int maxTags = 32;
+
+// The counts of one tag on one thread
+struct TagSlot {
+    std::atomic<const char*> tag{nullptr};
+    std::atomic<std::uint64_t> allocations{0};
+    std::atomic<std::uint64_t> bytes{0};
+};
+
+// The counts of one thread. Statics, so registering a thread allocates nothing
+struct ThreadSlot {
+    std::atomic<std::uint64_t> allocations{0};
+    std::atomic<std::uint64_t> bytes{0};
+    TagSlot tags[maxTags];
+};
+
+static ThreadSlot threadSlots[maxThreads];
+static std::atomic<int> claimedSlots{0};
+static thread_local ThreadSlot* threadSlot = nullptr;
+static thread_local const char* currentTag = nullptr;
+
+static std::atomic<bool> strictMode{false};
+static std::atomic<std::uint64_t> violations{0};
+static std::atomic<const char*> firstViolation{nullptr};
+
+static ThreadSlot& ThisThread() {
+    if (threadSlot == nullptr) {
+        int slot = claimedSlots.fetch_add(1, std::memory_order_relaxed);
+        threadSlot = &threadSlots[slot < maxThreads ? slot : maxThreads - 1];
+    }
+    return *threadSlot;
+}
+
+// Tags are literals, the same pointer is the same tag
+static TagSlot* FindTag(ThreadSlot& thread, const char* tag) {
+    for (TagSlot& slot : thread.tags) {
+        const char* current = slot.tag.load(std::memory_order_acquire);
+        if (current == nullptr) {
+            // Another thread sharing the slot may claim it first
+            if (slot.tag.compare_exchange_strong(current, tag)) return &slot;
+        }
+        if (current == tag) return &slot;
+    }
+    return nullptr;
+}
+
+static void Count(std::size_t size) {
+    ThreadSlot& thread = ThisThread();
+    thread.allocations.fetch_add(1, std::memory_order_relaxed);
+    thread.bytes.fetch_add(size, std::memory_order_relaxed);
+    if (currentTag == nullptr) return;
+
+    if (TagSlot* slot = FindTag(thread, currentTag)) {
+        slot->allocations.fetch_add(1, std::memory_order_relaxed);
+        slot->bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    if (strictMode.load(std::memory_order_relaxed)) {
+        violations.fetch_add(1, std::memory_order_relaxed);
+        const char* none = nullptr;
+        firstViolation.compare_exchange_strong(none, currentTag);
+    }
+}
+
+// Counts, then allocates like the standard operator new: on failure the
+// new handler runs and the allocation is tried again, until there is none
+static void* Allocate(std::size_t size, std::size_t alignment) {
+    Count(size);
+    if (size == 0) size = 1;
+
+    while (true) {
+        void* memory = nullptr;
+        if (alignment <= alignof(std::max_align_t)) {
+            memory = std::malloc(size);
+        } else {
+#ifdef _WIN32
+            memory = _aligned_malloc(size, alignment);
+#else
+            if (posix_memalign(&memory, alignment, size) != 0) memory = nullptr;
+#endif
+        }
+        if (memory != nullptr) return memory;
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) return nullptr;
+        handler();
+    }
+}
+
+static void* AllocateOrThrow(std::size_t size, std::size_t alignment) {
+    void* memory = Allocate(size, alignment);
+    if (memory == nullptr) throw std::bad_alloc();
+    return memory;
+}
+
+static void FreeAligned(void* memory) {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+AllocationCounts AllocationTracker::Thread() {
+    ThreadSlot& thread = ThisThread();
+    return {thread.allocations.load(std::memory_order_relaxed), thread.bytes.load(std::memory_order_relaxed)};
+}
+
+AllocationCounts AllocationTracker::Total() {
+    AllocationCounts total;
+    int claimed = std::min(claimedSlots.load(std::memory_order_relaxed), maxThreads);
+    for (int t = 0; t < claimed; t++) {
+        total.allocations += threadSlots[t].allocations.load(std::memory_order_relaxed);
+        total.bytes += threadSlots[t].bytes.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::vector<TagAllocations> AllocationTracker::Tags() {
+    std::vector<TagAllocations> tags;
+    int claimed = std::min(claimedSlots.load(std::memory_order_relaxed), maxThreads);
+    for (int t = 0; t < claimed; t++) {
+        for (const TagSlot& slot : threadSlots[t].tags) {
+            const char* tag = slot.tag.load(std::memory_order_acquire);
+            if (tag == nullptr) break;
+
+            auto entry = std::find_if(tags.begin(), tags.end(), [&](const TagAllocations& other) {
+                return std::strcmp(other.tag, tag) == 0;
+            });
+            if (entry == tags.end()) {
+                tags.push_back({tag, {}});
+                entry = tags.end() - 1;
+            }
+            entry->counts.allocations += slot.allocations.load(std::memory_order_relaxed);
+            entry->counts.bytes += slot.bytes.load(std::memory_order_relaxed);
+        }
+    }
+    return tags;
+}
+
+void AllocationTracker::Reset() {
+    for (ThreadSlot& thread : threadSlots) {
+        thread.allocations.store(0, std::memory_order_relaxed);
+        thread.bytes.store(0, std::memory_order_relaxed);
+        for (TagSlot& slot : thread.tags) {
+            slot.allocations.store(0, std::memory_order_relaxed);
+            slot.bytes.store(0, std::memory_order_relaxed);
+        }
+    }
+    violations.store(0, std::memory_order_relaxed);
+    firstViolation.store(nullptr, std::memory_order_relaxed);
+}
+
+const char* AllocationTracker::SetTag(const char* tag) {
+    const char* previous = currentTag;
+    currentTag = tag;
+    return previous;
+}
+
+void AllocationTracker::SetStrict(bool strict) {
+    strictMode.store(strict, std::memory_order_relaxed);
+}
+
+std::uint64_t AllocationTracker::Violations() {
+    return violations.load(std::memory_order_relaxed);
+}
+
+const char* AllocationTracker::FirstViolation() {
+    return firstViolation.load(std::memory_order_relaxed);
+}
+
+// REPLACED OPERATORS
+// ----
+
+void* operator new(std::size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new[](std::size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, std::size_t(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, std::size_t(alignment)); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, std::size_t(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, std::size_t(alignment)); }
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { FreeAligned(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { FreeAligned(memory); }
+
+// ----
+
+#else
+
+AllocationCounts AllocationTracker::Thread() { return {}; }
+AllocationCounts AllocationTracker::Total() { return {}; }
+std::vector<TagAllocations> AllocationTracker::Tags() { return {}; }
+void AllocationTracker::Reset() { }
+void AllocationTracker::SetStrict(bool) { }
+std::uint64_t AllocationTracker::Violations() { return 0; }
+const char* AllocationTracker::FirstViolation() { return nullptr; }
+
+#endif
@@ -6,6 +6,9 @@
 #include "Circle.hpp"
 #include "Simulation.hpp"
 #include "FluidSimulation.hpp"
+#include "GpuTimer.hpp"
+#include "PerformanceOverlay.hpp"
+#include "Profiler.hpp"
 
 // Standard cpp libaries
 #include <iostream>
@@ -61,7 +64,7 @@ void CreateDefaultVBO(GLuint& vao, GLuint& vbo, std::vector<GLfloat> vertices) {
 }
 
 // Bind buffers with IBO
-void CreateDefaultIBO(GLuint& vao, GLuint& vbo, std::vector<GLfloat> vertices, std::vector<GLint> indices) {
+void CreateDefaultIBO(GLuint& vao, GLuint& vbo, const std::pmr::vector<GLfloat>& vertices, const std::pmr::vector<GLint>& indices) {
     // Create vertex array object
     glGenVertexArrays(1, &vao);
     // Bind the vertex array object
@@ -256,8 +259,24 @@ GLuint& Application::getComputeShader() {
     return computeShader;
 }
 
+// Returns the timer for GPU work
+GpuTimer& Application::getGpuTimer() {
+    return gpuTimer;
+}
+
+// Returns the arena reset at the start of every Render
+FrameArena& Application::getFrameArena() {
+    return frameArena;
+}
+
+// Returns the width of the window
+int Application::getWindowWidth() const {
+    return program.m_windowWidth;
+}
+
 // Pre loop
 void Application::PreLoop() {
+    gpuTimer.Init();
     defaultShader = CreateDefaultShader();
     computeShader = CreateComputeShader(ConvertShaderToString("./shaders/force_compute.glsl"));
 
@@ -312,12 +331,31 @@ void Application::AddObject(std::shared_ptr<IObject> object) {
     }
 }
 
+// Erase the last entry of a list that holds object
+template <typename T>
+static bool EraseFromBack(std::vector<std::shared_ptr<T>>& objects, const std::shared_ptr<IObject>& object) {
+    for (auto it = objects.rbegin(); it != objects.rend(); it++) {
+        if (*it == object) {
+            objects.erase(std::next(it).base());
+            return true;
+        }
+    }
+    return false;
+}
+
+void Application::RemoveObject(std::shared_ptr<IObject> object) {
+    if (!EraseFromBack(circles, object) && !EraseFromBack(lines, object) && !EraseFromBack(triangles, object)) {
+        std::cerr << "Error, object is not in the scene." << std::endl;
+    }
+}
+
 void Application::AddSimulation(Simulation* sim) {
     simulations.push_back(sim);
 }
 
 
 void Application::HandleInput(SDL_Event e) {
+    PROFILE_ZONE("HandleInput");
 
     // Handle events on queue
 	while(SDL_PollEvent( &e ) != 0){
@@ -334,84 +372,191 @@ void Application::HandleInput(SDL_Event e) {
             if(state[SDL_SCANCODE_ESCAPE]) {
                 program.TerminateLoop();
             }
+            // F3 shows and hides the performance overlay, held keys repeat so only the first press counts
+            if(e.key.keysym.scancode == SDL_SCANCODE_F3 && e.key.repeat == 0) {
+                showOverlay = !showOverlay;
+            }
+        }
+
+        // Simulations see every event too, for controls of their own
+        for (Simulation* sim : simulations) {
+            sim->HandleEvent(e);
         }
 
 	} // End SDL_PollEvent loop.
 }
 
 void Application::Update() {
+    PROFILE_ZONE("Update");
     for (Simulation* sim : simulations) {
         sim->Update();
     }
 }
 
-// Adjusts the given indices by the given factor
-std::vector<GLuint> AdjustIndices(std::vector<GLuint> indices, int factor) {
-    std::vector<GLuint> newIndices;
+// Empties a list in the frame arena, returning how much it had room for
+template <typename T>
+static std::size_t ReleaseList(std::pmr::vector<T>& list) {
+    std::size_t capacity = list.capacity();
+    std::pmr::vector<T>(list.get_allocator()).swap(list);
+    return capacity;
+}
+
+// The lists give up their memory before the arena takes it back, then each
+// reserves what it had room for last frame, so it fills without growing
+void Application::ResetFrameArena() {
+    std::size_t triangleRoom[2] = {ReleaseList(triangleVertices), ReleaseList(triangleIndices)};
+    std::size_t lineRoom[2] = {ReleaseList(lineVertices), ReleaseList(lineIndices)};
+    std::size_t circleRoom[2] = {ReleaseList(circleVertices), ReleaseList(circleIndices)};
+    std::size_t overlayRoom[2] = {ReleaseList(overlayVertices), ReleaseList(overlayIndices)};
+
+    frameArena.Reset();
+
+    triangleVertices.reserve(triangleRoom[0]);
+    triangleIndices.reserve(triangleRoom[1]);
+    lineVertices.reserve(lineRoom[0]);
+    lineIndices.reserve(lineRoom[1]);
+    circleVertices.reserve(circleRoom[0]);
+    circleIndices.reserve(circleRoom[1]);
+    overlayVertices.reserve(overlayRoom[0]);
+    overlayIndices.reserve(overlayRoom[1]);
+}
+
+// Appends the given indices to the list, adjusted by the given factor.
+// Appending in place spares a copy of every object's indices
+void AdjustIndices(const std::vector<GLuint>& indices, int factor, std::pmr::vector<GLint>& list) {
     for (GLuint index : indices) {
-        newIndices.push_back(index + factor);
+        list.push_back(GLint(index + factor));
     }
-
-    return newIndices;
 }
 
 void Application::Render() {
+    PROFILE_ZONE("Render");
+    // The overlay keeps sampling while hidden, so its graphs are current
+    // when it is shown. Draw calls and uploads are those of the last frame,
+    // GPU time that of the frame the timer read back
+    gpuTimer.BeginFrame();
+    frameStats.gpuMilliseconds = gpuTimer.FrameMilliseconds();
+    for (Simulation* sim : simulations) {
+        sim->CollectStats(frameStats);
+    }
+    overlay.Record(frameStats);
+    frameStats = FrameStats();
+    ResetFrameArena();
+
     // Draw all triangles at once
     // Compile all triangles' vertices
-    for (int i = 0; i < triangles.size(); i++) {
-        // Update vertices
-        triangleVertices.insert(triangleVertices.end(), triangles.at(i)->vertices.begin(), triangles.at(i)->vertices.end());
-        // Add the appropriate indices to the list
-        std::vector<GLuint> t_indices = triangles.at(i)->ibo;
-        t_indices = AdjustIndices(t_indices, i * (triangleVertices.size() / (6 * triangles.size())));
-        // Update indices
-        triangleIndices.insert(triangleIndices.end(), t_indices.begin(), t_indices.end());
-
-    } // We do this so that when we update the triangle vertices dynamically it will update in real time
-    CreateDefaultIBO(vao, vbo, triangleVertices, triangleIndices);
+    {
+        PROFILE_ZONE("Build triangles");
+        for (int i = 0; i < triangles.size(); i++) {
+            // Update vertices
+            triangleVertices.insert(triangleVertices.end(), triangles.at(i)->vertices.begin(), triangles.at(i)->vertices.end());
+            // Add the appropriate indices to the list
+            AdjustIndices(triangles.at(i)->ibo, i * 3, triangleIndices);
+
+        } // We do this so that when we update the triangle vertices dynamically it will update in real time
+    }
+    {
+        PROFILE_ZONE("Upload triangles");
+        Upload(triangleVertices, triangleIndices);
+    }
+    gpuTimer.Begin("Draw triangles");
     Draw(triangleIndices);
+    gpuTimer.End();
 
     // Draw all lines at once
     // Compile all lines' vertices
-    for (int i = 0; i < lines.size(); i++) {
-        // Update vertices
-        lineVertices.insert(lineVertices.end(), lines.at(i)->vertices.begin(), lines.at(i)->vertices.end());
-        // Add the appropriate indices to the list
-        std::vector<GLuint> l_indices = lines.at(i)->ibo;
-        l_indices = AdjustIndices(l_indices, round(i * 4));
-        // Update indices
-        lineIndices.insert(lineIndices.end(), l_indices.begin(), l_indices.end());
-
-    } // We do this so that when we update the triangle vertices dynamically it will update in real time
-    CreateDefaultIBO(vao, vbo, lineVertices, lineIndices);
+    {
+        PROFILE_ZONE("Build lines");
+        for (int i = 0; i < lines.size(); i++) {
+            // Update vertices
+            lineVertices.insert(lineVertices.end(), lines.at(i)->vertices.begin(), lines.at(i)->vertices.end());
+            // Add the appropriate indices to the list
+            AdjustIndices(lines.at(i)->ibo, i * 4, lineIndices);
+
+        } // We do this so that when we update the triangle vertices dynamically it will update in real time
+    }
+    {
+        PROFILE_ZONE("Upload lines");
+        Upload(lineVertices, lineIndices);
+    }
+    gpuTimer.Begin("Draw lines");
     Draw(lineIndices);
+    gpuTimer.End();
 
     // Draw all circles at once
     // Compile all lines' vertices
-    int count = 0;
-    for (const auto& circle: circles) {
-        // Update vertices
-        circleVertices.insert(circleVertices.end(), circle->vertices.begin(), circle->vertices.end());
-        // Add the appropriate indices to the list
-        std::vector<GLuint> c_indices = circle->ibo;
-        c_indices = AdjustIndices(c_indices, count * 33);
-        // Update indices
-        circleIndices.insert(circleIndices.end(), c_indices.begin(), c_indices.end());
-        count++;
-    } // We do this so that when we update the triangle vertices dynamically it will update in real time
-    CreateDefaultIBO(vao, vbo, circleVertices, circleIndices);
+    {
+        PROFILE_ZONE("Build circles");
+        int count = 0;
+        for (const auto& circle: circles) {
+            // Update vertices
+            circleVertices.insert(circleVertices.end(), circle->vertices.begin(), circle->vertices.end());
+            // Add the appropriate indices to the list
+            AdjustIndices(circle->ibo, count * 33, circleIndices);
+            count++;
+        } // We do this so that when we update the triangle vertices dynamically it will update in real time
+        for (Simulation* sim : simulations) {
+            ParticleView particles = sim->Particles();
+            AppendParticles(particles, count);
+            count += int(particles.count);
+        }
+    }
+    {
+        PROFILE_ZONE("Upload circles");
+        Upload(circleVertices, circleIndices);
+    }
+    gpuTimer.Begin("Draw circles");
     Draw(circleIndices);
+    gpuTimer.End();
+
+    if (showOverlay) {
+        DrawOverlay();
+    }
+}
+
+// Window pixels with the origin at the bottom left, over everything drawn so far
+void Application::DrawOverlay() {
+    PROFILE_ZONE("Overlay");
+    overlay.Build(float(program.m_windowWidth), float(program.m_windowHeight), overlayVertices, overlayIndices);
+
+    glClear(GL_DEPTH_BUFFER_BIT);
+    Upload(overlayVertices, overlayIndices);
+    gpuTimer.Begin("Draw overlay");
+    Draw(overlayIndices, glm::ortho(0.0f, float(program.m_windowWidth), 0.0f, float(program.m_windowHeight), -1.0f, 1.0f));
+    gpuTimer.End();
+}
+
+// The discs are those of Circle, built from one outline shared by every
+// particle, so there is no Circle object or vertex list per particle
+void Application::AppendParticles(const ParticleView& particles, int firstCircle) {
+    if (particles.count == 0) return;
+    if (particleOutline.empty()) {
+        Circle unit(glm::vec3(0.0f), 1.0f);
+        for (std::size_t i = 0; i < unit.vertices.size(); i += 6) {
+            particleOutline.push_back(glm::vec2(unit.vertices[i], unit.vertices[i + 1]));
+        }
+        particleIndices = unit.ibo;
+    }
+
+    circleVertices.reserve(circleVertices.size() + particles.count * particleOutline.size() * 6);
+    circleIndices.reserve(circleIndices.size() + particles.count * particleIndices.size());
+    for (std::size_t p = 0; p < particles.count; p++) {
+        glm::vec2 center(particles.positions[2 * p], particles.positions[2 * p + 1]);
+        for (const glm::vec2& corner : particleOutline) {
+            glm::vec2 vertex = center + particles.radius * corner;
+            circleVertices.insert(circleVertices.end(), {vertex.x, vertex.y, 0.0f, 1.0f, 1.0f, 1.0f});
+        }
+        AdjustIndices(particleIndices, int(firstCircle + p) * int(particleOutline.size()), circleIndices);
+    }
+}
 
-    // Clear the indices and vertices
-    lineVertices.clear();
-    lineIndices.clear();
-    triangleVertices.clear();
-    triangleIndices.clear();
-    circleVertices.clear();
-    circleIndices.clear();
+// Give a batch to the GPU, counting the bytes for the overlay
+void Application::Upload(const std::pmr::vector<GLfloat>& vertices, const std::pmr::vector<GLint>& indices) {
+    CreateDefaultIBO(vao, vbo, vertices, indices);
+    frameStats.uploadedBytes += vertices.size() * sizeof(GLfloat) + indices.size() * sizeof(GLint);
 }
 
-void SendMVP(SDLGraphicsProgram &prog, GLuint &shader, Camera* camera) {
+glm::mat4 CameraMVP(SDLGraphicsProgram &prog, Camera* camera) {
     // Create the perspective matrix
     glm::mat4 perspective = glm::perspective(
         glm::radians(45.0f),
@@ -424,7 +569,10 @@ void SendMVP(SDLGraphicsProgram &prog, GLuint &shader, Camera* camera) {
     // Create view matrix
     glm::mat4 view = camera->GetViewMatrix();
     // Create the MVP matrix
-    glm::mat4 MVP = perspective * view * model;
+    return perspective * view * model;
+}
+
+void SendMVP(GLuint &shader, const glm::mat4& MVP) {
     // Find MVP's location in the shader
     GLint mvpLocation = glGetUniformLocation(shader, "MVP");
     if(mvpLocation >= 0){
@@ -435,10 +583,16 @@ void SendMVP(SDLGraphicsProgram &prog, GLuint &shader, Camera* camera) {
     }
 }
 
-void Application::Draw(std::vector<GLint> &indices) {
+void Application::Draw(const std::pmr::vector<GLint> &indices) {
+    Draw(indices, CameraMVP(program, camera));
+}
+
+void Application::Draw(const std::pmr::vector<GLint> &indices, const glm::mat4& MVP) {
+    PROFILE_ZONE("Draw");
+    frameStats.drawCalls++;
     glUseProgram(defaultShader);
 
-    SendMVP(program, defaultShader, camera);
+    SendMVP(defaultShader, MVP);
 
     glDrawElements(
         GL_TRIANGLES,
@@ -0,0 +1,246 @@
+#include "FluidScene.hpp"
+#include "RigidBody.hpp"
+#include "SignedDistanceField.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+    // The text after a flag's "=", and the flag before it
+    std::string FlagValue(const std::string& arg, std::string& flag) {
+        std::size_t equals = arg.find('=');
+        flag = arg.substr(0, equals);
+        return (equals == std::string::npos) ? std::string() : arg.substr(equals + 1);
+    }
+
+    // Read a flag's whole value as an integer between lowest and highest
+    bool ParseInteger(const std::string& arg, long long lowest, long long highest, long long& value) {
+        std::string flag;
+        std::string text = FlagValue(arg, flag);
+        char* end = nullptr;
+        errno = 0;
+        long long parsed = std::strtoll(text.c_str(), &end, 10);
+        if (text.empty() || *end != '\0' || errno == ERANGE || parsed < lowest || parsed > highest) {
+            std::cerr << "Expected an integer for " << flag << ", not \"" << text << "\"" << std::endl;
+            return false;
+        }
+        value = parsed;
+        return true;
+    }
+
+    // Ratio of the scene's particle spacing to the interactive scene's
+    double SceneScale(const SceneOptions& scene) {
+        return 11.0 / (std::max(scene.grid, 2) - 1);
+    }
+
+    // The explicit step shrinks with the smoothing distance, keeping the
+    // distance a particle moves per step the same fraction of it. PCISPH
+    // iterates the pressure instead of relying on a stiffness, so it stays
+    // stable over 4 explicit steps at once. Position Based Fluids only
+    // moves positions and takes a frame at 60Hz whatever the grid
+    double DefaultTimeStep(const SolverConfig& config, double scale) {
+        switch (config.mode) {
+            case SolverMode::PCISPH:
+                return 4 * config.deltaTime * scale;
+            case SolverMode::PositionBased:
+                return 1.0 / 60.0;
+            default:
+                return config.deltaTime * scale;
+        }
+    }
+
+    // A light ball, a box and a wedge dropped onto the fluid
+    void AddDroppedBodies(IFluidSolver& solver, double density) {
+        BoundaryShape ball;
+        ball.kind = BoundaryShape::Kind::Circle;
+        ball.radius = 0.3;
+        BoundaryShape box;
+        box.kind = BoundaryShape::Kind::Box;
+        box.halfExtents = {0.4, 0.15};
+        BoundaryShape wedge;
+        wedge.kind = BoundaryShape::Kind::Polygon;
+        wedge.points = {{-0.3, -0.2}, {0.3, -0.2}, {0, 0.3}};
+        solver.AddBody(MakeRigidBody(ball, {-1.5, 1.8}, density));
+        solver.AddBody(MakeRigidBody(box, {0, 1.8}, density));
+        solver.AddBody(MakeRigidBody(wedge, {1.5, 1.8}, density));
+    }
+
+    // Circles, boxes and triangles in turn on a grid above the fluid
+    void AddBodyGrid(IFluidSolver& solver, const SolverConfig& config, int count, double density) {
+        double bottom = config.height / 2 + config.particleSpacing;
+        double areaWidth = 2 * config.width;
+        double areaHeight = config.height - bottom;
+        int columns = std::max(1, int(std::ceil(std::sqrt(count * areaWidth / areaHeight))));
+        int rows = (count + columns - 1) / columns;
+        double cell = std::min(areaWidth / columns, areaHeight / rows);
+        double size = 0.35 * cell;
+
+        for (int i = 0; i < count; i++) {
+            glm::dvec2 position = {-config.width + (i % columns + 0.5) * areaWidth / columns,
+                                   bottom + (i / columns + 0.5) * areaHeight / rows};
+            BoundaryShape shape;
+            switch (i % 3) {
+                case 0:
+                    shape.kind = BoundaryShape::Kind::Circle;
+                    shape.radius = size;
+                    break;
+                case 1:
+                    shape.kind = BoundaryShape::Kind::Box;
+                    shape.halfExtents = {size, size / 2};
+                    break;
+                default:
+                    shape.kind = BoundaryShape::Kind::Polygon;
+                    shape.points = {{-size, -size}, {size, -size}, {0, size}};
+                    break;
+            }
+            RigidBody body = MakeRigidBody(shape, position, density);
+            body.angle = 0.3 * i;
+            solver.AddBody(body);
+        }
+    }
+}
+
+bool ParseIntArgument(const std::string& arg, int& value) {
+    long long parsed;
+    if (!ParseInteger(arg, INT_MIN, INT_MAX, parsed)) return false;
+    value = int(parsed);
+    return true;
+}
+
+bool ParseLongArgument(const std::string& arg, long long& value) {
+    return ParseInteger(arg, LLONG_MIN, LLONG_MAX, value);
+}
+
+bool ParseDoubleArgument(const std::string& arg, double& value) {
+    std::string flag;
+    std::string text = FlagValue(arg, flag);
+    char* end = nullptr;
+    errno = 0;
+    double parsed = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || errno == ERANGE || !std::isfinite(parsed)) {
+        std::cerr << "Expected a number for " << flag << ", not \"" << text << "\"" << std::endl;
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+ArgumentResult ParseSceneArgument(const std::string& arg, SolverConfig& config, SceneOptions& scene) {
+    if (arg.rfind("--precision=", 0) == 0) {
+        if (!ParsePrecision(arg.substr(12), config.precision)) {
+            std::cerr << "Unknown precision " << arg.substr(12) << ", expected float, double or mixed" << std::endl;
+            return ArgumentResult::Invalid;
+        }
+    } else if (arg.rfind("--mode=", 0) == 0) {
+        if (!ParseSolverMode(arg.substr(7), config.mode)) {
+            std::cerr << "Unknown mode " << arg.substr(7) << ", expected explicit, pcisph or pbf" << std::endl;
+            return ArgumentResult::Invalid;
+        }
+    } else if (arg.rfind("--mu=", 0) == 0) {
+        if (!ParseDoubleArgument(arg, config.mu)) {
+            return ArgumentResult::Invalid;
+        }
+    } else if (arg == "--implicit-viscosity") {
+        config.implicitViscosity = true;
+    } else if (arg == "--sleep") {
+        config.sleeping = true;
+    } else if (arg == "--adaptive") {
+        config.adaptiveTimeSteps = true;
+    } else if (arg.rfind("--levels=", 0) == 0) {
+        if (!ParseIntArgument(arg, config.maxTimeLevels)) {
+            return ArgumentResult::Invalid;
+        }
+    } else if (arg.rfind("--courant=", 0) == 0) {
+        if (!ParseDoubleArgument(arg, config.courantNumber)) {
+            return ArgumentResult::Invalid;
+        }
+    } else if (arg == "--sparse-grid") {
+        config.sparseGrid = true;
+    } else if (arg == "--adaptive-resolution") {
+        config.adaptiveResolution = true;
+    } else if (arg.rfind("--merge-levels=", 0) == 0) {
+        if (!ParseIntArgument(arg, config.maxMergeLevels)) {
+            return ArgumentResult::Invalid;
+        }
+    } else if (arg.rfind("--boundary=", 0) == 0) {
+        if (!LoadBoundaryShapes(arg.substr(11), config.obstacles)) {
+            return ArgumentResult::Invalid;
+        }
+    } else if (arg.rfind("--threads=", 0) == 0) {
+        if (!ParseIntArgument(arg, config.threadCount)) {
+            return ArgumentResult::Invalid;
+        }
+    } else if (arg.rfind("--grid=", 0) == 0) {
+        if (!ParseIntArgument(arg, scene.grid)) {
+            return ArgumentResult::Invalid;
+        }
+        if (scene.grid < 2) {
+            std::cerr << "The block needs at least 2 particles per side, not " << scene.grid << std::endl;
+            return ArgumentResult::Invalid;
+        }
+    } else if (arg.rfind("--dt=", 0) == 0) {
+        if (!ParseDoubleArgument(arg, scene.deltaTime)) {
+            return ArgumentResult::Invalid;
+        }
+    } else if (arg == "--inflow") {
+        scene.inflow = true;
+    } else if (arg == "--bodies") {
+        scene.bodies = true;
+    } else if (arg.rfind("--bodies=", 0) == 0) {
+        if (!ParseIntArgument(arg, scene.bodyCount)) {
+            return ArgumentResult::Invalid;
+        }
+    } else {
+        return ArgumentResult::Unknown;
+    }
+    return ArgumentResult::Parsed;
+}
+
+// The 12 x 12 block of the interactive scene is scaled to the requested
+// grid, so each particle sees the same neighborhood, density and pressure
+// acceleration. Unless one is given, the time step is the mode's default,
+// see DefaultTimeStep. The particle limit under inflow covers the same area
+// whatever the grid
+void ConfigureScene(SolverConfig& config, const SceneOptions& scene) {
+    double scale = SceneScale(scene);
+    config.width = 2.4;
+    config.height = 2.4;
+    config.smoothingDistance = 0.4 * scale;
+    config.stiffness *= scale;
+    config.nearStiffness *= scale;
+    config.particleSpacing *= scale;
+    config.particleMass = scale * scale;
+    config.deltaTime = (scene.deltaTime > 0) ? scene.deltaTime : DefaultTimeStep(config, scale);
+
+    if (scene.inflow) {
+        ParticleEmitter nozzle;
+        nozzle.position = {-1.9, 1.7};
+        nozzle.velocity = {2, -1};
+        config.emitters.push_back(nozzle);
+        BoundaryShape drain;
+        drain.kind = BoundaryShape::Kind::Circle;
+        drain.center = {config.width, -config.height};
+        drain.radius = 0.6;
+        config.sinks.push_back(drain);
+        config.maxParticles = int(std::lround(400 / (scale * scale)));
+    }
+}
+
+// Bodies are half as dense as the fluid, so they end up floating
+void PopulateScene(IFluidSolver& solver, const SceneOptions& scene) {
+    const SolverConfig& config = solver.Config();
+    glm::dvec3 lower = {-config.width / 2, -config.height / 2, 0};
+    glm::dvec3 upper = {config.width / 2, config.height / 2, 0};
+    SpawnParticleGrid(solver, lower, upper, scene.grid, config.particleMass);
+
+    double density = 0.5 * config.particleMass / (config.particleSpacing * config.particleSpacing);
+    if (scene.bodyCount > 0) {
+        AddBodyGrid(solver, config, scene.bodyCount, density);
+    } else if (scene.bodies) {
+        AddDroppedBodies(solver, density);
+    }
+}
@@ -0,0 +1,1776 @@
+#include "FluidSolver.hpp"
+#include "PerfCounters.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+
+// One grid level per merge level, so merged particles are binned on cells of their own support
+static int GridLevels(const SolverConfig& config) {
+    if (!config.adaptiveResolution || config.mode != SolverMode::Explicit || config.adaptiveTimeSteps) return 1;
+    return std::max(0, std::min(config.maxMergeLevels, 8)) + 1;
+}
+
+// Constructor
+template <typename Scalar, typename PairScalar>
+FluidSolver<Scalar, PairScalar>::FluidSolver(const SolverConfig& u_config)
+    : config(u_config),
+      grid(u_config.width, u_config.height, u_config.smoothingDistance, u_config.sparseGrid, GridLevels(u_config)),
+      kernels(PairScalar(u_config.smoothingDistance)),
+      threads(u_config.threadCount),
+      bodyTree(u_config.smoothingDistance / 4) {
+    width = Scalar(config.width);
+    height = Scalar(config.height);
+    gravity = Scalar(config.gravity);
+    dampeningConstant = Scalar(config.dampeningConstant);
+    deltaTime = Scalar(config.deltaTime);
+    mu = PairScalar(config.mu);
+    targetDensity = PairScalar(config.targetDensity);
+    stiffness = PairScalar(config.stiffness);
+    nearStiffness = PairScalar(config.nearStiffness);
+    CalculateRestDensity();
+
+    if (config.adaptiveTimeSteps && config.mode != SolverMode::Explicit) {
+        std::cerr << "Adaptive time steps need the explicit solver, using a global step" << std::endl;
+        config.adaptiveTimeSteps = false;
+    }
+    if (config.adaptiveTimeSteps && config.implicitViscosity) {
+        std::cerr << "Adaptive time steps need explicit viscosity, the implicit solve is global" << std::endl;
+        config.implicitViscosity = false;
+    }
+    config.maxTimeLevels = std::max(0, std::min(config.maxTimeLevels, 16));
+
+    if (config.adaptiveResolution && config.mode != SolverMode::Explicit) {
+        std::cerr << "Adaptive resolution needs the explicit solver, keeping every particle" << std::endl;
+        config.adaptiveResolution = false;
+    }
+    if (config.adaptiveResolution && config.adaptiveTimeSteps) {
+        std::cerr << "Adaptive resolution needs a global step, keeping every particle" << std::endl;
+        config.adaptiveResolution = false;
+    }
+    config.maxMergeLevels = std::max(0, std::min(config.maxMergeLevels, 8));
+    config.refinementInterval = std::max(1, config.refinementInterval);
+
+    if (!config.obstacles.empty()) {
+        double cellSize = (config.boundaryCellSize > 0) ? config.boundaryCellSize : config.smoothingDistance / 4;
+        boundary = SignedDistanceField(config.width, config.height, cellSize, config.obstacles);
+    }
+
+    // Room for every particle the emitters may add, so the step never reallocates
+    if (config.maxParticles > 0) {
+        std::size_t capacity = std::size_t(config.maxParticles);
+        particles.Reserve(capacity);
+        accelerations.reserve(capacity);
+        pressures.reserve(capacity);
+        lambdas.reserve(capacity);
+        viscousVelocities.reserve(capacity);
+        sleepVelocities.reserve(capacity);
+        timeLevels.reserve(capacity);
+        stepEnds.reserve(capacity);
+        timeLevelTargets.reserve(capacity);
+        stepDue.reserve(capacity);
+    }
+}
+
+template <typename Scalar, typename PairScalar>
+FluidSolver<Scalar, PairScalar>::~FluidSolver() { }
+
+// UTIL METHODS
+// ---------------------------------------------------------
+std::vector<double> linspace(double start, double end, int num) {
+    std::vector<double> result(num);
+    double step = (end - start) / (num - 1);
+
+    for (int i = 0; i < num; i++) {
+        result[i] = start + i * step;
+    }
+
+    return result;
+}
+
+template <typename Scalar, typename PairScalar>
+PairScalar FluidSolver<Scalar, PairScalar>::CalculateSharedPressure(PairScalar density1, PairScalar density2) const {
+    PairScalar pressure1 = stiffness * (density1 - targetDensity);
+    PairScalar pressure2 = stiffness * (density2 - targetDensity);
+    return (pressure1 + pressure2) / 2;
+}
+
+// One sweep over the neighbors gives both densities and the pairs the force pass uses
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::CalculateDensity(int sampleIndex) {
+    PairScalar density = 0;
+    PairScalar nearDensity = 0;
+    const Vec& samplePosition = particles.predictedPositions[sampleIndex];
+    PairScalar support = kernels.density.Support();
+    PairScalar sampleSmoothing = PairScalar(particles.smoothingLengths[sampleIndex]);
+    bool uniform = !config.adaptiveResolution;
+
+    grid.ForEachNeighbor(grid.CellOf(sampleIndex), double(samplePosition.x), double(samplePosition.y), [&](int particleIndex) {
+        // A pair uses the mean of the two supports, the kernels are built for
+        // the base one: W_h(r) = s^2 W(r s) with s the ratio of the two
+        PairScalar scale = uniform ? PairScalar(1) : 2 * support / (sampleSmoothing + PairScalar(particles.smoothingLengths[particleIndex]));
+        PairScalar scale2 = scale * scale;
+
+        // Squared distance, so a tabulated kernel needs no sqrt
+        PairVec offset = PairVec(samplePosition - particles.predictedPositions[particleIndex]);
+        PairScalar dist2 = glm::dot(offset, offset);
+        if (dist2 * scale2 >= support * support) return;
+
+        PairScalar mass = PairScalar(particles.masses[particleIndex]);
+        density += mass * kernels.density.ValueSquared(dist2 * scale2) * scale2;
+        nearDensity += mass * kernels.nearDensity.ValueSquared(dist2 * scale2) * scale2;
+
+        // The particle itself counts towards its density but exerts no force
+        if (particleIndex == sampleIndex) return;
+
+        typename PairBuffer<PairScalar>::Pair pair;
+        pair.index = particleIndex;
+        pair.dist = std::sqrt(dist2);
+        pair.dir = (pair.dist != 0) ? offset / pair.dist : PairVec(0, 0, 0);
+        pair.slope = kernels.pressure.Derivative(pair.dist * scale) * scale2 * scale;
+        pair.nearSlope = kernels.nearPressure.Derivative(pair.dist * scale) * scale2 * scale;
+        pair.viscositySlope = kernels.viscosity.Laplacian(pair.dist * scale) * scale2 * scale2;
+        pairs.Add(pair);
+    });
+
+    pairs.EndParticle(sampleIndex);
+    particles.densities[sampleIndex] = Scalar(density);
+    particles.nearDensities[sampleIndex] = Scalar(nearDensity);
+}
+
+// Given a particle index find the acceleration the other particles apply on it
+template <typename Scalar, typename PairScalar>
+typename FluidSolver<Scalar, PairScalar>::PairVec FluidSolver<Scalar, PairScalar>::CalculateForces(int index) const {
+    PairVec pressureForce = {0, 0, 0};
+    PairVec viscosityForce = {0, 0, 0};
+
+    PairVec velocity = PairVec(particles.velocities[index]);
+    PairScalar density = PairScalar(particles.densities[index]);
+    PairScalar nearDensity = PairScalar(particles.nearDensities[index]);
+    // An implicit solve takes care of viscosity after the velocity update
+    PairScalar viscosity = config.implicitViscosity ? PairScalar(0) : mu;
+
+    for (const auto* pair = pairs.Begin(index); pair != pairs.End(index); pair++) {
+        int particleIndex = pair->index;
+        PairScalar otherDensity = PairScalar(particles.densities[particleIndex]);
+        PairScalar otherNearDensity = PairScalar(particles.nearDensities[particleIndex]);
+        PairScalar mass = PairScalar(particles.masses[particleIndex]);
+        if (otherDensity == 0) continue;
+
+        // Pressure forces
+        PairScalar sharedPressure = CalculateSharedPressure(density, otherDensity);
+        pressureForce -= sharedPressure * pair->dir * mass * pair->slope / otherDensity;
+
+        // Near pressure is always repulsive
+        if (otherNearDensity != 0) {
+            PairScalar sharedNearPressure = nearStiffness * (nearDensity + otherNearDensity) / 2;
+            pressureForce -= sharedNearPressure * pair->dir * mass * pair->nearSlope / otherNearDensity;
+        }
+
+        // Viscosity forces
+        PairVec otherVelocity = PairVec(particles.velocities[particleIndex]);
+        viscosityForce += viscosity * mass * (otherVelocity - velocity) * pair->viscositySlope / otherDensity;
+    }
+
+    if (density == 0) return PairVec(0, 0, 0);
+    return (pressureForce + viscosityForce) / density;
+}
+// Viscosity on its own, for the modes that resolve pressure separately
+template <typename Scalar, typename PairScalar>
+typename FluidSolver<Scalar, PairScalar>::PairVec FluidSolver<Scalar, PairScalar>::CalculateViscosity(int index) const {
+    PairVec viscosityForce = {0, 0, 0};
+    PairVec velocity = PairVec(particles.velocities[index]);
+    PairScalar density = PairScalar(particles.densities[index]);
+
+    for (const auto* pair = pairs.Begin(index); pair != pairs.End(index); pair++) {
+        PairScalar otherDensity = PairScalar(particles.densities[pair->index]);
+        if (otherDensity == 0) continue;
+
+        PairScalar mass = PairScalar(particles.masses[pair->index]);
+        PairVec otherVelocity = PairVec(particles.velocities[pair->index]);
+        viscosityForce += mu * mass * (otherVelocity - velocity) * pair->viscositySlope / otherDensity;
+    }
+
+    if (density == 0) return PairVec(0, 0, 0);
+    return viscosityForce / density;
+}
+
+// Near pressure on its own, which keeps particles from collapsing onto each other
+template <typename Scalar, typename PairScalar>
+typename FluidSolver<Scalar, PairScalar>::PairVec FluidSolver<Scalar, PairScalar>::CalculateNearPressure(int index) const {
+    PairVec pressureForce = {0, 0, 0};
+    PairScalar density = PairScalar(particles.densities[index]);
+    PairScalar nearDensity = PairScalar(particles.nearDensities[index]);
+
+    for (const auto* pair = pairs.Begin(index); pair != pairs.End(index); pair++) {
+        PairScalar otherNearDensity = PairScalar(particles.nearDensities[pair->index]);
+        if (otherNearDensity == 0) continue;
+
+        PairScalar mass = PairScalar(particles.masses[pair->index]);
+        PairScalar sharedNearPressure = nearStiffness * (nearDensity + otherNearDensity) / 2;
+        pressureForce -= sharedNearPressure * pair->dir * mass * pair->nearSlope / otherNearDensity;
+    }
+
+    if (density == 0) return PairVec(0, 0, 0);
+    return pressureForce / density;
+}
+
+// Sample the kernels over a particle with a full lattice of neighbors at the rest spacing
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::CalculateRestDensity() {
+    double spacing = config.particleSpacing;
+    double support = kernels.density.Support();
+    int reach = int(std::ceil(support / spacing));
+
+    double kernelSum = 0;
+    glm::dvec3 gradientSum = {0, 0, 0};
+    double gradientDotSum = 0;
+    for (int a = -reach; a <= reach; a++) {
+        for (int b = -reach; b <= reach; b++) {
+            glm::dvec3 offset = {a * spacing, b * spacing, 0};
+            double dist = glm::length(offset);
+            if (dist >= support) continue;
+
+            kernelSum += kernels.density.Value(PairScalar(dist));
+            if (dist == 0) continue;
+
+            glm::dvec3 gradient = double(kernels.pressure.Derivative(PairScalar(dist))) * offset / dist;
+            gradientSum += gradient;
+            gradientDotSum += glm::dot(gradient, gradient);
+        }
+    }
+
+    double rest = config.particleMass * kernelSum;
+    double m = config.particleMass;
+    restDensity = PairScalar(rest);
+    // Position Based Fluids: the sum is the squared gradient of the density constraint
+    constraintSoftness = PairScalar(config.constraintRelaxation * m * m * (glm::dot(gradientSum, gradientSum) + gradientDotSum) / (rest * rest));
+
+    // A wall is treated as the lattice continuing past it, the first row
+    // half a spacing behind the wall. Without it a particle pressed onto a
+    // wall has nothing pushing it back off
+    const int samples = 64;
+    wallSampleSpacing = PairScalar(support / samples);
+    wallDensities.assign(samples + 2, PairScalar(0));
+    wallSlopes.assign(samples + 2, PairScalar(0));
+    for (int k = 0; k <= samples; k++) {
+        double distance = k * support / samples;
+        double density = 0;
+        double slope = 0;
+        for (int a = -reach; a <= reach; a++) {
+            for (int b = 0; b <= reach; b++) {
+                glm::dvec3 offset = {a * spacing, distance + (b + 0.5) * spacing, 0};
+                double dist = glm::length(offset);
+                if (dist >= support) continue;
+
+                density += m * kernels.density.Value(PairScalar(dist));
+                slope += m * kernels.pressure.Derivative(PairScalar(dist)) * offset.y / dist;
+            }
+        }
+        wallDensities[k] = PairScalar(density);
+        wallSlopes[k] = PairScalar(slope);
+    }
+}
+
+// Linear interpolation of the wall profile
+template <typename Scalar, typename PairScalar>
+PairScalar FluidSolver<Scalar, PairScalar>::WallDensity(PairScalar distance, PairScalar& slope) const {
+    PairScalar position = std::max(PairScalar(0), distance) / wallSampleSpacing;
+    int index = int(position);
+    if (index >= int(wallDensities.size()) - 2) {
+        slope = 0;
+        return 0;
+    }
+
+    PairScalar t = position - PairScalar(index);
+    slope = wallSlopes[index] + t * (wallSlopes[index + 1] - wallSlopes[index]);
+    return wallDensities[index] + t * (wallDensities[index + 1] - wallDensities[index]);
+}
+
+// Sum the four walls of the tank. Each slope is along the normal pointing
+// into the tank, so the gradient points into the walls the particle is near.
+// With obstacles only the nearest boundary in the distance field counts
+template <typename Scalar, typename PairScalar>
+PairScalar FluidSolver<Scalar, PairScalar>::CalculateWallDensity(const Vec& position, PairVec& gradient) const {
+    PairScalar density = 0;
+    PairScalar slope;
+    gradient = PairVec(0, 0, 0);
+
+    if (!boundary.Empty()) {
+        glm::dvec2 normal;
+        double distance = boundary.Sample(double(position.x), double(position.y), normal);
+        density = WallDensity(PairScalar(distance), slope);
+        gradient = slope * PairVec(PairScalar(normal.x), PairScalar(normal.y), 0);
+        return density;
+    }
+
+    density += WallDensity(PairScalar(position.x + width), slope);
+    gradient.x += slope;
+    density += WallDensity(PairScalar(width - position.x), slope);
+    gradient.x -= slope;
+    density += WallDensity(PairScalar(position.y + height), slope);
+    gradient.y += slope;
+    density += WallDensity(PairScalar(height - position.y), slope);
+    gradient.y -= slope;
+
+    return density;
+}
+
+// Measure how far the densities are above the rest density
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::MeasureDensityError() {
+    PROFILE_ZONE("MeasureDensityError");
+    COUNT_STAGE("Density");
+    double total = 0;
+    double largest = 0;
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        double error = std::max(0.0, double(particles.densities[i]) - double(restDensity)) / double(restDensity);
+        total += error;
+        largest = std::max(largest, error);
+    }
+    stats.averageDensityError = particles.Size() > 0 ? total / particles.Size() : 0;
+    stats.maxDensityError = largest;
+}
+// ---------------------------------------------------------
+
+// Apply gravitational forces
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::ApplyGravitationalForces() {
+    PROFILE_ZONE("ApplyGravitationalForces");
+    COUNT_STAGE("Forces");
+    Vec down = {0.0, -1.0, 0.0};
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (!particles.awake[i]) {
+            particles.predictedPositions[i] = particles.positions[i];
+            continue;
+        }
+        Integrator::Kick(particles.velocities[i], down * gravity, deltaTime);
+        particles.predictedPositions[i] = Integrator::Predict(particles.positions[i], particles.velocities[i], deltaTime);
+    }
+}
+
+// Create hash table for particles to live in
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::CreateHashTable() {
+    PROFILE_ZONE("CreateHashTable");
+    COUNT_STAGE("Grid");
+    grid.Build(particles.predictedPositions, particles.smoothingLengths);
+}
+
+// Calculate the densities of all particles. A sleeping particle keeps the
+// density it fell asleep with and records no pairs, so it exerts no force
+// of its own, while its awake neighbors still see it
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::CalculateDensities() {
+    PROFILE_ZONE("CalculateDensities");
+    COUNT_STAGE("Density");
+    pairs.Clear(particles.Size());
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (!particles.awake[i]) {
+            pairs.EndParticle(int(i));
+            continue;
+        }
+        CalculateDensity(int(i));
+    }
+}
+
+// Apply the pressure forces
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::ApplyPressureForces() {
+    PROFILE_ZONE("ApplyPressureForces");
+    COUNT_STAGE("Forces");
+    // All accelerations are computed before any velocity changes,
+    // so the result does not depend on the particle order
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        accelerations[i] = particles.awake[i] ? Vec(CalculateForces(int(i))) : Vec(0, 0, 0);
+    }
+}
+
+// Update the positions of the particles
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::UpdatePositions() {
+    PROFILE_ZONE("UpdatePositions");
+    COUNT_STAGE("Integrate");
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (!particles.awake[i]) continue;
+        Integrator::Kick(particles.velocities[i], accelerations[i], deltaTime);
+    }
+    if (config.implicitViscosity) {
+        SolveImplicitViscosity();
+    }
+
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (!particles.awake[i]) continue;
+        Integrator::Drift(particles.positions[i], particles.velocities[i], deltaTime);
+        // Update the particle collisions after the update
+        HandleCollisions(int(i));
+        particles.positions[i].z = 0; // Ensure no z variance
+    }
+}
+
+// Handle collisions between particles and walls
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::HandleCollisions(int sampleIndex) {
+    Vec& position = particles.positions[sampleIndex];
+    Vec& velocity = particles.velocities[sampleIndex];
+
+    // One lookup, then out along the normal, reflecting the velocity into the boundary
+    if (!boundary.Empty()) {
+        glm::dvec2 normal;
+        double distance = boundary.Sample(double(position.x), double(position.y), normal);
+        if (distance < 0) {
+            Vec n = Vec(Scalar(normal.x), Scalar(normal.y), 0);
+            position -= Scalar(distance) * n;
+            Scalar speed = glm::dot(velocity, n);
+            if (speed < 0) velocity -= (1 + dampeningConstant) * speed * n;
+        }
+    } else {
+        if (std::abs(position.x) >= width) {
+            position.x = glm::sign(position.x) * width;
+            velocity.x *= -dampeningConstant;
+        }
+        if (std::abs(position.y) >= height) {
+            position.y = glm::sign(position.y) * height;
+            velocity.y *= -dampeningConstant;
+        }
+    }
+
+    CollideWithBodies(sampleIndex);
+}
+
+// Clamp into the tank, or step out of the distance field along its normal
+template <typename Scalar, typename PairScalar>
+bool FluidSolver<Scalar, PairScalar>::ProjectToBoundary(Vec& position) const {
+    if (!boundary.Empty()) {
+        glm::dvec2 normal;
+        double distance = boundary.Sample(double(position.x), double(position.y), normal);
+        if (distance >= 0) return false;
+
+        position.x -= Scalar(distance * normal.x);
+        position.y -= Scalar(distance * normal.y);
+        return true;
+    }
+
+    Vec clamped = position;
+    clamped.x = glm::clamp(clamped.x, -width, width);
+    clamped.y = glm::clamp(clamped.y, -height, height);
+    bool moved = clamped != position;
+    position = clamped;
+    return moved;
+}
+
+template <typename Scalar, typename PairScalar>
+int FluidSolver<Scalar, PairScalar>::AddParticle(const glm::dvec3& position, const glm::dvec3& velocity, double mass) {
+    accelerations.push_back(Vec(0, 0, 0));
+    return particles.Add(Vec(position), Vec(velocity), Scalar(mass), Scalar(config.smoothingDistance));
+}
+
+// Moves the last entry of a per particle array into index and drops it. Arrays
+// a feature fills lazily may lag behind the particle count and are padded first
+template <typename T>
+static void RemoveEntry(std::vector<T>& values, std::size_t index, std::size_t count, const T& fill) {
+    if (values.empty()) return;
+    values.resize(count, fill);
+    values[index] = values.back();
+    values.pop_back();
+}
+
+// Every array that carries state from one step to the next follows the store
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::RemoveParticle(std::size_t index) {
+    std::size_t count = particles.Size();
+    RemoveEntry(accelerations, index, count, Vec(0, 0, 0));
+    RemoveEntry(pressures, index, count, PairScalar(0));
+    RemoveEntry(lambdas, index, count, PairScalar(0));
+    RemoveEntry(viscousVelocities, index, count, Vec(0, 0, 0));
+    RemoveEntry(sleepVelocities, index, count, Vec(0, 0, 0));
+    RemoveEntry(timeLevels, index, count, 0);
+    RemoveEntry(stepEnds, index, count, substepClock);
+    RemoveEntry(timeLevelTargets, index, count, 0);
+    RemoveEntry(stepDue, index, count, (unsigned char)0);
+    particles.Remove(int(index));
+}
+
+template <typename Scalar, typename PairScalar>
+int FluidSolver<Scalar, PairScalar>::AddBody(const RigidBody& body) {
+    glm::dvec2 lower, upper;
+    BodyBounds(body, lower, upper);
+    bodies.push_back(body);
+    bodyLeaves.push_back(bodyTree.Insert(lower, upper, int(bodies.size()) - 1));
+    return int(bodies.size()) - 1;
+}
+
+// Advance the simulation by one step
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::Step() {
+    PROFILE_ZONE("Step");
+    COUNT_STAGE("Step");
+    stepArena.Reset();
+    // Every particle takes one step of deltaTime unless the multi rate step says otherwise
+    stats.timeLevelCounts.assign(1, int(particles.Size()));
+    stats.finestTimeLevel = 0;
+    stats.forceEvaluations = int(particles.Size());
+
+    switch (config.mode) {
+        case SolverMode::PCISPH:
+            StepPCISPH();
+            break;
+        case SolverMode::PositionBased:
+            StepPBF();
+            break;
+        case SolverMode::Explicit:
+        default:
+            if (config.adaptiveTimeSteps) {
+                StepMultiRate();
+            } else {
+                StepExplicit();
+            }
+            break;
+    }
+    stats.neighborPairs = int(pairs.Size());
+    stats.maxNeighbors = 0;
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        stats.maxNeighbors = std::max(stats.maxNeighbors, pairs.Count(int(i)));
+    }
+    StepRigidBodies();
+    UpdateSleeping();
+    AdaptResolution();
+    DrainParticles();
+    EmitParticles();
+}
+
+// Wake the cells overlapping the square around position
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::WakeRegion(const glm::dvec3& position, double radius) {
+    if (cellAsleep.empty()) return;
+
+    grid.ForEachCellInRegion(position.x - radius, position.y - radius, position.x + radius, position.y + radius, [&](int cell) {
+        cellAsleep[cell] = 0;
+        cellRestSteps[cell] = 0;
+    });
+
+    // The grid may be older than the particles, so bin them again
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        int level = grid.LevelFor(double(particles.smoothingLengths[i]));
+        int cell = grid.CalculatePosition(double(particles.positions[i].x), double(particles.positions[i].y), level);
+        if (cell < 0 || !cellAsleep[cell]) particles.awake[i] = 1;
+    }
+}
+
+// One step of the equation of state solver
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::StepExplicit() {
+    // Apply the gravitational forces
+    ApplyGravitationalForces();
+    // Bin the particles for the neighbor search
+    CreateHashTable();
+    // Calculate the densities, the only pass that searches the grid
+    CalculateDensities();
+    MeasureDensityError();
+    stats.pressureIterations = 1;
+    // Apply the pressure forces
+    ApplyPressureForces();
+    // Update positions
+    UpdatePositions();
+}
+
+// PCISPH
+// ---------------------------------------------------------
+
+// One predictive-corrective step
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::StepPCISPH() {
+    // Neighbors and densities at a first guess of where the step ends, under
+    // gravity alone, so pairs that close in during a long step are recorded
+    Vec down = {0.0, -1.0, 0.0};
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        Vec& predicted = particles.predictedPositions[i];
+        if (!particles.awake[i]) {
+            predicted = particles.positions[i];
+            continue;
+        }
+        Vec velocity = particles.velocities[i];
+        Integrator::Kick(velocity, down * gravity, deltaTime);
+        predicted = Integrator::Predict(particles.positions[i], velocity, deltaTime);
+        ProjectToBoundary(predicted);
+    }
+    CreateHashTable();
+    CalculateDensities();
+    CalculateExternalAccelerations();
+
+    // Sleeping particles keep the pressure they fell asleep with, which their
+    // awake neighbors still feel, so it counts as a change for the first pass
+    pressures.resize(particles.Size(), PairScalar(0));
+    pressureChanges.resize(particles.Size());
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (particles.awake[i]) pressures[i] = 0;
+        pressureChanges[i] = pressures[i];
+    }
+    pressureAccelerations.assign(particles.Size(), Vec(0, 0, 0));
+    pairGradients.resize(pairs.Size());
+
+    // Iterate until the predicted compression is small enough
+    int iterations = 0;
+    PairScalar densityError = 0;
+    while (iterations < config.maxPressureIterations) {
+        PredictPCISPHPositions();
+        densityError = CorrectPCISPHPressures();
+        CalculatePressureAccelerations();
+        iterations++;
+
+        if (iterations >= config.minPressureIterations && densityError < PairScalar(config.densityErrorTolerance)) {
+            break;
+        }
+    }
+    stats.pressureIterations = iterations;
+
+    // Integrate with the final pressure. The pressure solve already kept the
+    // predictions inside the tank, so a particle pressed into a wall stops
+    // there instead of bouncing, which would turn pressure into kinetic energy
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (!particles.awake[i]) continue;
+        Integrator::Kick(particles.velocities[i], accelerations[i] + pressureAccelerations[i], deltaTime);
+    }
+    if (config.implicitViscosity) {
+        SolveImplicitViscosity();
+    }
+
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (!particles.awake[i]) continue;
+        Vec& velocity = particles.velocities[i];
+        Vec predicted = Integrator::Predict(particles.positions[i], velocity, deltaTime);
+        if (ProjectToBoundary(predicted)) {
+            velocity = (predicted - particles.positions[i]) / deltaTime;
+        }
+
+        Integrator::Drift(particles.positions[i], velocity, deltaTime);
+        CollideWithBodies(int(i));
+        particles.positions[i].z = 0; // Ensure no z variance
+    }
+}
+
+// Gravity, viscosity and near pressure
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::CalculateExternalAccelerations() {
+    PROFILE_ZONE("CalculateExternalAccelerations");
+    COUNT_STAGE("Forces");
+    Vec down = {0.0, -1.0, 0.0};
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (!particles.awake[i]) {
+            accelerations[i] = Vec(0, 0, 0);
+            continue;
+        }
+        accelerations[i] = down * gravity + Vec(CalculateNearPressure(int(i)));
+        if (!config.implicitViscosity) {
+            accelerations[i] += Vec(CalculateViscosity(int(i)));
+        }
+    }
+}
+
+// Where the particles would end up with the current pressures
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::PredictPCISPHPositions() {
+    PROFILE_ZONE("PredictPCISPHPositions");
+    COUNT_STAGE("Integrate");
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (!particles.awake[i]) continue;
+        Vec velocity = particles.velocities[i];
+        Integrator::Kick(velocity, accelerations[i] + pressureAccelerations[i], deltaTime);
+        Vec predicted = Integrator::Predict(particles.positions[i], velocity, deltaTime);
+
+        // Keep predictions inside the tank, as the collision step would
+        ProjectToBoundary(predicted);
+        particles.predictedPositions[i] = predicted;
+    }
+}
+
+// Raise the pressure of every compressed particle in proportion to its density error.
+// The scale is the one that would undo the error at the predicted positions
+// if only this particle's pressure changed,
+// rho0^2 / (dt^2 (|sum m grad W|^2 + sum |m grad W|^2)), with the walls in
+// the first sum. It is worked out per particle and per iteration rather
+// than once for the lattice, so it softens where pairs closed in and the
+// spiky gradient steepened. The gradients are kept for the pressure
+// accelerations, which see the same positions. Sleeping particles keep
+// their pressure and are left out of the average
+template <typename Scalar, typename PairScalar>
+PairScalar FluidSolver<Scalar, PairScalar>::CorrectPCISPHPressures() {
+    PROFILE_ZONE("CorrectPCISPHPressures");
+    COUNT_STAGE("Forces");
+    PairScalar selfDensity = kernels.density.ValueSquared(PairScalar(0));
+    PairScalar scale = restDensity * restDensity / (PairScalar(deltaTime) * PairScalar(deltaTime));
+    const auto* firstPair = pairs.Begin(0);
+    double total = 0;
+    double largest = 0;
+    int active = 0;
+
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (!particles.awake[i]) continue;
+        active++;
+        const Vec& position = particles.predictedPositions[i];
+        PairVec gradient;
+        PairScalar density = PairScalar(particles.masses[i]) * selfDensity + CalculateWallDensity(position, gradient);
+
+        PairScalar gradientDotSum = 0;
+        for (const auto* pair = pairs.Begin(int(i)); pair != pairs.End(int(i)); pair++) {
+            PairVec offset = PairVec(position - particles.predictedPositions[pair->index]);
+            PairScalar dist2 = glm::dot(offset, offset);
+            PairScalar mass = PairScalar(particles.masses[pair->index]);
+            density += mass * kernels.density.ValueSquared(dist2);
+
+            PairVec& neighborGradient = pairGradients[pair - firstPair];
+            neighborGradient = PairVec(0, 0, 0);
+            if (dist2 == 0) continue;
+
+            PairScalar dist = std::sqrt(dist2);
+            neighborGradient = mass * kernels.pressure.Derivative(dist) * offset / dist;
+            gradient += neighborGradient;
+            gradientDotSum += glm::dot(neighborGradient, neighborGradient);
+        }
+        particles.densities[i] = Scalar(density);
+
+        // Only compression is corrected, a free surface may stay under dense
+        PairScalar error = density - restDensity;
+        PairScalar denominator = glm::dot(gradient, gradient) + gradientDotSum;
+        PairScalar pressure = pressures[i];
+        if (denominator > 0) {
+            pressure = std::max(PairScalar(0), pressure + scale * error / denominator);
+        }
+        pressureChanges[i] = pressure - pressures[i];
+        pressures[i] = pressure;
+
+        double relative = std::max(0.0, double(error) / double(restDensity));
+        total += relative;
+        largest = std::max(largest, relative);
+    }
+
+    stats.averageDensityError = active > 0 ? total / active : 0;
+    stats.maxDensityError = largest;
+    return PairScalar(stats.averageDensityError);
+}
+
+// Symmetric pressure gradient of the pressure changes, with the kernel
+// gradients at the predicted positions they were worked out at, added to
+// the accelerations of the earlier iterations. Applying the whole pressure
+// along the latest gradients instead makes the iteration diverge on long
+// steps: a pair pushed closer steepens its gradient, and the pressure
+// gathered so far then pushes it a full spacing past where it should go
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::CalculatePressureAccelerations() {
+    PROFILE_ZONE("CalculatePressureAccelerations");
+    COUNT_STAGE("Forces");
+    PairScalar invRestDensity2 = PairScalar(1) / (restDensity * restDensity);
+    const auto* firstPair = pairs.Begin(0);
+
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (!particles.awake[i]) continue;
+        PairVec acceleration = {0, 0, 0};
+
+        for (const auto* pair = pairs.Begin(int(i)); pair != pairs.End(int(i)); pair++) {
+            acceleration -= (pressureChanges[i] + pressureChanges[pair->index]) * invRestDensity2 * pairGradients[pair - firstPair];
+        }
+
+        // Walls push back with the pressure of the particle itself
+        PairVec wallGradient;
+        CalculateWallDensity(particles.predictedPositions[i], wallGradient);
+        acceleration -= 2 * pressureChanges[i] * invRestDensity2 * wallGradient;
+
+        pressureAccelerations[i] += Vec(acceleration);
+    }
+
+    // The pressures of sleeping particles stay put, so they are felt once
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        if (!particles.awake[i]) pressureChanges[i] = 0;
+    }
+}
+// ---------------------------------------------------------
+
+// POSITION BASED FLUIDS
+// ---------------------------------------------------------
+
+// One position based step. The constraints only move positions, velocities
+// are derived from how far the particles moved, so there is no stiffness
+// to make the step unstable
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::StepPBF() {
+    // Gravity and a first guess of the positions
+    ApplyGravitationalForces();
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        ProjectToBoundary(particles.predictedPositions[i]);
+    }
+    // Neighbors are found once, at the first guess
+    CreateHashTable();
+    CalculateDensities();
+
+    lambdas.resize(particles.Size(), PairScalar(0));
+    corrections.resize(particles.Size());
+    pairGradients.resize(pairs.Size());
+    for (int iteration = 0; iteration < config.constraintIterations; iteration++) {
+        CalculateLambdas();
+        ApplyPositionCorrections();
+    }
+    // Densities from the last iteration, before its correction
+    MeasureDensityError();
+    stats.pressureIterations = config.constraintIterations;
+
+    // Velocity from the distance moved, then the positions are committed
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        particles.velocities[i] = (particles.predictedPositions[i] - particles.positions[i]) / deltaTime;
+    }
+    ApplyXSPHViscosity();
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        particles.positions[i] = particles.predictedPositions[i];
+        CollideWithBodies(int(i));
+        particles.positions[i].z = 0; // Ensure no z variance
+    }
+}
+
+// lambda = -C / (sum |grad C|^2 + softness), with C = density / rest density - 1.
+// Only compression is a violation, a free surface may stay under dense.
+// Density and gradients come from one walk over the pairs, and the gradients
+// are kept for the correction pass, which sees the same positions
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::CalculateLambdas() {
+    PROFILE_ZONE("CalculateLambdas");
+    COUNT_STAGE("Forces");
+    PairScalar invRestDensity = PairScalar(1) / restDensity;
+    PairScalar selfDensity = kernels.density.ValueSquared(PairScalar(0));
+    const auto* firstPair = pairs.Begin(0);
+
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        // A sleeping particle keeps the scale it fell asleep with, so its
+        // awake neighbors are still pushed back as hard as before
+        if (!particles.awake[i]) continue;
+        const Vec& position = particles.predictedPositions[i];
+        PairVec wallGradient;
+        PairScalar density = PairScalar(particles.masses[i]) * selfDensity + CalculateWallDensity(position, wallGradient);
+
+        // Gradient with respect to the particle itself, and to each neighbor
+        PairVec gradient = wallGradient * invRestDensity;
+        PairScalar gradientDotSum = 0;
+        for (const auto* pair = pairs.Begin(int(i)); pair != pairs.End(int(i)); pair++) {
+            PairVec offset = PairVec(position - particles.predictedPositions[pair->index]);
+            PairScalar dist2 = glm::dot(offset, offset);
+            PairScalar mass = PairScalar(particles.masses[pair->index]);
+            density += mass * kernels.density.ValueSquared(dist2);
+
+            PairVec& neighborGradient = pairGradients[pair - firstPair];
+            neighborGradient = PairVec(0, 0, 0);
+            if (dist2 == 0) continue;
+
+            PairScalar dist = std::sqrt(dist2);
+            neighborGradient = mass * invRestDensity * kernels.pressure.Derivative(dist) * offset / dist;
+            gradient += neighborGradient;
+            gradientDotSum += glm::dot(neighborGradient, neighborGradient);
+        }
+
+        particles.densities[i] = Scalar(density);
+        PairScalar constraint = density * invRestDensity - 1;
+        lambdas[i] = (constraint > 0) ? -constraint / (glm::dot(gradient, gradient) + gradientDotSum + constraintSoftness) : PairScalar(0);
+    }
+}
+
+// delta p = sum (lambda_i + lambda_j) grad C / 2, all from the same lambdas
+// so the result does not depend on the particle order
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::ApplyPositionCorrections() {
+    PROFILE_ZONE("ApplyPositionCorrections");
+    COUNT_STAGE("Forces");
+    PairScalar invRestDensity = PairScalar(1) / restDensity;
+    const auto* firstPair = pairs.Begin(0);
+
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        PairVec correction = {0, 0, 0};
+        if (!particles.awake[i]) {
+            corrections[i] = Vec(0, 0, 0);
+            continue;
+        }
+        for (const auto* pair = pairs.Begin(int(i)); pair != pairs.End(int(i)); pair++) {
+            correction += (lambdas[i] + lambdas[pair->index]) * pairGradients[pair - firstPair];
+        }
+
+        // Walls only move the particle
+        if (lambdas[i] != 0) {
+            PairVec wallGradient;
+            CalculateWallDensity(particles.predictedPositions[i], wallGradient);
+            correction += invRestDensity * lambdas[i] * wallGradient;
+        }
+
+        corrections[i] = Vec(correction);
+    }
+
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        Vec& predicted = particles.predictedPositions[i];
+        predicted += corrections[i];
+        ProjectToBoundary(predicted);
+    }
+}
+
+// v_i += c sum m / rho_j (v_j - v_i) W
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::ApplyXSPHViscosity() {
+    PROFILE_ZONE("ApplyXSPHViscosity");
+    COUNT_STAGE("Forces");
+    PairScalar viscosity = PairScalar(config.xsphViscosity);
+
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        const Vec& position = particles.predictedPositions[i];
+        PairVec velocity = PairVec(particles.velocities[i]);
+        PairVec blend = {0, 0, 0};
+
+        for (const auto* pair = pairs.Begin(int(i)); pair != pairs.End(int(i)); pair++) {
+            PairScalar otherDensity = PairScalar(particles.densities[pair->index]);
+            if (otherDensity == 0) continue;
+
+            PairVec offset = PairVec(position - particles.predictedPositions[pair->index]);
+            PairScalar mass = PairScalar(particles.masses[pair->index]);
+            PairVec otherVelocity = PairVec(particles.velocities[pair->index]);
+            blend += mass / otherDensity * (otherVelocity - velocity) * kernels.density.ValueSquared(glm::dot(offset, offset));
+        }
+
+        corrections[i] = Vec(viscosity * blend);
+    }
+
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        particles.velocities[i] += corrections[i];
+    }
+}
+// ---------------------------------------------------------
+
+// IMPLICIT VISCOSITY
+// ---------------------------------------------------------
+
+// The explicit viscosity acceleration is sum_j w_ij (v_j - v_i) with
+// w_ij = mu m_j lap W / (rho_i rho_j). Scaled by m_i the weights are
+// symmetric and positive, so M + dt K is symmetric positive definite and
+// conjugate gradients apply. Pairs come from this step's density pass
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::SolveImplicitViscosity() {
+    PROFILE_ZONE("SolveImplicitViscosity");
+    COUNT_STAGE("Forces");
+    std::size_t count = particles.Size();
+    stats.viscosityIterations = 0;
+    stats.viscosityResidual = 0;
+    if (count == 0 || config.mu == 0) return;
+
+    viscosityResidual.resize(count);
+    viscosityDirection.resize(count);
+    viscosityProduct.resize(count);
+    viscosityPreconditioned.resize(count);
+    viscosityDiagonal.resize(count);
+
+    // Warm start from the last solution, new particles start from their own velocity.
+    // Sleeping particles start and stay at rest, their rows have no pairs
+    std::size_t previous = std::min(viscousVelocities.size(), count);
+    viscousVelocities.resize(count);
+    for (std::size_t i = previous; i < count; i++) {
+        viscousVelocities[i] = particles.velocities[i];
+    }
+    for (std::size_t i = 0; i < count; i++) {
+        if (!particles.awake[i]) viscousVelocities[i] = Vec(0, 0, 0);
+    }
+
+    // Diagonal of M + dt K, the Jacobi preconditioner
+    for (std::size_t i = 0; i < count; i++) {
+        PairScalar density = PairScalar(particles.densities[i]);
+        PairScalar diagonal = 0;
+        if (density != 0) {
+            for (const auto* pair = pairs.Begin(int(i)); pair != pairs.End(int(i)); pair++) {
+                PairScalar otherDensity = PairScalar(particles.densities[pair->index]);
+                if (otherDensity == 0) continue;
+                diagonal += PairScalar(particles.masses[pair->index]) * pair->viscositySlope / otherDensity;
+            }
+            diagonal *= PairScalar(deltaTime) * mu / density;
+        }
+        viscosityDiagonal[i] = particles.masses[i] * (1 + Scalar(diagonal));
+    }
+
+    // r = M v* - A x, z = r / diagonal, p = z
+    MultiplyViscosity(viscousVelocities, viscosityProduct);
+    double rhsNorm = 0;
+    double rz = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        Vec rhs = particles.masses[i] * particles.velocities[i];
+        viscosityResidual[i] = rhs - viscosityProduct[i];
+        viscosityPreconditioned[i] = viscosityResidual[i] / viscosityDiagonal[i];
+        viscosityDirection[i] = viscosityPreconditioned[i];
+        rhsNorm += glm::dot(glm::dvec3(rhs), glm::dvec3(rhs));
+        rz += glm::dot(glm::dvec3(viscosityResidual[i]), glm::dvec3(viscosityPreconditioned[i]));
+    }
+    rhsNorm = std::sqrt(rhsNorm);
+
+    double residual = 0;
+    int iteration = 0;
+    while (true) {
+        residual = 0;
+        for (std::size_t i = 0; i < count; i++) {
+            residual += glm::dot(glm::dvec3(viscosityResidual[i]), glm::dvec3(viscosityResidual[i]));
+        }
+        residual = (rhsNorm > 0) ? std::sqrt(residual) / rhsNorm : 0;
+        if (residual <= config.viscosityTolerance || iteration >= config.maxViscosityIterations) break;
+
+        MultiplyViscosity(viscosityDirection, viscosityProduct);
+        double pAp = 0;
+        for (std::size_t i = 0; i < count; i++) {
+            pAp += glm::dot(glm::dvec3(viscosityDirection[i]), glm::dvec3(viscosityProduct[i]));
+        }
+        if (pAp <= 0) break;
+
+        Scalar alpha = Scalar(rz / pAp);
+        double rzNext = 0;
+        for (std::size_t i = 0; i < count; i++) {
+            viscousVelocities[i] += alpha * viscosityDirection[i];
+            viscosityResidual[i] -= alpha * viscosityProduct[i];
+            viscosityPreconditioned[i] = viscosityResidual[i] / viscosityDiagonal[i];
+            rzNext += glm::dot(glm::dvec3(viscosityResidual[i]), glm::dvec3(viscosityPreconditioned[i]));
+        }
+
+        Scalar beta = Scalar(rzNext / rz);
+        rz = rzNext;
+        for (std::size_t i = 0; i < count; i++) {
+            viscosityDirection[i] = viscosityPreconditioned[i] + beta * viscosityDirection[i];
+        }
+        iteration++;
+    }
+
+    stats.viscosityIterations = iteration;
+    stats.viscosityResidual = residual;
+    particles.velocities = viscousVelocities;
+}
+
+// Each thread takes a contiguous run of the grid's cell order, so it reads
+// neighbors that are close in memory and writes only its own particles
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::MultiplyViscosity(const std::vector<Vec>& x, std::vector<Vec>& result) {
+    PairScalar scale = PairScalar(deltaTime) * mu;
+
+    threads.ParallelFor(int(particles.Size()), [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            int i = grid.ParticleAt(k);
+            PairScalar density = PairScalar(particles.densities[i]);
+            PairVec xi = PairVec(x[i]);
+            PairVec sum = {0, 0, 0};
+
+            if (density != 0) {
+                for (const auto* pair = pairs.Begin(i); pair != pairs.End(i); pair++) {
+                    PairScalar otherDensity = PairScalar(particles.densities[pair->index]);
+                    if (otherDensity == 0) continue;
+                    PairScalar weight = PairScalar(particles.masses[pair->index]) * pair->viscositySlope / otherDensity;
+                    sum += weight * (xi - PairVec(x[pair->index]));
+                }
+                sum *= scale / density;
+            }
+
+            result[i] = particles.masses[i] * (x[i] + Vec(sum));
+        }
+    });
+}
+// ---------------------------------------------------------
+
+// MULTIPLE TIME STEPPING
+// ---------------------------------------------------------
+
+// Block time steps. A particle on level L steps deltaTime / 2^L and is due
+// on the substeps its step ends on: it gets a new density, force and level
+// there and is kicked once for its whole next step, while every particle
+// drifts on every substep, so the due ones see their neighbors where they
+// are now. Neighbors that are not due keep the density of their last update.
+// A level only coarsens on a substep the coarser step is aligned to, and
+// neighbors are kept within one level of each other: a particle next to a
+// much finer one has its step cut short and the unspent part of its kick
+// taken back, so a splash landing on resting fluid is felt right away
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::StepMultiRate() {
+    PROFILE_ZONE("StepMultiRate");
+    std::size_t count = particles.Size();
+    int levels = config.maxTimeLevels;
+    long long substeps = 1LL << levels;
+    Scalar substep = deltaTime / Scalar(substeps);
+    Vec down = {0.0, -1.0, 0.0};
+
+    // New particles are due right away
+    timeLevels.resize(count, 0);
+    timeLevelTargets.resize(count, 0);
+    stepEnds.resize(count, substepClock);
+    stepDue.resize(count);
+    stats.forceEvaluations = 0;
+    stats.finestTimeLevel = 0;
+
+    for (long long s = 0; s < substeps; s++) {
+        long long clock = substepClock + s;
+
+        dueParticles.clear();
+        for (std::size_t i = 0; i < count; i++) {
+            stepDue[i] = particles.awake[i] && stepEnds[i] <= clock;
+            if (stepDue[i]) dueParticles.push_back(int(i));
+        }
+
+        if (!dueParticles.empty()) {
+            // Densities and forces of the due particles at the current positions
+            particles.predictedPositions = particles.positions;
+            CreateHashTable();
+            pairs.Clear(count);
+            for (std::size_t i = 0; i < count; i++) {
+                if (stepDue[i]) {
+                    CalculateDensity(int(i));
+                } else {
+                    pairs.EndParticle(int(i));
+                }
+            }
+            for (int i : dueParticles) {
+                accelerations[i] = down * gravity + Vec(CalculateForces(i));
+                timeLevelTargets[i] = CalculateTimeLevel(i);
+            }
+
+            // Stay within one level of every neighbor, and only coarsen on an aligned substep
+            for (int i : dueParticles) {
+                int level = timeLevelTargets[i];
+                for (const auto* pair = pairs.Begin(i); pair != pairs.End(i); pair++) {
+                    int other = stepDue[pair->index] ? timeLevelTargets[pair->index] : timeLevels[pair->index];
+                    level = std::max(level, other - 1);
+                }
+                while (level < levels && clock % (substeps >> level) != 0) level++;
+                timeLevels[i] = level;
+            }
+
+            for (int i : dueParticles) {
+                long long length = substeps >> timeLevels[i];
+                Integrator::Kick(particles.velocities[i], accelerations[i], substep * Scalar(length));
+                stepEnds[i] = clock + length;
+                stats.finestTimeLevel = std::max(stats.finestTimeLevel, timeLevels[i]);
+            }
+
+            // Cut short the steps of neighbors more than one level coarser
+            for (int i : dueParticles) {
+                for (const auto* pair = pairs.Begin(i); pair != pairs.End(i); pair++) {
+                    int j = pair->index;
+                    if (stepDue[j] || !particles.awake[j] || timeLevels[j] >= timeLevels[i] - 1) continue;
+                    particles.velocities[j] -= accelerations[j] * substep * Scalar(stepEnds[j] - (clock + 1));
+                    stepEnds[j] = clock + 1;
+                    timeLevels[j] = timeLevels[i] - 1;
+                }
+            }
+            stats.forceEvaluations += int(dueParticles.size());
+        }
+
+        for (std::size_t i = 0; i < count; i++) {
+            if (!particles.awake[i]) continue;
+            Integrator::Drift(particles.positions[i], particles.velocities[i], substep);
+            HandleCollisions(int(i));
+            particles.positions[i].z = 0; // Ensure no z variance
+        }
+    }
+    substepClock += substeps;
+
+    MeasureDensityError();
+    stats.pressureIterations = 1;
+    stats.timeLevelCounts.assign(levels + 1, 0);
+    for (std::size_t i = 0; i < count; i++) {
+        if (particles.awake[i]) stats.timeLevelCounts[timeLevels[i]]++;
+    }
+}
+
+// The largest power of two division of deltaTime that keeps a pressure wave
+// or the particle itself from crossing more than a fraction of the smoothing
+// distance, and keeps its acceleration from doing the same. The equation of
+// state sets the sound speed, sqrt(dp / drho), so resting fluid has a floor
+// on its level and the bulk only gains from a coarse deltaTime where it is
+// calm enough
+template <typename Scalar, typename PairScalar>
+int FluidSolver<Scalar, PairScalar>::CalculateTimeLevel(int index) const {
+    Scalar smoothing = Scalar(config.smoothingDistance);
+    Scalar courant = Scalar(config.courantNumber);
+    Scalar soundSpeed = Scalar(std::sqrt(config.stiffness + config.nearStiffness));
+    Scalar speed = glm::length(particles.velocities[index]);
+    Scalar acceleration = glm::length(accelerations[index]);
+
+    Scalar step = std::min(deltaTime, courant * smoothing / (soundSpeed + speed));
+    if (acceleration > 0) step = std::min(step, courant * std::sqrt(smoothing / acceleration));
+
+    int level = 0;
+    while (level < config.maxTimeLevels && deltaTime / Scalar(1LL << level) > step) level++;
+    return level;
+}
+// ---------------------------------------------------------
+
+// SLEEPING
+// ---------------------------------------------------------
+
+// A cell sleeps once all its particles rested for sleepSteps steps and no
+// neighboring cell moved. It wakes when a neighboring cell moves, when its
+// particle count changes because something moved in or out, or through
+// WakeRegion. Only speed wakes a cell: the change of speed is noisy at rest,
+// in particular next to a cell that just fell asleep, so it only holds a
+// cell awake. Cells are those of this step's grid, which the sleeping
+// particles never leave
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::UpdateSleeping() {
+    PROFILE_ZONE("UpdateSleeping");
+    std::size_t count = particles.Size();
+    int cells = grid.CellCount();
+
+    if (!config.sleeping) {
+        grid.ClearCreatedCells();
+        int occupied = 0;
+        for (int cell = 0; cell < cells; cell++) {
+            occupied += grid.CountInCell(cell) > 0;
+        }
+        stats.activeParticles = int(count);
+        stats.activeCells = occupied;
+        return;
+    }
+
+    cellRestSteps.resize(cells, 0);
+    cellAsleep.resize(cells, 0);
+    cellSleepCounts.resize(cells, 0);
+    // A sparse cell index may have belonged to a cell that emptied since
+    for (int cell : grid.CreatedCells()) {
+        cellRestSteps[cell] = 0;
+        cellAsleep[cell] = 0;
+        cellSleepCounts[cell] = 0;
+    }
+    grid.ClearCreatedCells();
+    cellMoving.assign(cells, 0);
+    cellRestless.assign(cells, 0);
+
+    // A cell moved if any of its awake particles is above the speed threshold,
+    // and is restless if one changed speed faster than the acceleration threshold.
+    // New particles have no previous velocity and count as moving
+    Scalar restSpeed2 = Scalar(config.sleepVelocity * config.sleepVelocity);
+    Scalar restChange = Scalar(config.sleepAcceleration) * deltaTime;
+    std::size_t previous = std::min(sleepVelocities.size(), count);
+    sleepVelocities.resize(count, Vec(0, 0, 0));
+    for (std::size_t i = 0; i < count; i++) {
+        if (!particles.awake[i]) continue;
+        const Vec& velocity = particles.velocities[i];
+        Vec change = velocity - sleepVelocities[i];
+        if (i >= previous || glm::dot(velocity, velocity) > restSpeed2) {
+            cellMoving[grid.CellOf(int(i))] = 1;
+        }
+        if (glm::dot(change, change) > restChange * restChange) {
+            cellRestless[grid.CellOf(int(i))] = 1;
+        }
+        sleepVelocities[i] = velocity;
+    }
+
+    // A moving body stirs every cell it overlaps
+    for (const RigidBody& body : bodies) {
+        glm::dvec2 lower, upper;
+        BodyBounds(body, lower, upper);
+        double speed = glm::length(body.velocity) + std::abs(body.angularVelocity) * glm::length(upper - lower) / 2;
+        if (speed * speed <= double(restSpeed2)) continue;
+        grid.ForEachCellInRegion(lower.x, lower.y, upper.x, upper.y, [&](int cell) { cellMoving[cell] = 1; });
+    }
+
+    for (int cell = 0; cell < cells; cell++) {
+        bool nearMotion = false;
+        grid.ForEachNeighborCell(cell, [&](int other) { nearMotion = nearMotion || cellMoving[other]; });
+
+        if (cellAsleep[cell]) {
+            if (nearMotion || grid.CountInCell(cell) != cellSleepCounts[cell]) {
+                cellAsleep[cell] = 0;
+                cellRestSteps[cell] = 0;
+            }
+            continue;
+        }
+
+        cellRestSteps[cell] = (cellMoving[cell] || cellRestless[cell]) ? 0 : cellRestSteps[cell] + 1;
+        if (cellRestSteps[cell] >= config.sleepSteps && !nearMotion && grid.CountInCell(cell) > 0) {
+            cellAsleep[cell] = 1;
+            cellSleepCounts[cell] = grid.CountInCell(cell);
+        }
+    }
+
+    // Flag the particles, a particle falling asleep stops where it is
+    int activeParticles = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        bool awake = !cellAsleep[grid.CellOf(int(i))];
+        if (!awake && particles.awake[i]) {
+            particles.velocities[i] = Vec(0, 0, 0);
+            sleepVelocities[i] = Vec(0, 0, 0);
+        }
+        particles.awake[i] = awake;
+        activeParticles += awake;
+    }
+
+    int activeCells = 0;
+    for (int cell = 0; cell < cells; cell++) {
+        activeCells += !cellAsleep[cell] && grid.CountInCell(cell) > 0;
+    }
+    stats.activeParticles = activeParticles;
+    stats.activeCells = activeCells;
+}
+// ---------------------------------------------------------
+
+// RIGID BODIES
+// ---------------------------------------------------------
+
+// The particle leaves along the body normal and, if it was moving into the
+// body, takes the impulse that sends it out with the wall restitution, the
+// body the opposite one. Both ends of the contact are in the impulse, so a
+// light body gives way and a heavy one barely notices a single particle
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::CollideWithBodies(int index) {
+    if (bodies.empty()) return;
+
+    Vec& position = particles.positions[index];
+    Vec& velocity = particles.velocities[index];
+    glm::dvec2 point = {double(position.x), double(position.y)};
+    glm::dvec2 particleVelocity = {double(velocity.x), double(velocity.y)};
+    double particleMass = double(particles.masses[index]);
+    bool touched = false;
+
+    bodyTree.Query(point, point, [&](int b) {
+        RigidBody& body = bodies[b];
+        glm::dvec2 normal;
+        double distance = BodyDistance(body, point, normal);
+        if (distance >= 0) return;
+
+        point -= distance * normal;
+        touched = true;
+
+        // Velocity of the body's surface at the contact
+        glm::dvec2 r = point - body.position;
+        glm::dvec2 surfaceVelocity = body.velocity + body.angularVelocity * glm::dvec2(-r.y, r.x);
+        double approach = glm::dot(particleVelocity - surfaceVelocity, normal);
+        if (approach >= 0) return;
+
+        double arm = r.x * normal.y - r.y * normal.x;
+        double inverseMass = 1 / particleMass;
+        if (body.mass > 0) inverseMass += 1 / body.mass + arm * arm / body.inertia;
+        double impulse = -(1 + double(dampeningConstant)) * approach / inverseMass;
+
+        particleVelocity += impulse / particleMass * normal;
+        if (body.mass > 0) {
+            body.impulse -= impulse * normal;
+            body.angularImpulse -= impulse * arm;
+        }
+    });
+
+    if (!touched) return;
+    position.x = Scalar(point.x);
+    position.y = Scalar(point.y);
+    velocity.x = Scalar(particleVelocity.x);
+    velocity.y = Scalar(particleVelocity.y);
+}
+
+// Bodies take one step of deltaTime whatever the solver mode, with the
+// impulses every particle contact of the step added up. The tank walls
+// stop them with the same restitution as particles, obstacles do not
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::StepRigidBodies() {
+    PROFILE_ZONE("StepRigidBodies");
+    double dt = config.deltaTime;
+    double restitution = config.dampeningConstant;
+
+    for (std::size_t b = 0; b < bodies.size(); b++) {
+        RigidBody& body = bodies[b];
+        if (body.mass > 0) {
+            body.velocity += body.impulse / body.mass;
+            body.velocity.y -= config.gravity * dt;
+            body.angularVelocity += body.angularImpulse / body.inertia;
+        }
+        body.impulse = {0, 0};
+        body.angularImpulse = 0;
+
+        body.position += body.velocity * dt;
+        body.angle += body.angularVelocity * dt;
+
+        glm::dvec2 lower, upper;
+        BodyBounds(body, lower, upper);
+        if (body.mass > 0) {
+            glm::dvec2 push = glm::max(glm::dvec2(-config.width, -config.height) - lower, glm::dvec2(0, 0))
+                            + glm::min(glm::dvec2(config.width, config.height) - upper, glm::dvec2(0, 0));
+            for (int axis = 0; axis < 2; axis++) {
+                if (push[axis] == 0) continue;
+                if (push[axis] * body.velocity[axis] < 0) body.velocity[axis] *= -restitution;
+                body.angularVelocity *= restitution;
+            }
+            body.position += push;
+            lower += push;
+            upper += push;
+        }
+        bodyTree.Update(bodyLeaves[b], lower, upper);
+    }
+}
+// ---------------------------------------------------------
+
+// EMITTERS AND SINKS
+// ---------------------------------------------------------
+
+// Rows are laid down one particle spacing apart along the flow, so the
+// inflow enters at the rest spacing whatever its speed. A row that was due
+// partway through the step starts the distance it has moved since downstream
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::EmitParticles() {
+    PROFILE_ZONE("EmitParticles");
+    stats.emittedParticles = 0;
+    // The first row comes out on the first step
+    emitterDistances.resize(config.emitters.size(), config.particleSpacing);
+
+    for (std::size_t e = 0; e < config.emitters.size(); e++) {
+        const ParticleEmitter& emitter = config.emitters[e];
+        double speed = glm::length(emitter.velocity);
+        if (speed == 0) continue;
+
+        glm::dvec2 along = emitter.velocity / speed;
+        glm::dvec2 across = {-along.y, along.x};
+        int columns = std::max(1, int(std::round(emitter.width / config.particleSpacing)));
+
+        emitterDistances[e] += speed * config.deltaTime;
+        while (emitterDistances[e] >= config.particleSpacing) {
+            emitterDistances[e] -= config.particleSpacing;
+            glm::dvec2 start = emitter.position + emitterDistances[e] * along;
+            for (int k = 0; k < columns; k++) {
+                if (config.maxParticles > 0 && int(particles.Size()) >= config.maxParticles) break;
+                glm::dvec2 position = start + (k - (columns - 1) / 2.0) * config.particleSpacing * across;
+                AddParticle(glm::dvec3(position, 0), glm::dvec3(emitter.velocity, 0), config.particleMass);
+                stats.emittedParticles++;
+            }
+        }
+    }
+}
+
+// Only the grid cells under a sink are searched, so draining costs the
+// particles near the sinks rather than all of them. The grid binned the
+// predicted positions, a smoothing distance of slack covers the rest of the
+// step. Splits and merges this step moved particles to other indices and
+// added some the grid never saw, so then it bins them again first
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::DrainParticles() {
+    stats.removedParticles = 0;
+    if (config.sinks.empty()) return;
+    PROFILE_ZONE("DrainParticles");
+    if (stats.splitParticles > 0 || stats.mergedParticles > 0) {
+        CreateHashTable();
+    }
+
+    drained.clear();
+    for (const BoundaryShape& sink : config.sinks) {
+        glm::dvec2 lower = glm::dvec2(INFINITY, INFINITY);
+        glm::dvec2 upper = -lower;
+        for (glm::dvec2 point : ShapeOutline(sink, &stepArena)) {
+            lower = glm::min(lower, point);
+            upper = glm::max(upper, point);
+        }
+        double slack = config.smoothingDistance + sink.thickness / 2;
+
+        grid.ForEachInRegion(lower.x - slack, lower.y - slack, upper.x + slack, upper.y + slack, [&](int i) {
+            glm::dvec2 position = {double(particles.positions[i].x), double(particles.positions[i].y)};
+            if (ShapeDistance(sink, position) < 0) drained.push_back(i);
+        });
+    }
+
+    // Highest index first, so the last particle filling a freed slot is never one still to remove
+    std::sort(drained.begin(), drained.end(), std::greater<int>());
+    drained.erase(std::unique(drained.begin(), drained.end()), drained.end());
+    for (int i : drained) {
+        RemoveParticle(std::size_t(i));
+    }
+    stats.removedParticles = int(drained.size());
+}
+// ---------------------------------------------------------
+
+// ADAPTIVE RESOLUTION
+// ---------------------------------------------------------
+
+// Merging two particles of level k gives one of level k + 1 with the sum of
+// their masses, so a level k particle covers 2^k times the base area and its
+// support grows by sqrt(2) per level to keep the same number of neighbors
+template <typename Scalar, typename PairScalar>
+Scalar FluidSolver<Scalar, PairScalar>::LevelSmoothing(int level) const {
+    return Scalar(config.smoothingDistance * std::pow(2.0, level / 2.0));
+}
+
+// Runs on the pairs of the step that just ended, every refinementInterval
+// steps. Particles on the free surface, their neighbors and particles in
+// shear are kept fine: a merged particle there splits in two, side by side
+// along an axis that alternates with the level. Half way to the surface
+// particles are left as they are, so the band does not flicker between
+// splitting and merging the same particles. Elsewhere a particle merges
+// with its nearest neighbor of the same level when both are calm, at their
+// center of mass and with their momentum, which conserves both exactly; the
+// kinetic energy of their relative motion is lost. Sleeping particles are
+// left alone
+template <typename Scalar, typename PairScalar>
+void FluidSolver<Scalar, PairScalar>::AdaptResolution() {
+    stats.splitParticles = 0;
+    stats.mergedParticles = 0;
+    if (!config.adaptiveResolution) return;
+    PROFILE_ZONE("AdaptResolution");
+    if (--refinementCountdown > 0) return;
+    refinementCountdown = config.refinementInterval;
+
+    int count = int(particles.Size());
+    surfaceBand.assign(count, 0);
+    shearRates.assign(count, Scalar(0));
+    refined.assign(count, 0);
+
+    // The density gradient points into the fluid and vanishes inside it, the
+    // walls fill in for missing neighbors. Relative to the density and over
+    // one support it is of order one on the free surface
+    PairScalar threshold = PairScalar(config.surfaceThreshold);
+    for (int i = 0; i < count; i++) {
+        if (!particles.awake[i]) continue;
+        PairVec gradient;
+        CalculateWallDensity(particles.positions[i], gradient);
+        for (const auto* pair = pairs.Begin(i); pair != pairs.End(i); pair++) {
+            gradient += PairScalar(particles.masses[pair->index]) * pair->slope * pair->dir;
+        }
+        PairScalar measure = glm::length(gradient) * PairScalar(particles.smoothingLengths[i]);
+        PairScalar density = PairScalar(particles.densities[i]);
+        // Half way to the surface a particle and its neighbors stay as they are
+        unsigned char band = (measure >= threshold * density) ? 2 : (2 * measure >= threshold * density) ? 1 : 0;
+        if (band == 0) continue;
+
+        surfaceBand[i] = std::max(surfaceBand[i], band);
+        for (const auto* pair = pairs.Begin(i); pair != pairs.End(i); pair++) {
+            surfaceBand[pair->index] = std::max(surfaceBand[pair->index], band);
+        }
+    }
+
+    // Shear rate from the SPH velocity gradient, the part of it that is
+    // neither rotation nor compression
+    for (int i = 0; i < count; i++) {
+        if (!particles.awake[i]) continue;
+        PairVec velocity = PairVec(particles.velocities[i]);
+        PairScalar dudx = 0, dudy = 0, dvdx = 0, dvdy = 0;
+        for (const auto* pair = pairs.Begin(i); pair != pairs.End(i); pair++) {
+            PairScalar otherDensity = PairScalar(particles.densities[pair->index]);
+            if (otherDensity == 0) continue;
+
+            PairScalar volume = PairScalar(particles.masses[pair->index]) / otherDensity;
+            PairVec change = volume * (PairVec(particles.velocities[pair->index]) - velocity);
+            PairVec gradient = pair->slope * pair->dir;
+            dudx += change.x * gradient.x;
+            dudy += change.x * gradient.y;
+            dvdx += change.y * gradient.x;
+            dvdy += change.y * gradient.y;
+        }
+        shearRates[i] = Scalar(std::sqrt((dudx - dvdy) * (dudx - dvdy) + (dudy + dvdx) * (dudy + dvdx)));
+    }
+
+    Scalar splitRate = Scalar(config.splitShearRate);
+    Scalar mergeRate = splitRate / 2;
+    mergedAway.clear();
+    for (int i = 0; i < count; i++) {
+        if (!particles.awake[i] || refined[i]) continue;
+        int level = particles.levels[i];
+
+        if (surfaceBand[i] == 2 || shearRates[i] > splitRate) {
+            if (level == 0) continue;
+            if (config.maxParticles > 0 && int(particles.Size()) >= config.maxParticles) continue;
+
+            // The children sit one child spacing apart
+            Scalar half = Scalar(config.particleSpacing * std::pow(2.0, (level - 1) / 2.0) / 2);
+            Vec offset = (level % 2) ? Vec(half, 0, 0) : Vec(0, half, 0);
+            Vec position = particles.positions[i];
+            Vec first = position - offset;
+            Vec second = position + offset;
+            ProjectToBoundary(first);
+            ProjectToBoundary(second);
+
+            Vec velocity = particles.velocities[i];
+            Scalar mass = particles.masses[i] / 2;
+            particles.positions[i] = first;
+            particles.predictedPositions[i] = first;
+            particles.masses[i] = mass;
+            particles.smoothingLengths[i] = LevelSmoothing(level - 1);
+            particles.levels[i] = (unsigned char)(level - 1);
+            accelerations.push_back(Vec(0, 0, 0));
+            int child = particles.Add(second, velocity, mass, LevelSmoothing(level - 1), level - 1);
+            particles.densities[child] = particles.densities[i];
+            particles.nearDensities[child] = particles.nearDensities[i];
+            refined[i] = 1;
+            stats.splitParticles++;
+            continue;
+        }
+
+        if (level >= config.maxMergeLevels || surfaceBand[i] || shearRates[i] >= mergeRate) continue;
+
+        // Nearest calm neighbor of the same level nothing else claimed yet
+        int partner = -1;
+        PairScalar nearest = 0;
+        for (const auto* pair = pairs.Begin(i); pair != pairs.End(i); pair++) {
+            int j = pair->index;
+            if (refined[j] || surfaceBand[j] || !particles.awake[j] || particles.levels[j] != level) continue;
+            if (shearRates[j] >= mergeRate) continue;
+            if (partner < 0 || pair->dist < nearest) {
+                partner = j;
+                nearest = pair->dist;
+            }
+        }
+        if (partner < 0) continue;
+
+        Scalar massI = particles.masses[i];
+        Scalar massJ = particles.masses[partner];
+        Scalar mass = massI + massJ;
+        Vec position = (massI * particles.positions[i] + massJ * particles.positions[partner]) / mass;
+        particles.positions[i] = position;
+        particles.predictedPositions[i] = position;
+        particles.velocities[i] = (massI * particles.velocities[i] + massJ * particles.velocities[partner]) / mass;
+        particles.masses[i] = mass;
+        particles.smoothingLengths[i] = LevelSmoothing(level + 1);
+        particles.levels[i] = (unsigned char)(level + 1);
+        refined[i] = 1;
+        refined[partner] = 1;
+        mergedAway.push_back(partner);
+        stats.mergedParticles++;
+    }
+
+    // Highest index first, like the sinks
+    std::sort(mergedAway.begin(), mergedAway.end(), std::greater<int>());
+    for (int i : mergedAway) {
+        RemoveParticle(std::size_t(i));
+    }
+}
+// ---------------------------------------------------------
+
+template <typename Scalar, typename PairScalar>
+std::size_t FluidSolver<Scalar, PairScalar>::ParticleCount() const {
+    return particles.Size();
+}
+
+template <typename Scalar, typename PairScalar>
+std::size_t FluidSolver<Scalar, PairScalar>::BodyCount() const {
+    return bodies.size();
+}
+
+template <typename Scalar, typename PairScalar>
+RigidBody& FluidSolver<Scalar, PairScalar>::Body(std::size_t index) {
+    return bodies[index];
+}
+
+template <typename Scalar, typename PairScalar>
+glm::vec3 FluidSolver<Scalar, PairScalar>::Position(std::size_t index) const {
+    return glm::vec3(particles.positions[index]);
+}
+
+template <typename Scalar, typename PairScalar>
+glm::vec3 FluidSolver<Scalar, PairScalar>::Velocity(std::size_t index) const {
+    return glm::vec3(particles.velocities[index]);
+}
+
+template <typename Scalar, typename PairScalar>
+float FluidSolver<Scalar, PairScalar>::Density(std::size_t index) const {
+    return float(particles.densities[index]);
+}
+
+template <typename Scalar, typename PairScalar>
+int FluidSolver<Scalar, PairScalar>::ParticleId(std::size_t index) const {
+    return particles.ids[index];
+}
+
+template <typename Scalar, typename PairScalar>
+SolverDiagnostics FluidSolver<Scalar, PairScalar>::Diagnostics() const {
+    SolverDiagnostics diagnostics;
+    for (std::size_t i = 0; i < particles.Size(); i++) {
+        double mass = double(particles.masses[i]);
+        glm::dvec3 velocity = glm::dvec3(particles.velocities[i]);
+        double y = double(particles.positions[i].y) + config.height;
+
+        diagnostics.kineticEnergy += 0.5 * mass * glm::dot(velocity, velocity);
+        diagnostics.potentialEnergy += mass * config.gravity * y;
+        diagnostics.momentum += mass * velocity;
+    }
+    return diagnostics;
+}
+
+template <typename Scalar, typename PairScalar>
+const SolverConfig& FluidSolver<Scalar, PairScalar>::Config() const {
+    return config;
+}
+
+template <typename Scalar, typename PairScalar>
+const StepStats& FluidSolver<Scalar, PairScalar>::Stats() const {
+    return stats;
+}
+
+template <typename Scalar, typename PairScalar>
+KernelErrors FluidSolver<Scalar, PairScalar>::KernelTableErrors() const {
+    KernelErrors errors;
+#ifdef SPH_TABULATED_KERNELS
+    errors.tabulated = true;
+    errors.maxDensityError = double(kernels.density.MaxValueError());
+    errors.maxPressureGradientError = double(kernels.pressure.MaxDerivativeError());
+#endif
+    return errors;
+}
+
+// The supported instantiations
+template class FluidSolver<float, float>;
+template class FluidSolver<double, double>;
+template class FluidSolver<double, float>;
+
+// Pick the instantiation for the requested precision
+std::unique_ptr<IFluidSolver> CreateFluidSolver(const SolverConfig& config) {
+    switch (config.precision) {
+        case Precision::Double:
+            return std::make_unique<FluidSolver<double, double>>(config);
+        case Precision::Mixed:
+            return std::make_unique<FluidSolver<double, float>>(config);
+        case Precision::Single:
+        default:
+            return std::make_unique<FluidSolver<float, float>>(config);
+    }
+}
+
+// Create the grid of particles
+void SpawnParticleGrid(IFluidSolver& solver, glm::dvec3 lower, glm::dvec3 upper, int steps, double mass) {
+    std::vector<double> xValues = linspace(lower.x, upper.x, steps);
+    std::vector<double> yValues = linspace(lower.y, upper.y, steps);
+
+    for (int i = 0; i < yValues.size(); i++) {
+        for (int j = 0; j < xValues.size(); j++) {
+            glm::dvec3 position = {xValues[j], yValues[i], 0};
+            glm::dvec3 velocity = {0, 0, 0};
+            solver.AddParticle(position, velocity, mass);
+        }
+    }
+}
+
+bool ParsePrecision(const std::string& name, Precision& precision) {
+    if (name == "float") {
+        precision = Precision::Single;
+    } else if (name == "double") {
+        precision = Precision::Double;
+    } else if (name == "mixed") {
+        precision = Precision::Mixed;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* PrecisionName(Precision precision) {
+    switch (precision) {
+        case Precision::Double: return "double";
+        case Precision::Mixed: return "mixed";
+        case Precision::Single:
+        default: return "float";
+    }
+}
+
+bool ParseSolverMode(const std::string& name, SolverMode& mode) {
+    if (name == "explicit") {
+        mode = SolverMode::Explicit;
+    } else if (name == "pcisph") {
+        mode = SolverMode::PCISPH;
+    } else if (name == "pbf") {
+        mode = SolverMode::PositionBased;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* SolverModeName(SolverMode mode) {
+    switch (mode) {
+        case SolverMode::PCISPH: return "pcisph";
+        case SolverMode::PositionBased: return "pbf";
+        case SolverMode::Explicit:
+        default: return "explicit";
+    }
+}
@@ -0,0 +1,65 @@
+#include "FrameArena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+// Constructor
+FrameArena::FrameArena(std::size_t u_initialBytes) : initialBytes(std::max<std::size_t>(u_initialBytes, 64)) { }
+
+// Destructor
+FrameArena::~FrameArena() {
+    Release();
+}
+
+void* FrameArena::do_allocate(std::size_t bytes, std::size_t alignment) {
+    while (true) {
+        if (current < blocks.size()) {
+            std::uintptr_t base = reinterpret_cast<std::uintptr_t>(blocks[current].memory);
+            std::size_t start = ((base + offset + alignment - 1) & ~std::uintptr_t(alignment - 1)) - base;
+            if (start + bytes <= blocks[current].size) {
+                offset = start + bytes;
+                highWater = std::max(highWater, Used());
+                return blocks[current].memory + start;
+            }
+            // What is left of the block counts as used until the Reset
+            usedBefore += blocks[current].size;
+            current++;
+            offset = 0;
+            if (current < blocks.size()) continue;
+        }
+        AddBlock(bytes + alignment);
+    }
+}
+
+void FrameArena::AddBlock(std::size_t minimum) {
+    std::size_t size = blocks.empty() ? initialBytes : 2 * blocks.back().size;
+    size = std::max(size, minimum);
+    blocks.push_back({static_cast<char*>(::operator new(size)), size});
+    capacity += size;
+}
+
+void FrameArena::Release() {
+    for (const Block& block : blocks) {
+        ::operator delete(block.memory);
+    }
+    blocks.clear();
+    capacity = 0;
+}
+
+// A frame that spilled into a second block gets one block as large as all
+// of them, so the next frame of the same size fits in it
+void FrameArena::Reset() {
+    if (current > 0) {
+        std::size_t total = capacity;
+        Release();
+        AddBlock(total);
+    }
+    current = 0;
+    offset = 0;
+    usedBefore = 0;
+}
+
+std::size_t FrameArena::Used() const {
+    return usedBefore + offset;
+}
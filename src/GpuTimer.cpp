@@ -0,0 +1,93 @@
+#include "GpuTimer.hpp"
+#include "Profiler.hpp"
+
+// Frames between two calibrations of the GPU clock, it drifts slowly
+static const std::uint64_t calibrationInterval = 256;
+
+// Destructor
+GpuTimer::~GpuTimer() {
+    if (!queries.empty()) {
+        glDeleteQueries(GLsizei(queries.size()), queries.data());
+    }
+}
+
+void GpuTimer::Init() {
+    queries.resize(2 * zonesPerFrame * framesInFlight);
+    glGenQueries(GLsizei(queries.size()), queries.data());
+    Calibrate();
+}
+
+// Reading GL_TIMESTAMP waits for the commands before it to be submitted,
+// not to finish, so this costs a round trip to the driver and no stall
+void GpuTimer::Calibrate() {
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    clockOffset = Profiler::Now() - std::int64_t(gpuNow);
+}
+
+void GpuTimer::BeginFrame() {
+    if (queries.empty()) return;
+
+    // A zone left open would never get its end written
+    while (!open.empty()) {
+        End();
+    }
+    frame++;
+    if (frame % calibrationInterval == 0) Calibrate();
+
+    // The slot this frame reuses was filled framesInFlight frames ago
+    int slot = int(frame % framesInFlight);
+    std::vector<Zone>& done = zones[slot];
+    if (done.empty()) return;
+
+    GLuint* first = &queries[2 * zonesPerFrame * slot];
+    for (std::size_t q = 0; q < 2 * done.size(); q++) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(first[q], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            droppedFrames++;
+            done.clear();
+            return;
+        }
+    }
+
+    double total = 0;
+    for (std::size_t z = 0; z < done.size(); z++) {
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(first[2 * z], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(first[2 * z + 1], GL_QUERY_RESULT, &end);
+        if (done[z].depth == 0) total += double(end - start) / 1e6;
+        if (Profiler::enabled) {
+            Profiler::RecordTrack("GPU", done[z].name, std::int64_t(start) + clockOffset, std::int64_t(end) + clockOffset);
+        }
+    }
+    frameMilliseconds = total;
+    done.clear();
+}
+
+void GpuTimer::Begin(const char* name) {
+    if (queries.empty()) return;
+
+    int slot = int(frame % framesInFlight);
+    std::vector<Zone>& current = zones[slot];
+    if (int(current.size()) == zonesPerFrame) {
+        open.push_back(-1);
+        return;
+    }
+
+    glQueryCounter(queries[2 * (zonesPerFrame * slot + current.size())], GL_TIMESTAMP);
+    open.push_back(int(current.size()));
+    current.push_back({name, int(open.size()) - 1});
+}
+
+void GpuTimer::End() {
+    if (open.empty()) return;
+
+    int zone = open.back();
+    open.pop_back();
+    if (zone < 0) return;
+
+    int slot = int(frame % framesInFlight);
+    glQueryCounter(queries[2 * (zonesPerFrame * slot + zone) + 1], GL_TIMESTAMP);
+}
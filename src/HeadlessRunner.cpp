@@ -0,0 +1,98 @@
+#include "HeadlessRunner.hpp"
+#include "Profiler.hpp"
+
+#include <chrono>
+#include <iostream>
+
+// Constructor
+HeadlessRunner::HeadlessRunner(const SolverConfig& config) : solver(CreateFluidSolver(config)) { }
+
+void HeadlessRunner::AddHook(int stride, Hook hook) {
+    if (stride < 1) {
+        std::cerr << "Hook stride " << stride << " is less than one step, using one" << std::endl;
+        stride = 1;
+    }
+    hooks.push_back({stride, std::move(hook)});
+}
+
+// Every hook sees the state before the first step and after the last,
+// whatever its stride, and never the same step twice
+void HeadlessRunner::CallHooks(const RunProgress& progress) {
+    PROFILE_ZONE("Hooks");
+    for (HookEntry& entry : hooks) {
+        if ((progress.step % entry.stride == 0 || progress.last) && entry.calledAt != progress.step) {
+            entry.calledAt = progress.step;
+            entry.hook(*solver, progress);
+        }
+    }
+}
+
+long long HeadlessRunner::Run(long long steps, double duration) {
+    double deltaTime = solver->Config().deltaTime;
+    // Half a step of slack, so rounding in the time does not add a step
+    auto finished = [&](const RunProgress& progress) {
+        return stopping || (steps > 0 && progress.step >= steps) || (duration > 0 && progress.time + deltaTime / 2 > duration);
+    };
+    auto begin = std::chrono::steady_clock::now();
+    stopping = false;
+    for (HookEntry& entry : hooks) {
+        entry.calledAt = -1;
+    }
+
+    RunProgress progress;
+    CallHooks(progress);
+    while (!finished(progress)) {
+        solver->Step();
+        progress.step++;
+        progress.time = progress.step * deltaTime;
+        progress.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        progress.last = finished(progress);
+        CallHooks(progress);
+    }
+
+    // A hook that stopped the run made the step it saw the last one
+    if (!progress.last && progress.step > 0) {
+        progress.last = true;
+        CallHooks(progress);
+    }
+    return progress.step;
+}
+
+// HOOKS
+// ----
+
+HeadlessRunner::Hook ProgressHook(std::ostream& out) {
+    long long lastStep = 0;
+    double lastSeconds = 0;
+    return [&out, lastStep, lastSeconds](const IFluidSolver& solver, const RunProgress& progress) mutable {
+        SolverDiagnostics diagnostics = solver.Diagnostics();
+        double seconds = progress.wallSeconds - lastSeconds;
+        out << "step " << progress.step << "  time " << progress.time << "s  particles " << solver.ParticleCount()
+            << "  energy " << diagnostics.kineticEnergy + diagnostics.potentialEnergy;
+        if (seconds > 0) {
+            out << "  " << (progress.step - lastStep) / seconds << " steps/s";
+        }
+        out << std::endl;
+        lastStep = progress.step;
+        lastSeconds = progress.wallSeconds;
+    };
+}
+
+HeadlessRunner::Hook DiagnosticsHook(std::ostream& out) {
+    bool headerWritten = false;
+    return [&out, headerWritten](const IFluidSolver& solver, const RunProgress& progress) mutable {
+        if (!headerWritten) {
+            out << "step,time,particles,kineticEnergy,potentialEnergy,momentumX,momentumY,pressureIterations,averageDensityError\n";
+            headerWritten = true;
+        }
+        SolverDiagnostics diagnostics = solver.Diagnostics();
+        const StepStats& stats = solver.Stats();
+        out << progress.step << "," << progress.time << "," << solver.ParticleCount() << ","
+            << diagnostics.kineticEnergy << "," << diagnostics.potentialEnergy << ","
+            << diagnostics.momentum.x << "," << diagnostics.momentum.y << ","
+            << stats.pressureIterations << "," << stats.averageDensityError << "\n";
+        if (progress.last) out.flush();
+    };
+}
+
+// ----
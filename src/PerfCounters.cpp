@@ -0,0 +1,158 @@
+#include "PerfCounters.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+bool PerfCounters::open = false;
+std::vector<PerfStageCounts> PerfCounters::stages;
+
+const char* PerfEventName(PerfEvent event) {
+    switch (event) {
+        case PerfEvent::Cycles: return "cycles";
+        case PerfEvent::Instructions: return "instructions";
+        case PerfEvent::L1DataMisses: return "l1dMisses";
+        case PerfEvent::LastLevelMisses: return "llcMisses";
+        case PerfEvent::BranchMisses: return "branchMisses";
+        default: return "unknown";
+    }
+}
+
+void PerfCounters::Add(const char* stage, const PerfCounts& before, const PerfCounts& after) {
+    PerfStageCounts* entry = nullptr;
+    for (PerfStageCounts& candidate : stages) {
+        if (std::strcmp(candidate.stage, stage) == 0) {
+            entry = &candidate;
+            break;
+        }
+    }
+    if (entry == nullptr) {
+        PerfStageCounts added;
+        added.stage = stage;
+        added.runs = 0;
+        for (std::int64_t& value : added.counts.values) {
+            value = 0;
+        }
+        stages.push_back(added);
+        entry = &stages.back();
+    }
+
+    entry->runs++;
+    for (int e = 0; e < int(PerfEvent::Count); e++) {
+        if (before.values[e] < 0 || after.values[e] < 0) {
+            entry->counts.values[e] = -1;
+        } else if (entry->counts.values[e] >= 0) {
+            entry->counts.values[e] += after.values[e] - before.values[e];
+        }
+    }
+}
+
+#ifdef __linux__
+
+// The group's file descriptors, the cycle counter leading, -1 for events that did not open
+static int eventFds[int(PerfEvent::Count)] = {-1, -1, -1, -1, -1};
+// Where each open event's value sits in a read of the group
+static int eventSlots[int(PerfEvent::Count)] = {-1, -1, -1, -1, -1};
+static int openEvents = 0;
+
+// Set the type and config of an event
+static void DescribeEvent(PerfEvent event, perf_event_attr& attr) {
+    switch (event) {
+        case PerfEvent::Cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PerfEvent::Instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PerfEvent::L1DataMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PerfEvent::LastLevelMisses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PerfEvent::BranchMisses:
+        default:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+}
+
+bool PerfCounters::Open() {
+    if (open) return true;
+
+    for (int e = 0; e < int(PerfEvent::Count); e++) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        DescribeEvent(PerfEvent(e), attr);
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // The leader starts disabled and starts the whole group once it is complete
+        attr.disabled = (e == 0);
+
+        int leader = (e == 0) ? -1 : eventFds[0];
+        int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+        if (fd < 0) {
+            if (e == 0) {
+                std::cerr << "Hardware counters are not available (" << std::strerror(errno)
+                          << "), check /proc/sys/kernel/perf_event_paranoid" << std::endl;
+                return false;
+            }
+            std::cerr << "Counter " << PerfEventName(PerfEvent(e)) << " is not available (" << std::strerror(errno) << ")" << std::endl;
+            continue;
+        }
+        eventFds[e] = fd;
+        eventSlots[e] = openEvents++;
+    }
+
+    ioctl(eventFds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(eventFds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    open = true;
+    return true;
+}
+
+// A group read is the number of events, the times enabled and running,
+// then one value per event in the order they were opened
+PerfCounts PerfCounters::Read() {
+    PerfCounts counts;
+    if (!open) return counts;
+
+    std::uint64_t buffer[3 + int(PerfEvent::Count)];
+    if (read(eventFds[0], buffer, sizeof(buffer)) < ssize_t(3 * sizeof(std::uint64_t))) return counts;
+
+    std::uint64_t enabled = buffer[1];
+    std::uint64_t running = buffer[2];
+    double scale = (running > 0 && running < enabled) ? double(enabled) / running : 1.0;
+    for (int e = 0; e < int(PerfEvent::Count); e++) {
+        if (eventSlots[e] >= 0) {
+            counts.values[e] = std::int64_t(buffer[3 + eventSlots[e]] * scale);
+        }
+    }
+    return counts;
+}
+
+#else
+
+bool PerfCounters::Open() {
+    std::cerr << "Hardware counters are only supported on Linux" << std::endl;
+    return false;
+}
+
+PerfCounts PerfCounters::Read() {
+    return PerfCounts();
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include "PerformanceOverlay.hpp"
+#include "AllocationTracker.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+// Layout in window pixels
+static const float margin = 10.0f;
+static const float graphWidth = 240.0f;
+static const float graphHeight = 36.0f;
+static const float rowGap = 6.0f;
+static const float digitHeight = 14.0f;
+
+// Constructor
+PerformanceOverlay::PerformanceOverlay() {
+    graphs.resize(GraphCount);
+    graphs[FrameTime].color = {1.0f, 1.0f, 1.0f};
+    graphs[StepTime] = {{1.0f, 0.9f, 0.2f}, {"Step"}, {}};
+    graphs[NeighborTime] = {{0.2f, 0.9f, 1.0f}, {"CreateHashTable", "CalculateDensities"}, {}};
+    graphs[PressureTime] = {{1.0f, 0.55f, 0.1f}, {"ApplyPressureForces", "PredictPCISPHPositions", "CorrectPCISPHPressures", "CalculatePressureAccelerations", "CalculateLambdas", "ApplyPositionCorrections"}, {}};
+    graphs[RenderTime] = {{1.0f, 0.3f, 1.0f}, {"Render"}, {}};
+    graphs[GpuTime].color = {0.2f, 0.8f, 0.7f};
+    graphs[Particles].color = {0.3f, 1.0f, 0.3f};
+    graphs[MeanNeighbors].color = {0.3f, 0.5f, 1.0f};
+    graphs[MaxNeighbors].color = {0.6f, 0.4f, 1.0f};
+    graphs[DrawCalls].color = {1.0f, 0.25f, 0.25f};
+    graphs[UploadedKilobytes].color = {0.6f, 0.6f, 0.6f};
+    graphs[Allocations].color = {1.0f, 0.75f, 0.6f};
+    for (Graph& graph : graphs) {
+        graph.samples.assign(historyLength, 0.0f);
+    }
+}
+
+void PerformanceOverlay::Record(const FrameStats& frame) {
+    std::int64_t now = Profiler::Now();
+    std::int64_t since = (lastRecord == 0) ? now : lastRecord;
+    std::uint64_t allocations = AllocationTracker::Total().allocations;
+
+    float values[GraphCount] = {};
+    values[FrameTime] = float(now - since) / 1e6f;
+    values[GpuTime] = float(frame.gpuMilliseconds);
+    values[Particles] = float(frame.particles);
+    values[MeanNeighbors] = (frame.particles > 0) ? float(frame.neighborPairs) / frame.particles : 0.0f;
+    values[MaxNeighbors] = float(frame.maxNeighbors);
+    values[DrawCalls] = float(frame.drawCalls);
+    values[UploadedKilobytes] = float(frame.uploadedBytes) / 1024.0f;
+    values[Allocations] = (lastRecord == 0) ? 0.0f : float(allocations - lastAllocations);
+    for (int g = 0; g < GraphCount; g++) {
+        for (const char* zone : graphs[g].zones) {
+            values[g] += float(Profiler::ThreadTotal(zone, since)) / 1e6f;
+        }
+        graphs[g].samples[next] = values[g];
+    }
+
+    next = (next + 1) % historyLength;
+    lastRecord = now;
+    lastAllocations = allocations;
+}
+
+// Each graph is scaled to the largest sample it holds, so a spike shows
+// as a spike whatever the units
+void PerformanceOverlay::Build(float windowWidth, float windowHeight, std::pmr::vector<GLfloat>& vertices, std::pmr::vector<GLint>& indices) const {
+    float step = graphWidth / (historyLength - 1);
+    float textWidth = 6 * 0.75f * digitHeight;
+    float panelRight = std::min(windowWidth - margin, 2 * margin + graphWidth + textWidth);
+
+    for (int g = 0; g < GraphCount; g++) {
+        const Graph& graph = graphs[g];
+        float top = windowHeight - margin - g * (graphHeight + rowGap);
+        float bottom = top - graphHeight;
+        AddQuad({margin, bottom}, {panelRight, top}, -0.5f, {0.08f, 0.08f, 0.1f}, vertices, indices);
+
+        float largest = *std::max_element(graph.samples.begin(), graph.samples.end());
+        float scale = (largest > 0) ? graphHeight / largest : 0.0f;
+        glm::vec2 previous;
+        for (int k = 0; k < historyLength; k++) {
+            float sample = graph.samples[(next + k) % historyLength];
+            glm::vec2 point = {margin + k * step, bottom + sample * scale};
+            if (k > 0) AddSegment(previous, point, 1.5f, graph.color, vertices, indices);
+            previous = point;
+        }
+
+        float newest = graph.samples[(next + historyLength - 1) % historyLength];
+        AddNumber(newest, {2 * margin + graphWidth, top - (graphHeight - digitHeight) / 2}, digitHeight, graph.color, vertices, indices);
+    }
+}
+
+// GEOMETRY
+// ----
+
+void PerformanceOverlay::AddQuad(glm::vec2 low, glm::vec2 high, float z, glm::vec3 color, std::pmr::vector<GLfloat>& vertices, std::pmr::vector<GLint>& indices) {
+    GLint base = GLint(vertices.size() / 6);
+    glm::vec2 corners[] = {{low.x, low.y}, {high.x, low.y}, {low.x, high.y}, {high.x, high.y}};
+    for (const glm::vec2& corner : corners) {
+        vertices.insert(vertices.end(), {corner.x, corner.y, z, color.x, color.y, color.z});
+    }
+    indices.insert(indices.end(), {base, base + 1, base + 2, base + 2, base + 1, base + 3});
+}
+
+// Offset to both sides of the segment by half the thickness, as Line does
+void PerformanceOverlay::AddSegment(glm::vec2 start, glm::vec2 end, float thickness, glm::vec3 color, std::pmr::vector<GLfloat>& vertices, std::pmr::vector<GLint>& indices) {
+    glm::vec2 along = end - start;
+    float length = glm::length(along);
+    if (length == 0) return;
+    glm::vec2 offset = glm::vec2(-along.y, along.x) * (thickness / 2 / length);
+
+    GLint base = GLint(vertices.size() / 6);
+    glm::vec2 corners[] = {start + offset, start - offset, end + offset, end - offset};
+    for (const glm::vec2& corner : corners) {
+        vertices.insert(vertices.end(), {corner.x, corner.y, 0.0f, color.x, color.y, color.z});
+    }
+    indices.insert(indices.end(), {base, base + 1, base + 2, base + 2, base + 1, base + 3});
+}
+
+// Segments a to g of each digit, bit 0 being a:
+//  aaa
+// f   b
+//  ggg
+// e   c
+//  ddd
+static const unsigned char digitSegments[10] = {
+    0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F
+};
+
+void PerformanceOverlay::AddNumber(float value, glm::vec2 corner, float height, glm::vec3 color, std::pmr::vector<GLfloat>& vertices, std::pmr::vector<GLint>& indices) {
+    // Three significant digits at most, so the width stays put
+    char text[32];
+    if (value < 10) {
+        std::snprintf(text, sizeof(text), "%.2f", value);
+    } else if (value < 100) {
+        std::snprintf(text, sizeof(text), "%.1f", value);
+    } else {
+        std::snprintf(text, sizeof(text), "%.0f", value);
+    }
+
+    float width = height / 2;
+    float thickness = height / 8;
+    glm::vec2 ends[7][2] = {
+        {{0, 0}, {width, 0}},
+        {{width, 0}, {width, -height / 2}},
+        {{width, -height / 2}, {width, -height}},
+        {{0, -height}, {width, -height}},
+        {{0, -height / 2}, {0, -height}},
+        {{0, 0}, {0, -height / 2}},
+        {{0, -height / 2}, {width, -height / 2}}
+    };
+
+    glm::vec2 cursor = corner;
+    for (const char* c = text; *c; c++) {
+        if (*c == '.') {
+            AddQuad({cursor.x, cursor.y - height}, {cursor.x + thickness, cursor.y - height + thickness}, 0.0f, color, vertices, indices);
+            cursor.x += 2 * thickness;
+            continue;
+        }
+        if (*c == '-') {
+            AddSegment(cursor + ends[6][0], cursor + ends[6][1], thickness, color, vertices, indices);
+        } else if (*c >= '0' && *c <= '9') {
+            for (int segment = 0; segment < 7; segment++) {
+                if (digitSegments[*c - '0'] & (1 << segment)) {
+                    AddSegment(cursor + ends[segment][0], cursor + ends[segment][1], thickness, color, vertices, indices);
+                }
+            }
+        }
+        cursor.x += 1.5f * width;
+    }
+}
+
+// ----
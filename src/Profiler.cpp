@@ -0,0 +1,164 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// One recorded zone
+struct ProfileEvent {
+    const char* name;
+    std::int64_t start;
+    std::int64_t end;
+};
+
+// The zones of one thread. Rings live until exit, so a trace written after
+// a thread finished still has its zones
+struct ProfileRing {
+    static constexpr std::size_t capacity = 1 << 16;
+
+    std::vector<ProfileEvent> events = std::vector<ProfileEvent>(capacity);
+    // Zones recorded so far, the ring holds the last capacity of them
+    std::atomic<std::uint64_t> written{0};
+    const char* threadName = nullptr;
+    int threadId = 0;
+    // Whether the ring is a named track rather than a thread's
+    bool track = false;
+};
+
+// Every thread's ring, appended to under the mutex
+static std::mutex ringsMutex;
+static std::vector<std::unique_ptr<ProfileRing>> rings;
+
+// The calling thread's ring, registered on first use
+static ProfileRing& ThreadRing() {
+    thread_local ProfileRing* ring = nullptr;
+    if (ring == nullptr) {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.push_back(std::make_unique<ProfileRing>());
+        ring = rings.back().get();
+        ring->threadId = int(rings.size());
+    }
+    return *ring;
+}
+
+// The ring of a named track, registered on first use
+static ProfileRing& TrackRing(const char* track) {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (const auto& ring : rings) {
+        if (ring->track && std::strcmp(ring->threadName, track) == 0) return *ring;
+    }
+    rings.push_back(std::make_unique<ProfileRing>());
+    ProfileRing& ring = *rings.back();
+    ring.threadId = int(rings.size());
+    ring.threadName = track;
+    ring.track = true;
+    return ring;
+}
+
+// Only the ring's own thread writes, readers see zones up to written
+static void Push(ProfileRing& ring, const ProfileEvent& event) {
+    std::uint64_t index = ring.written.load(std::memory_order_relaxed);
+    ring.events[index % ProfileRing::capacity] = event;
+    ring.written.store(index + 1, std::memory_order_release);
+}
+
+std::int64_t Profiler::Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::Record(const char* name, std::int64_t start, std::int64_t end) {
+    Push(ThreadRing(), {name, start, end});
+}
+
+void Profiler::RecordTrack(const char* track, const char* name, std::int64_t start, std::int64_t end) {
+    Push(TrackRing(track), {name, start, end});
+}
+
+void Profiler::SetThreadName(const char* name) {
+    ThreadRing().threadName = name;
+}
+
+// Zones are recorded as they end, so the ring is walked back from the newest
+// until one ended before since
+std::int64_t Profiler::ThreadTotal(const char* name, std::int64_t since) {
+    if (!enabled) return 0;
+
+    const ProfileRing& ring = ThreadRing();
+    std::uint64_t written = ring.written.load(std::memory_order_relaxed);
+    std::uint64_t first = written - std::min<std::uint64_t>(written, ProfileRing::capacity);
+    std::int64_t total = 0;
+    for (std::uint64_t k = written; k > first; k--) {
+        const ProfileEvent& event = ring.events[(k - 1) % ProfileRing::capacity];
+        if (event.end < since) break;
+        if (std::strcmp(event.name, name) == 0) total += event.end - event.start;
+    }
+    return total;
+}
+
+// Names are literals from the source, only quotes and backslashes need escaping
+static void WriteJsonString(std::ofstream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') out << '\\';
+        out << *c;
+    }
+    out << '"';
+}
+
+// Complete events ("ph": "X") in microseconds from the earliest zone, one
+// track per thread
+bool Profiler::WriteChromeTrace(const std::string& path) {
+    if (!enabled) {
+        std::cerr << "Built without SPH_PROFILE, no zones were recorded for " << path << std::endl;
+    }
+
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Could not write the trace to " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    std::int64_t origin = INT64_MAX;
+    for (const auto& ring : rings) {
+        std::uint64_t written = ring->written.load(std::memory_order_acquire);
+        std::uint64_t first = written - std::min<std::uint64_t>(written, ProfileRing::capacity);
+        for (std::uint64_t k = first; k < written; k++) {
+            origin = std::min(origin, ring->events[k % ProfileRing::capacity].start);
+        }
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool firstEvent = true;
+    for (const auto& ring : rings) {
+        if (ring->threadName != nullptr) {
+            out << (firstEvent ? "" : ",\n") << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": "
+                << ring->threadId << ", \"args\": {\"name\": ";
+            WriteJsonString(out, ring->threadName);
+            out << "}}";
+            firstEvent = false;
+        }
+
+        std::uint64_t written = ring->written.load(std::memory_order_acquire);
+        std::uint64_t first = written - std::min<std::uint64_t>(written, ProfileRing::capacity);
+        for (std::uint64_t k = first; k < written; k++) {
+            const ProfileEvent& event = ring->events[k % ProfileRing::capacity];
+            out << (firstEvent ? "" : ",\n") << "{\"ph\": \"X\", \"name\": ";
+            WriteJsonString(out, event.name);
+            out << ", \"pid\": 1, \"tid\": " << ring->threadId
+                << ", \"ts\": " << double(event.start - origin) / 1000
+                << ", \"dur\": " << double(event.end - event.start) / 1000 << "}";
+            firstEvent = false;
+        }
+    }
+    out << "\n]}\n";
+    return bool(out);
+}
@@ -0,0 +1,247 @@
+#include "ReplaySimulation.hpp"
+#include "Application.hpp"
+#include "PerformanceOverlay.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Constructor
+ReplaySimulation::ReplaySimulation(Application& u_app) : app(u_app) { }
+
+// Destructor
+ReplaySimulation::~ReplaySimulation() {
+    if (decoder.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(frameMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        decoder.join();
+    }
+}
+
+bool ReplaySimulation::Open(const std::string& path) {
+    if (!reader.Open(path)) {
+        return false;
+    }
+    if (reader.FrameCount() == 0) {
+        std::cerr << "Trajectory file " << path << " has no frames" << std::endl;
+        return false;
+    }
+    startTime = reader.FrameTime(0);
+    endTime = reader.FrameTime(reader.FrameCount() - 1);
+    playbackTime = startTime;
+    return true;
+}
+
+void ReplaySimulation::SetSpeed(double u_speed) {
+    speed = u_speed;
+}
+
+void ReplaySimulation::SetLooping(bool u_looping) {
+    looping = u_looping;
+}
+
+// Draw the borders of the recorded tank
+void ReplaySimulation::DrawBorders() {
+    GLfloat buffer = 0.06;
+    GLfloat thickness = 0.03;
+    GLfloat x = GLfloat(reader.Width()) + buffer;
+    GLfloat y = GLfloat(reader.Height()) + buffer;
+    glm::vec3 corners[4] = {glm::vec3(-x, -y, 0), glm::vec3(x, -y, 0), glm::vec3(x, y, 0), glm::vec3(-x, y, 0)};
+    for (int i = 0; i < 4; i++) {
+        app.AddObject(std::make_shared<Line>(corners[i], corners[(i + 1) % 4], glm::vec3(1, 1, 1), thickness));
+    }
+}
+
+// First time render, the first frame is read here so there is something
+// to draw before the decoder has run
+void ReplaySimulation::Render() {
+    std::cout << "Replaying " << reader.FrameCount() << " frames, " << startTime << "s to " << endTime << "s of simulated time" << std::endl;
+    std::cout << "Space pauses, Left and Right step, Page Up and Page Down jump, Home and End go to the ends," << std::endl;
+    std::cout << "Up and Down change the speed, R reverses, L loops, dragging with the left mouse button scrubs" << std::endl;
+    DrawBorders();
+
+    if (!reader.ReadFrame(0, shown)) {
+        std::cerr << "Could not read the first trajectory frame" << std::endl;
+    }
+    requested = 0;
+    attempted = 0;
+    decoder = std::thread(&ReplaySimulation::DecoderLoop, this);
+    lastUpdate = std::chrono::steady_clock::now();
+}
+
+void ReplaySimulation::Update() {
+    PROFILE_ZONE("Replay");
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double wallSeconds = std::chrono::duration<double>(now - lastUpdate).count();
+    lastUpdate = now;
+    if (!paused && !scrubbing) {
+        Seek(playbackTime + wallSeconds * speed);
+        // Without looping, playback stops at the end it ran into
+        if (!looping && ((speed > 0 && playbackTime >= endTime) || (speed < 0 && playbackTime <= startTime))) {
+            paused = true;
+            PrintState();
+        }
+    }
+
+    std::size_t index = reader.FrameAt(playbackTime);
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        requested = index;
+        if (readyFresh) {
+            std::swap(shown, ready);
+            readyFresh = false;
+        }
+    }
+    wake.notify_one();
+}
+
+void ReplaySimulation::CollectStats(FrameStats& stats) const {
+    stats.particles += int(shown.densities.size());
+}
+
+ParticleView ReplaySimulation::Particles() const {
+    ParticleView particles;
+    particles.positions = shown.positions.data();
+    particles.count = shown.densities.size();
+    particles.radius = 0.04f;
+    return particles;
+}
+
+// PLAYBACK
+// ----
+
+void ReplaySimulation::HandleEvent(const SDL_Event& e) {
+    if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) {
+        scrubbing = true;
+        SeekFraction(double(e.button.x) / std::max(app.getWindowWidth(), 1));
+        return;
+    }
+    if (e.type == SDL_MOUSEMOTION && scrubbing) {
+        SeekFraction(double(e.motion.x) / std::max(app.getWindowWidth(), 1));
+        return;
+    }
+    if (e.type == SDL_MOUSEBUTTONUP && e.button.button == SDL_BUTTON_LEFT) {
+        scrubbing = false;
+        return;
+    }
+    if (e.type != SDL_KEYDOWN) {
+        return;
+    }
+
+    switch (e.key.keysym.scancode) {
+    case SDL_SCANCODE_SPACE:
+        if (e.key.repeat != 0) return;
+        paused = !paused;
+        // Playing again from the end it stopped at starts over
+        if (!paused && !looping) {
+            if (speed > 0 && playbackTime >= endTime) playbackTime = startTime;
+            if (speed < 0 && playbackTime <= startTime) playbackTime = endTime;
+        }
+        break;
+    case SDL_SCANCODE_RIGHT:
+        StepFrames(1);
+        break;
+    case SDL_SCANCODE_LEFT:
+        StepFrames(-1);
+        break;
+    case SDL_SCANCODE_PAGEDOWN:
+        Seek(playbackTime + (endTime - startTime) / 10);
+        break;
+    case SDL_SCANCODE_PAGEUP:
+        Seek(playbackTime - (endTime - startTime) / 10);
+        break;
+    case SDL_SCANCODE_HOME:
+        Seek(startTime);
+        break;
+    case SDL_SCANCODE_END:
+        Seek(endTime);
+        break;
+    case SDL_SCANCODE_UP:
+        speed *= 2;
+        break;
+    case SDL_SCANCODE_DOWN:
+        speed /= 2;
+        break;
+    case SDL_SCANCODE_R:
+        if (e.key.repeat != 0) return;
+        speed = -speed;
+        break;
+    case SDL_SCANCODE_L:
+        if (e.key.repeat != 0) return;
+        looping = !looping;
+        break;
+    default:
+        return;
+    }
+    PrintState();
+}
+
+void ReplaySimulation::Seek(double time) {
+    double duration = endTime - startTime;
+    if (looping && duration > 0 && (time < startTime || time > endTime)) {
+        time = startTime + (time - startTime) - duration * std::floor((time - startTime) / duration);
+    }
+    playbackTime = std::min(std::max(time, startTime), endTime);
+}
+
+void ReplaySimulation::SeekFraction(double fraction) {
+    fraction = std::min(std::max(fraction, 0.0), 1.0);
+    playbackTime = startTime + fraction * (endTime - startTime);
+}
+
+// Frames are stepped by index, not time, so no frame is skipped
+void ReplaySimulation::StepFrames(int frames) {
+    paused = true;
+    long long index = (long long)reader.FrameAt(playbackTime) + frames;
+    long long last = (long long)reader.FrameCount() - 1;
+    if (looping) {
+        index = ((index % (last + 1)) + last + 1) % (last + 1);
+    }
+    playbackTime = reader.FrameTime(std::size_t(std::min(std::max(index, 0LL), last)));
+}
+
+void ReplaySimulation::PrintState() const {
+    std::size_t index = reader.FrameAt(playbackTime);
+    std::cout << "Replay: frame " << index + 1 << " of " << reader.FrameCount() << ", step " << reader.FrameStep(index)
+              << ", " << playbackTime << "s, speed " << speed << "x" << (paused ? ", paused" : "") << (looping ? ", looping" : "") << std::endl;
+}
+
+// ----
+
+// DECODING
+// ----
+
+// Decodes the frame most recently wanted, then hints the OS to load the
+// frame after it in the direction playback is moving
+void ReplaySimulation::DecoderLoop() {
+    PROFILE_THREAD("Replay decoder");
+    std::size_t previous = 0;
+    std::unique_lock<std::mutex> lock(frameMutex);
+    while (true) {
+        wake.wait(lock, [this] { return stopping || requested != attempted; });
+        if (stopping) break;
+        std::size_t index = requested;
+        attempted = index;
+        lock.unlock();
+
+        bool read = reader.ReadFrame(index, decoding);
+        long long next = 2 * (long long)index - (long long)previous;
+        if (next != (long long)index && next >= 0) {
+            reader.Prefetch(std::size_t(next));
+        }
+        previous = index;
+
+        lock.lock();
+        if (read) {
+            std::swap(ready, decoding);
+            readyFresh = true;
+        } else {
+            std::cerr << "Could not read trajectory frame " << index + 1 << std::endl;
+        }
+    }
+}
+
+// ----
@@ -0,0 +1,170 @@
+#include "RigidBody.hpp"
+
+#include <cmath>
+#include <iostream>
+
+// Corners of a shape in its own frame, circles as a 32 sided polygon
+static std::pmr::vector<glm::dvec2> LocalCorners(const BoundaryShape& shape, std::pmr::memory_resource* memory) {
+    std::pmr::vector<glm::dvec2> corners(memory);
+    switch (shape.kind) {
+        case BoundaryShape::Kind::Box: {
+            glm::dvec2 e = shape.halfExtents;
+            corners = {{-e.x, -e.y}, {e.x, -e.y}, {e.x, e.y}, {-e.x, e.y}};
+            break;
+        }
+        case BoundaryShape::Kind::Polygon:
+        case BoundaryShape::Kind::Polyline:
+            corners.assign(shape.points.begin(), shape.points.end());
+            break;
+        case BoundaryShape::Kind::Circle:
+        default: {
+            const int sides = 32;
+            for (int k = 0; k < sides; k++) {
+                double angle = 2 * M_PI * k / sides;
+                corners.push_back(shape.radius * glm::dvec2(std::cos(angle), std::sin(angle)));
+            }
+            break;
+        }
+    }
+    return corners;
+}
+
+// Corners of a box or polygon in its own frame without copying them, a box's
+// are written to storage. Collisions query these per particle, so they must
+// not allocate
+static const glm::dvec2* PolygonCorners(const BoundaryShape& shape, glm::dvec2 (&storage)[4], std::size_t& count) {
+    if (shape.kind == BoundaryShape::Kind::Box) {
+        glm::dvec2 e = shape.halfExtents;
+        storage[0] = {-e.x, -e.y};
+        storage[1] = {e.x, -e.y};
+        storage[2] = {e.x, e.y};
+        storage[3] = {-e.x, e.y};
+        count = 4;
+        return storage;
+    }
+    count = shape.points.size();
+    return shape.points.data();
+}
+
+// Rotate a vector counterclockwise
+static glm::dvec2 Rotate(glm::dvec2 v, double angle) {
+    double c = std::cos(angle);
+    double s = std::sin(angle);
+    return {c * v.x - s * v.y, s * v.x + c * v.y};
+}
+
+RigidBody MakeRigidBody(const BoundaryShape& shape, glm::dvec2 position, double density) {
+    RigidBody body;
+    body.shape = shape;
+    body.shape.center = {0, 0};
+    body.position = position;
+
+    switch (body.shape.kind) {
+        case BoundaryShape::Kind::Box: {
+            glm::dvec2 size = 2.0 * body.shape.halfExtents;
+            body.mass = density * size.x * size.y;
+            body.inertia = body.mass * (size.x * size.x + size.y * size.y) / 12;
+            break;
+        }
+        case BoundaryShape::Kind::Polyline:
+            std::cerr << "Rigid bodies have no open walls, closing the polyline into a polygon" << std::endl;
+            body.shape.kind = BoundaryShape::Kind::Polygon;
+            // Fall through
+        case BoundaryShape::Kind::Polygon: {
+            // Area and centroid by the shoelace formula, the points are moved onto the centroid
+            std::vector<glm::dvec2>& points = body.shape.points;
+            double area = 0;
+            glm::dvec2 centroid = {0, 0};
+            for (std::size_t i = 0; i < points.size(); i++) {
+                glm::dvec2 a = points[i];
+                glm::dvec2 b = points[(i + 1) % points.size()];
+                double cross = a.x * b.y - a.y * b.x;
+                area += cross / 2;
+                centroid += (a + b) * cross / 6.0;
+            }
+            if (area == 0) break;
+            centroid /= area;
+
+            double second = 0;
+            for (glm::dvec2& point : points) {
+                point -= centroid;
+            }
+            for (std::size_t i = 0; i < points.size(); i++) {
+                glm::dvec2 a = points[i];
+                glm::dvec2 b = points[(i + 1) % points.size()];
+                double cross = a.x * b.y - a.y * b.x;
+                second += cross * (glm::dot(a, a) + glm::dot(a, b) + glm::dot(b, b)) / 12;
+            }
+            body.mass = density * std::abs(area);
+            body.inertia = density * std::abs(second);
+            break;
+        }
+        case BoundaryShape::Kind::Circle:
+        default:
+            body.mass = density * M_PI * body.shape.radius * body.shape.radius;
+            body.inertia = body.mass * body.shape.radius * body.shape.radius / 2;
+            break;
+    }
+    return body;
+}
+
+// The shape distance gives the sign, the closest point on the outline the normal
+double BodyDistance(const RigidBody& body, glm::dvec2 point, glm::dvec2& normal) {
+    glm::dvec2 local = Rotate(point - body.position, -body.angle);
+    double distance = ShapeDistance(body.shape, local);
+
+    glm::dvec2 direction;
+    if (body.shape.kind == BoundaryShape::Kind::Circle) {
+        direction = local;
+    } else {
+        glm::dvec2 storage[4];
+        std::size_t count;
+        const glm::dvec2* corners = PolygonCorners(body.shape, storage, count);
+        glm::dvec2 closest = corners[0];
+        double best = INFINITY;
+        for (std::size_t i = 0; i < count; i++) {
+            glm::dvec2 a = corners[i];
+            glm::dvec2 ab = corners[(i + 1) % count] - a;
+            double length2 = glm::dot(ab, ab);
+            double t = (length2 > 0) ? glm::clamp(glm::dot(local - a, ab) / length2, 0.0, 1.0) : 0.0;
+            glm::dvec2 candidate = a + t * ab;
+            double d2 = glm::dot(local - candidate, local - candidate);
+            if (d2 < best) {
+                best = d2;
+                closest = candidate;
+            }
+        }
+        direction = (distance < 0) ? closest - local : local - closest;
+    }
+
+    double length = glm::length(direction);
+    normal = (length > 0) ? Rotate(direction / length, body.angle) : glm::dvec2(0, 0);
+    return distance;
+}
+
+void BodyBounds(const RigidBody& body, glm::dvec2& lower, glm::dvec2& upper) {
+    if (body.shape.kind == BoundaryShape::Kind::Circle) {
+        lower = body.position - body.shape.radius;
+        upper = body.position + body.shape.radius;
+        return;
+    }
+
+    glm::dvec2 storage[4];
+    std::size_t count;
+    const glm::dvec2* corners = PolygonCorners(body.shape, storage, count);
+    lower = glm::dvec2(INFINITY, INFINITY);
+    upper = -lower;
+    for (std::size_t i = 0; i < count; i++) {
+        glm::dvec2 corner = body.position + Rotate(corners[i], body.angle);
+        lower = glm::min(lower, corner);
+        upper = glm::max(upper, corner);
+    }
+}
+
+std::pmr::vector<glm::dvec2> BodyOutline(const RigidBody& body, std::pmr::memory_resource* memory) {
+    std::pmr::vector<glm::dvec2> corners = LocalCorners(body.shape, memory);
+    for (glm::dvec2& corner : corners) {
+        corner = body.position + Rotate(corner, body.angle);
+    }
+    return corners;
+}
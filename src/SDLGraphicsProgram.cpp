@@ -1,4 +1,5 @@
 #include "SDLGraphicsProgram.hpp"
+#include "Profiler.hpp"
 
 
 // Initialization function
@@ -257,9 +258,11 @@ void SDLGraphicsProgram::Loop(){
     
     // Call the pre-loop function once
     pfn_preLoopFunc();
+    PROFILE_THREAD("Main");
 
     // While application is running
     while(!m_quitLoop){
+        PROFILE_ZONE("Frame");
      	
 		// Handle any input from the user
         // (Calls the function pointer)
@@ -273,6 +276,7 @@ void SDLGraphicsProgram::Loop(){
       	// Update screen of our specified window with the final
         // graphics scene.
         if(m_OpenGLInitialized){
+      	    PROFILE_ZONE("Swap");
       	    SDL_GL_SwapWindow(GetSDLWindowPointer());
         }else{
             
@@ -0,0 +1,199 @@
+#include "SignedDistanceField.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Extra nodes past the tank walls, so particles pushed slightly out still find a normal
+static const int margin = 2;
+
+// Constructor
+SignedDistanceField::SignedDistanceField(double width, double height, double u_cellSize, const std::vector<BoundaryShape>& shapes) {
+    cellSize = u_cellSize;
+    cols = int(std::ceil(2 * width / cellSize)) + 1 + 2 * margin;
+    rows = int(std::ceil(2 * height / cellSize)) + 1 + 2 * margin;
+    origin = {-width - margin * cellSize, -height - margin * cellSize};
+
+    // The tank is a box the fluid is inside of, each obstacle one it is outside of
+    BoundaryShape tank;
+    tank.kind = BoundaryShape::Kind::Box;
+    tank.halfExtents = {width, height};
+
+    distances.resize(cols * rows);
+    for (int row = 0; row < rows; row++) {
+        for (int col = 0; col < cols; col++) {
+            glm::dvec2 point = origin + cellSize * glm::dvec2(col, row);
+            double distance = -ShapeDistance(tank, point);
+            for (const BoundaryShape& shape : shapes) {
+                distance = std::min(distance, ShapeDistance(shape, point));
+            }
+            distances[row * cols + col] = float(distance);
+        }
+    }
+
+    // Normals by central differences, one sided on the border
+    normals.resize(cols * rows);
+    for (int row = 0; row < rows; row++) {
+        for (int col = 0; col < cols; col++) {
+            int left = std::max(col - 1, 0);
+            int right = std::min(col + 1, cols - 1);
+            int below = std::max(row - 1, 0);
+            int above = std::min(row + 1, rows - 1);
+            glm::vec2 gradient = {
+                (distances[row * cols + right] - distances[row * cols + left]) / float((right - left) * cellSize),
+                (distances[above * cols + col] - distances[below * cols + col]) / float((above - below) * cellSize)
+            };
+            float length = glm::length(gradient);
+            normals[row * cols + col] = (length > 0) ? gradient / length : glm::vec2(0, 0);
+        }
+    }
+}
+
+// Bilinear blend of the four surrounding nodes
+double SignedDistanceField::Sample(double x, double y, glm::dvec2& normal) const {
+    double u = glm::clamp((x - origin.x) / cellSize, 0.0, double(cols - 1));
+    double v = glm::clamp((y - origin.y) / cellSize, 0.0, double(rows - 1));
+    int col = std::min(int(u), cols - 2);
+    int row = std::min(int(v), rows - 2);
+    double s = u - col;
+    double t = v - row;
+
+    int corner = row * cols + col;
+    double w00 = (1 - s) * (1 - t), w10 = s * (1 - t), w01 = (1 - s) * t, w11 = s * t;
+    normal = w00 * glm::dvec2(normals[corner]) + w10 * glm::dvec2(normals[corner + 1])
+           + w01 * glm::dvec2(normals[corner + cols]) + w11 * glm::dvec2(normals[corner + cols + 1]);
+    double length = glm::length(normal);
+    if (length > 0) normal /= length;
+
+    return w00 * distances[corner] + w10 * distances[corner + 1]
+         + w01 * distances[corner + cols] + w11 * distances[corner + cols + 1];
+}
+
+// Distance from a point to the segment ab
+static double SegmentDistance(glm::dvec2 point, glm::dvec2 a, glm::dvec2 b) {
+    glm::dvec2 ab = b - a;
+    double length2 = glm::dot(ab, ab);
+    double t = (length2 > 0) ? glm::clamp(glm::dot(point - a, ab) / length2, 0.0, 1.0) : 0.0;
+    return glm::length(point - (a + t * ab));
+}
+
+double ShapeDistance(const BoundaryShape& shape, glm::dvec2 point) {
+    switch (shape.kind) {
+        case BoundaryShape::Kind::Box: {
+            glm::dvec2 q = glm::abs(point - shape.center) - shape.halfExtents;
+            return glm::length(glm::max(q, glm::dvec2(0, 0))) + std::min(std::max(q.x, q.y), 0.0);
+        }
+        case BoundaryShape::Kind::Polygon: {
+            // Nearest edge for the distance, crossings of a ray to the right for the sign
+            double distance = INFINITY;
+            bool inside = false;
+            std::size_t count = shape.points.size();
+            for (std::size_t i = 0, j = count - 1; i < count; j = i++) {
+                glm::dvec2 a = shape.points[j];
+                glm::dvec2 b = shape.points[i];
+                distance = std::min(distance, SegmentDistance(point, a, b));
+                if ((a.y > point.y) != (b.y > point.y) && point.x < a.x + (point.y - a.y) * (b.x - a.x) / (b.y - a.y)) {
+                    inside = !inside;
+                }
+            }
+            return inside ? -distance : distance;
+        }
+        case BoundaryShape::Kind::Polyline: {
+            double distance = INFINITY;
+            for (std::size_t i = 1; i < shape.points.size(); i++) {
+                distance = std::min(distance, SegmentDistance(point, shape.points[i - 1], shape.points[i]));
+            }
+            return distance - shape.thickness / 2;
+        }
+        case BoundaryShape::Kind::Circle:
+        default:
+            return glm::length(point - shape.center) - shape.radius;
+    }
+}
+
+std::pmr::vector<glm::dvec2> ShapeOutline(const BoundaryShape& shape, std::pmr::memory_resource* memory) {
+    std::pmr::vector<glm::dvec2> segments(memory);
+    std::pmr::vector<glm::dvec2> corners(memory);
+    bool closed = true;
+
+    switch (shape.kind) {
+        case BoundaryShape::Kind::Box: {
+            glm::dvec2 e = shape.halfExtents;
+            corners = {shape.center + glm::dvec2(-e.x, -e.y), shape.center + glm::dvec2(e.x, -e.y),
+                       shape.center + glm::dvec2(e.x, e.y), shape.center + glm::dvec2(-e.x, e.y)};
+            break;
+        }
+        case BoundaryShape::Kind::Polygon:
+            corners.assign(shape.points.begin(), shape.points.end());
+            break;
+        case BoundaryShape::Kind::Polyline:
+            corners.assign(shape.points.begin(), shape.points.end());
+            closed = false;
+            break;
+        case BoundaryShape::Kind::Circle:
+        default: {
+            const int sides = 32;
+            for (int k = 0; k < sides; k++) {
+                double angle = 2 * M_PI * k / sides;
+                corners.push_back(shape.center + shape.radius * glm::dvec2(std::cos(angle), std::sin(angle)));
+            }
+            break;
+        }
+    }
+
+    for (std::size_t i = 1; i < corners.size(); i++) {
+        segments.push_back(corners[i - 1]);
+        segments.push_back(corners[i]);
+    }
+    if (closed && corners.size() > 2) {
+        segments.push_back(corners.back());
+        segments.push_back(corners.front());
+    }
+    return segments;
+}
+
+bool LoadBoundaryShapes(const std::string& path, std::vector<BoundaryShape>& shapes) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Could not open boundary file " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::istringstream in(line);
+        std::string kind;
+        if (!(in >> kind) || kind[0] == '#') continue;
+
+        BoundaryShape shape;
+        bool valid = true;
+        if (kind == "circle") {
+            shape.kind = BoundaryShape::Kind::Circle;
+            valid = bool(in >> shape.center.x >> shape.center.y >> shape.radius);
+        } else if (kind == "box") {
+            shape.kind = BoundaryShape::Kind::Box;
+            valid = bool(in >> shape.center.x >> shape.center.y >> shape.halfExtents.x >> shape.halfExtents.y);
+        } else if (kind == "polygon" || kind == "polyline") {
+            shape.kind = (kind == "polygon") ? BoundaryShape::Kind::Polygon : BoundaryShape::Kind::Polyline;
+            if (kind == "polyline") valid = bool(in >> shape.thickness);
+            glm::dvec2 point;
+            while (in >> point.x >> point.y) {
+                shape.points.push_back(point);
+            }
+            valid = valid && shape.points.size() >= ((kind == "polygon") ? 3u : 2u);
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            std::cerr << "Invalid boundary shape on line " << lineNumber << " of " << path << std::endl;
+            return false;
+        }
+        shapes.push_back(shape);
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+#include "ThreadPool.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+
+// Constructor
+ThreadPool::ThreadPool(int threadCount) {
+    if (threadCount <= 0) {
+        threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+    }
+
+    // The calling thread does the first chunk
+    for (int chunk = 1; chunk < threadCount; chunk++) {
+        workers.emplace_back(&ThreadPool::WorkerLoop, this, chunk);
+    }
+}
+
+// Destructor
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// Split [0, count) into one chunk per thread
+void ThreadPool::Run(int count, const void* body, void (*call)(const void*, int, int)) {
+    int chunks = ThreadCount();
+    if (chunks == 1 || count < chunks) {
+        call(body, 0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = body;
+        jobCall = call;
+        jobCount = count;
+        pending = chunks - 1;
+        generation++;
+    }
+    jobReady.notify_all();
+
+    {
+        PROFILE_ZONE("Chunk");
+        call(body, 0, count / chunks);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    jobDone.wait(lock, [this] { return pending == 0; });
+    job = nullptr;
+}
+
+// Wait for a job, run this worker's chunk of it, repeat
+void ThreadPool::WorkerLoop(int chunk) {
+    PROFILE_THREAD("Worker");
+    unsigned seen = 0;
+    while (true) {
+        const void* body;
+        void (*call)(const void*, int, int);
+        int count;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobReady.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            body = job;
+            call = jobCall;
+            count = jobCount;
+        }
+
+        int chunks = ThreadCount();
+        {
+            PROFILE_ZONE("Chunk");
+            call(body, int(long(count) * chunk / chunks), int(long(count) * (chunk + 1) / chunks));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending--;
+        }
+        jobDone.notify_one();
+    }
+}
@@ -0,0 +1,337 @@
+#include "TrajectoryCodec.hpp"
+#include "Profiler.hpp"
+#include "TrajectoryWriter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+    // Values sharing one Rice parameter
+    const std::size_t runLength = 64;
+    // Quotients this large are escaped and the value stored whole
+    const unsigned escapeQuotient = 24;
+    // Positions span [0, positionSteps] across the tank
+    const double positionSteps = 65535;
+
+    // Appends bits to a byte vector, least significant bit first
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<unsigned char>& u_out) : out(u_out) { }
+
+        // Append the low count bits of value, count at most 32
+        void Put(std::uint32_t value, int count) {
+            bits |= std::uint64_t(value) << used;
+            used += count;
+            while (used >= 8) {
+                out.push_back((unsigned char)bits);
+                bits >>= 8;
+                used -= 8;
+            }
+        }
+
+        // Write out a partly filled last byte
+        void Flush() {
+            if (used > 0) out.push_back((unsigned char)bits);
+            bits = 0;
+            used = 0;
+        }
+
+    private:
+        std::vector<unsigned char>& out;
+        std::uint64_t bits = 0;
+        int used = 0;
+    };
+
+    // Reads bits written by a BitWriter, reading past the end sets a flag
+    class BitReader {
+    public:
+        BitReader(const unsigned char* u_data, std::size_t bytes) : data(u_data), end(u_data + bytes) { }
+
+        // Read count bits, count at most 32
+        std::uint32_t Get(int count) {
+            if (available < count) {
+                Refill();
+                if (available < count) {
+                    overrun = true;
+                    return 0;
+                }
+            }
+            std::uint32_t value = std::uint32_t(bits & ((std::uint64_t(1) << count) - 1));
+            bits >>= count;
+            available -= count;
+            return value;
+        }
+
+        // Count one bits up to a zero, which is consumed, or up to limit ones
+        unsigned Ones(unsigned limit) {
+            unsigned count = 0;
+            while (count < limit) {
+                if (available == 0) {
+                    Refill();
+                    if (available == 0) {
+                        overrun = true;
+                        return count;
+                    }
+                }
+                bool one = bits & 1;
+                bits >>= 1;
+                available--;
+                if (!one) break;
+                count++;
+            }
+            return count;
+        }
+
+        bool Overrun() const { return overrun; }
+
+    private:
+        void Refill() {
+            while (available <= 56 && data < end) {
+                bits |= std::uint64_t(*data++) << available;
+                available += 8;
+            }
+        }
+
+        const unsigned char* data;
+        const unsigned char* end;
+        std::uint64_t bits = 0;
+        int available = 0;
+        bool overrun = false;
+    };
+
+    // Map signed residuals to unsigned, small magnitudes to small values
+    std::uint32_t ZigZag(std::uint32_t residual) {
+        return (residual << 1) ^ std::uint32_t(-(residual >> 31));
+    }
+    std::uint32_t UnZigZag(std::uint32_t value) {
+        return (value >> 1) ^ std::uint32_t(-(value & 1));
+    }
+
+    // Rice parameter near log2 of the mean of a run
+    int RiceParameter(const std::uint32_t* values, std::size_t count) {
+        std::uint64_t sum = 0;
+        for (std::size_t i = 0; i < count; i++) sum += values[i];
+        int k = 0;
+        while (k < 31 && (std::uint64_t(count) << (k + 1)) <= sum) k++;
+        return k;
+    }
+
+    // Round to a whole number of steps, clamped to what an int32 holds
+    std::int32_t RoundToSteps(double value, double step) {
+        double steps = std::round(value / step);
+        if (!(steps > std::numeric_limits<std::int32_t>::min())) return std::numeric_limits<std::int32_t>::min();
+        if (steps > std::numeric_limits<std::int32_t>::max()) return std::numeric_limits<std::int32_t>::max();
+        return std::int32_t(steps);
+    }
+
+    // Prediction of value i of stream s: from the keyframe where it has the
+    // particle, with positions moved on by its velocity, else from the value before
+    std::int32_t Predict(const std::vector<std::int32_t>& values, const QuantizedFrame* key, std::size_t keyCount, const double scales[2], int s, std::size_t i, std::size_t begin) {
+        if (i < keyCount) {
+            std::int32_t value = key->streams[s][i];
+            if (s < 2) {
+                double drift = std::min(std::max(key->streams[s + 2][i] * scales[s], -positionSteps), positionSteps);
+                value += std::int32_t(std::lround(drift));
+            }
+            return value;
+        }
+        return i > begin ? values[i - 1] : 0;
+    }
+
+    // Round a coordinate to a 16 bit fraction of [-extent, extent]
+    std::int32_t RoundToFraction(double value, double extent) {
+        double fraction = std::round((value + extent) / (2 * extent) * positionSteps);
+        return std::int32_t(std::min(std::max(fraction, 0.0), positionSteps));
+    }
+}
+
+// Constructor
+TrajectoryCodec::TrajectoryCodec(const TrajectoryQuantization& u_quantization, int u_blockParticles, int threadCount) :
+    quantization(u_quantization), blockParticles(std::max(u_blockParticles, int(runLength))), pool(new ThreadPool(threadCount)) { }
+
+// QUANTIZATION
+// ----
+
+void TrajectoryCodec::Quantize(const TrajectoryFrame& frame, QuantizedFrame& quantized) const {
+    std::size_t count = frame.densities.size();
+    quantized.time = frame.time;
+    for (std::vector<std::int32_t>& stream : quantized.streams) {
+        stream.resize(count);
+    }
+    for (std::size_t i = 0; i < count; i++) {
+        quantized.streams[0][i] = RoundToFraction(frame.positions[2 * i], quantization.width);
+        quantized.streams[1][i] = RoundToFraction(frame.positions[2 * i + 1], quantization.height);
+        quantized.streams[2][i] = RoundToSteps(frame.velocities[2 * i], quantization.velocityStep);
+        quantized.streams[3][i] = RoundToSteps(frame.velocities[2 * i + 1], quantization.velocityStep);
+        quantized.streams[4][i] = RoundToSteps(frame.densities[i], quantization.densityStep);
+        quantized.streams[5][i] = frame.ids[i];
+    }
+}
+
+void TrajectoryCodec::Dequantize(const QuantizedFrame& quantized, TrajectoryFrame& frame) const {
+    std::size_t count = quantized.Size();
+    frame.time = quantized.time;
+    frame.positions.resize(2 * count);
+    frame.velocities.resize(2 * count);
+    frame.densities.resize(count);
+    frame.ids.resize(count);
+    double xScale = 2 * quantization.width / positionSteps;
+    double yScale = 2 * quantization.height / positionSteps;
+    for (std::size_t i = 0; i < count; i++) {
+        frame.positions[2 * i] = float(quantized.streams[0][i] * xScale - quantization.width);
+        frame.positions[2 * i + 1] = float(quantized.streams[1][i] * yScale - quantization.height);
+        frame.velocities[2 * i] = float(quantized.streams[2][i] * quantization.velocityStep);
+        frame.velocities[2 * i + 1] = float(quantized.streams[3][i] * quantization.velocityStep);
+        frame.densities[i] = float(quantized.streams[4][i] * quantization.densityStep);
+        frame.ids[i] = quantized.streams[5][i];
+    }
+}
+
+// ----
+
+// CODING
+// ----
+
+// Computed the same way on both sides, so the predictions match exactly
+void TrajectoryCodec::DriftScales(double elapsed, double scales[2]) const {
+    scales[0] = quantization.velocityStep * elapsed / (2 * quantization.width / positionSteps);
+    scales[1] = quantization.velocityStep * elapsed / (2 * quantization.height / positionSteps);
+}
+
+// Blocks are laid out as uint32 blockParticles, uint32 blockCount,
+// uint32 bytes of each block, then the blocks one after another
+void TrajectoryCodec::Encode(const QuantizedFrame& frame, const QuantizedFrame* key, std::vector<unsigned char>& payload) {
+    PROFILE_ZONE("Encode frame");
+    std::size_t count = frame.Size();
+    std::size_t blockCount = (count + blockParticles - 1) / blockParticles;
+    if (blockBytes.size() < blockCount) {
+        blockBytes.resize(blockCount);
+    }
+    pool->ParallelFor(int(blockCount), [&](int begin, int end) {
+        for (int block = begin; block < end; block++) {
+            std::size_t first = std::size_t(block) * blockParticles;
+            blockBytes[block].clear();
+            EncodeBlock(frame, key, first, std::min(first + blockParticles, count), blockBytes[block]);
+        }
+    });
+
+    std::uint32_t layout[2] = {std::uint32_t(blockParticles), std::uint32_t(blockCount)};
+    const unsigned char* layoutBytes = reinterpret_cast<const unsigned char*>(layout);
+    payload.insert(payload.end(), layoutBytes, layoutBytes + sizeof(layout));
+    for (std::size_t block = 0; block < blockCount; block++) {
+        std::uint32_t bytes = std::uint32_t(blockBytes[block].size());
+        const unsigned char* sizeBytes = reinterpret_cast<const unsigned char*>(&bytes);
+        payload.insert(payload.end(), sizeBytes, sizeBytes + sizeof(bytes));
+    }
+    for (std::size_t block = 0; block < blockCount; block++) {
+        payload.insert(payload.end(), blockBytes[block].begin(), blockBytes[block].end());
+    }
+}
+
+bool TrajectoryCodec::Decode(const unsigned char* blocks, std::size_t bytes, std::size_t count, double time, const QuantizedFrame* key, QuantizedFrame& frame) {
+    PROFILE_ZONE("Decode frame");
+    frame.time = time;
+    std::uint32_t layout[2];
+    if (bytes < sizeof(layout)) return false;
+    std::memcpy(layout, blocks, sizeof(layout));
+    std::size_t particles = layout[0];
+    std::size_t blockCount = layout[1];
+    if (particles == 0 || blockCount != (count + particles - 1) / particles) return false;
+    std::size_t tableBytes = sizeof(layout) + blockCount * sizeof(std::uint32_t);
+    if (bytes < tableBytes) return false;
+
+    // Where each block starts, from the table of their sizes
+    std::vector<std::size_t> offsets(blockCount + 1);
+    offsets[0] = tableBytes;
+    for (std::size_t block = 0; block < blockCount; block++) {
+        std::uint32_t size;
+        std::memcpy(&size, blocks + sizeof(layout) + block * sizeof(size), sizeof(size));
+        offsets[block + 1] = offsets[block] + size;
+    }
+    if (offsets[blockCount] > bytes) return false;
+
+    for (std::vector<std::int32_t>& stream : frame.streams) {
+        stream.resize(count);
+    }
+    std::atomic<bool> failed{false};
+    pool->ParallelFor(int(blockCount), [&](int begin, int end) {
+        for (int block = begin; block < end; block++) {
+            std::size_t first = std::size_t(block) * particles;
+            if (!DecodeBlock(blocks + offsets[block], offsets[block + 1] - offsets[block], key, first, std::min(first + particles, count), frame)) {
+                failed = true;
+            }
+        }
+    });
+    return !failed;
+}
+
+// Each stream of the block in turn, in runs that each start with a 5 bit
+// Rice parameter k. A value u is written as u >> k in unary, ones ended by
+// a zero, then its low k bits; a quotient of escapeQuotient or more is
+// written as escapeQuotient ones and u in 32 bits.
+void TrajectoryCodec::EncodeBlock(const QuantizedFrame& frame, const QuantizedFrame* key, std::size_t begin, std::size_t end, std::vector<unsigned char>& out) const {
+    std::size_t keyCount = key != nullptr ? key->Size() : 0;
+    double scales[2] = {0, 0};
+    if (key != nullptr) DriftScales(frame.time - key->time, scales);
+    BitWriter writer(out);
+    std::uint32_t run[runLength];
+    for (int s = 0; s < QuantizedFrame::streamCount; s++) {
+        const std::vector<std::int32_t>& values = frame.streams[s];
+        for (std::size_t start = begin; start < end; start += runLength) {
+            std::size_t length = std::min(runLength, end - start);
+            for (std::size_t j = 0; j < length; j++) {
+                std::size_t i = start + j;
+                std::int32_t prediction = Predict(values, key, keyCount, scales, s, i, begin);
+                run[j] = ZigZag(std::uint32_t(values[i]) - std::uint32_t(prediction));
+            }
+
+            int k = RiceParameter(run, length);
+            writer.Put(k, 5);
+            for (std::size_t j = 0; j < length; j++) {
+                std::uint32_t quotient = run[j] >> k;
+                if (quotient < escapeQuotient) {
+                    writer.Put((1u << quotient) - 1, quotient + 1);
+                    if (k > 0) writer.Put(run[j] & ((1u << k) - 1), k);
+                } else {
+                    writer.Put((1u << escapeQuotient) - 1, escapeQuotient);
+                    writer.Put(run[j], 32);
+                }
+            }
+        }
+    }
+    writer.Flush();
+}
+
+bool TrajectoryCodec::DecodeBlock(const unsigned char* data, std::size_t bytes, const QuantizedFrame* key, std::size_t begin, std::size_t end, QuantizedFrame& frame) const {
+    std::size_t keyCount = key != nullptr ? key->Size() : 0;
+    double scales[2] = {0, 0};
+    if (key != nullptr) DriftScales(frame.time - key->time, scales);
+    BitReader reader(data, bytes);
+    for (int s = 0; s < QuantizedFrame::streamCount; s++) {
+        std::vector<std::int32_t>& values = frame.streams[s];
+        for (std::size_t start = begin; start < end; start += runLength) {
+            std::size_t length = std::min(runLength, end - start);
+            int k = int(reader.Get(5));
+            for (std::size_t j = 0; j < length; j++) {
+                std::uint32_t quotient = reader.Ones(escapeQuotient);
+                std::uint32_t value;
+                if (quotient < escapeQuotient) {
+                    value = (quotient << k) | (k > 0 ? reader.Get(k) : 0);
+                } else {
+                    value = reader.Get(32);
+                }
+
+                std::size_t i = start + j;
+                std::int32_t prediction = Predict(values, key, keyCount, scales, s, i, begin);
+                values[i] = std::int32_t(std::uint32_t(prediction) + UnZigZag(value));
+            }
+            if (reader.Overrun()) return false;
+        }
+    }
+    return true;
+}
+
+// ----
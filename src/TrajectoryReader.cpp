@@ -0,0 +1,296 @@
+#include "TrajectoryReader.hpp"
+#include "Profiler.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // Sizes of the fixed parts of the format
+    const std::uint64_t chunkHeaderBytes = 16;
+    const std::uint64_t rawHeaderBytes = 40;
+    const std::uint64_t quantizedHeaderBytes = 56;
+    const std::uint64_t trailerBytes = 16;
+    // Offsets in a frame chunk's payload
+    const std::uint64_t stepField = 0;
+    const std::uint64_t timeField = 8;
+    const std::uint64_t countField = 16;
+    const std::uint64_t keyOffsetField = 24;
+    const std::uint64_t rawArraysField = 24;
+    const std::uint64_t blocksField = 32;
+}
+
+template <typename T>
+T TrajectoryReader::Load(std::uint64_t offset) const {
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    return value;
+}
+
+// Constructor
+TrajectoryReader::TrajectoryReader() { }
+
+// Destructor
+TrajectoryReader::~TrajectoryReader() {
+    Close();
+}
+
+// The file and mapping handles are closed as soon as the view exists, the
+// view keeps the file open until it is unmapped
+bool TrajectoryReader::Open(const std::string& path) {
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Could not open trajectory file " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size = std::size_t(fileSize.QuadPart);
+    HANDLE mapping = size > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    if (mapping != nullptr) {
+        data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        std::cerr << "Could not open trajectory file " << path << std::endl;
+        return false;
+    }
+    struct stat status;
+    size = fstat(file, &status) == 0 ? std::size_t(status.st_size) : 0;
+    if (size > 0) {
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+        data = mapped != MAP_FAILED ? static_cast<const unsigned char*>(mapped) : nullptr;
+    }
+    close(file);
+#endif
+    if (data == nullptr) {
+        std::cerr << "Could not map trajectory file " << path << std::endl;
+        size = 0;
+        return false;
+    }
+
+    // The header
+    std::uint64_t headerBytes = rawHeaderBytes;
+    bool valid = size >= rawHeaderBytes && std::memcmp(data, Trajectory::fileMagic, sizeof(Trajectory::fileMagic)) == 0
+        && Load<std::uint32_t>(8) == Trajectory::version;
+    if (valid) {
+        encoding = Load<std::uint32_t>(12);
+        width = Load<double>(16);
+        height = Load<double>(24);
+        deltaTime = Load<double>(32);
+        if (encoding == Trajectory::quantizedEncoding) {
+            headerBytes = quantizedHeaderBytes;
+            valid = size >= quantizedHeaderBytes;
+        } else {
+            valid = encoding == Trajectory::rawEncoding;
+        }
+    }
+    if (!valid) {
+        std::cerr << path << " is not a trajectory file this program can read" << std::endl;
+        Close();
+        return false;
+    }
+    if (encoding == Trajectory::quantizedEncoding) {
+        TrajectoryQuantization quantization;
+        quantization.width = width;
+        quantization.height = height;
+        quantization.velocityStep = Load<double>(40);
+        quantization.densityStep = Load<double>(48);
+        codec.reset(new TrajectoryCodec(quantization));
+    }
+
+    // The index, found through the trailer
+    std::uint64_t indexOffset = 0;
+    std::uint64_t indexBytes = 0;
+    bool indexed = size >= headerBytes + trailerBytes
+        && std::memcmp(data + size - sizeof(Trajectory::endMagic), Trajectory::endMagic, sizeof(Trajectory::endMagic)) == 0;
+    if (indexed) {
+        indexOffset = Load<std::uint64_t>(size - trailerBytes);
+        indexed = ChunkBytes(indexOffset, indexBytes) && Load<std::uint32_t>(indexOffset) == Trajectory::indexTag && indexBytes >= sizeof(std::uint64_t);
+    }
+    if (indexed) {
+        std::uint64_t count = Load<std::uint64_t>(indexOffset + chunkHeaderBytes);
+        indexed = count <= (indexBytes - sizeof(std::uint64_t)) / sizeof(std::uint64_t);
+        frameCount = std::size_t(count);
+        indexEntries = indexOffset + chunkHeaderBytes + sizeof(std::uint64_t);
+    }
+    if (!indexed) {
+        std::cerr << path << " has no index, its writer did not close it; finding its frames" << std::endl;
+        ScanFrames(headerBytes);
+    }
+    return true;
+}
+
+void TrajectoryReader::Close() {
+    if (data != nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<unsigned char*>(data), size);
+#endif
+    }
+    data = nullptr;
+    size = 0;
+    frameCount = 0;
+    indexEntries = 0;
+    scannedOffsets.clear();
+    codec.reset();
+    keyframeValid = false;
+}
+
+// FRAMES
+// ----
+
+long long TrajectoryReader::FrameStep(std::size_t index) const {
+    std::uint64_t field = FrameField(index, stepField);
+    return field != 0 ? Load<std::int64_t>(field) : 0;
+}
+
+double TrajectoryReader::FrameTime(std::size_t index) const {
+    std::uint64_t field = FrameField(index, timeField);
+    return field != 0 ? Load<double>(field) : 0;
+}
+
+std::size_t TrajectoryReader::FrameParticles(std::size_t index) const {
+    std::uint64_t field = FrameField(index, countField);
+    return field != 0 ? Load<std::uint32_t>(field) : 0;
+}
+
+// Frames are in time order, so a binary search reads the times of a few of them
+std::size_t TrajectoryReader::FrameAt(double time) const {
+    std::size_t low = 0;
+    std::size_t high = frameCount;
+    while (low < high) {
+        std::size_t middle = low + (high - low) / 2;
+        if (FrameTime(middle) <= time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low > 0 ? low - 1 : 0;
+}
+
+bool TrajectoryReader::ReadFrame(std::size_t index, TrajectoryFrame& frame) {
+    PROFILE_ZONE("Read frame");
+    if (index >= frameCount) return false;
+    std::uint64_t offset = FrameOffset(index);
+    std::uint64_t bytes;
+    if (!ChunkBytes(offset, bytes) || bytes < rawArraysField) return false;
+    std::uint64_t payload = offset + chunkHeaderBytes;
+    std::uint32_t tag = Load<std::uint32_t>(offset);
+    std::size_t count = Load<std::uint32_t>(payload + countField);
+
+    if (encoding == Trajectory::rawEncoding) {
+        if (tag != Trajectory::frameTag || bytes < rawArraysField + count * (5 * sizeof(float) + sizeof(std::int32_t))) return false;
+        frame.step = Load<std::int64_t>(payload + stepField);
+        frame.time = Load<double>(payload + timeField);
+        frame.positions.resize(2 * count);
+        frame.velocities.resize(2 * count);
+        frame.densities.resize(count);
+        frame.ids.resize(count);
+        const unsigned char* arrays = data + payload + rawArraysField;
+        std::memcpy(frame.positions.data(), arrays, 2 * count * sizeof(float));
+        std::memcpy(frame.velocities.data(), arrays + 2 * count * sizeof(float), 2 * count * sizeof(float));
+        std::memcpy(frame.densities.data(), arrays + 4 * count * sizeof(float), count * sizeof(float));
+        std::memcpy(frame.ids.data(), arrays + 5 * count * sizeof(float), count * sizeof(std::int32_t));
+        return true;
+    }
+
+    // A quantized frame needs its keyframe, decoded once for all the frames after it
+    if (tag != Trajectory::quantizedFrameTag || bytes < blocksField) return false;
+    std::uint64_t keyOffset = Load<std::uint64_t>(payload + keyOffsetField);
+    if (!keyframeValid || keyframeOffset != keyOffset) {
+        keyframeOffset = keyOffset;
+        keyframeValid = DecodeQuantized(keyOffset, nullptr, keyframe);
+        if (!keyframeValid) return false;
+    }
+    const QuantizedFrame* decoded = &keyframe;
+    if (keyOffset != offset) {
+        if (!DecodeQuantized(offset, &keyframe, quantized)) return false;
+        decoded = &quantized;
+    }
+    codec->Dequantize(*decoded, frame);
+    frame.step = Load<std::int64_t>(payload + stepField);
+    return true;
+}
+
+// Only the chunk headers are certain to be loaded, and whole pages at that
+void TrajectoryReader::Prefetch(std::size_t index) const {
+#ifndef _WIN32
+    if (index >= frameCount) return;
+    std::uint64_t offset = FrameOffset(index);
+    std::uint64_t bytes;
+    if (!ChunkBytes(offset, bytes)) return;
+    std::uint64_t page = std::uint64_t(sysconf(_SC_PAGESIZE));
+    std::uint64_t begin = offset / page * page;
+    madvise(const_cast<unsigned char*>(data) + begin, std::size_t(offset + chunkHeaderBytes + bytes - begin), MADV_WILLNEED);
+#endif
+}
+
+// ----
+
+// LAYOUT
+// ----
+
+std::uint64_t TrajectoryReader::FrameOffset(std::size_t index) const {
+    if (indexEntries != 0) {
+        return Load<std::uint64_t>(indexEntries + index * sizeof(std::uint64_t));
+    }
+    return scannedOffsets[index];
+}
+
+std::uint64_t TrajectoryReader::FrameField(std::size_t index, std::uint64_t field) const {
+    if (index >= frameCount) return 0;
+    std::uint64_t offset = FrameOffset(index);
+    std::uint64_t bytes;
+    if (!ChunkBytes(offset, bytes) || bytes < field + sizeof(std::uint64_t)) return 0;
+    return offset + chunkHeaderBytes + field;
+}
+
+bool TrajectoryReader::ChunkBytes(std::uint64_t offset, std::uint64_t& bytes) const {
+    if (offset > size || size - offset < chunkHeaderBytes) return false;
+    bytes = Load<std::uint64_t>(offset + 8);
+    return bytes <= size - offset - chunkHeaderBytes;
+}
+
+// Stops at the first chunk that runs past the end, the one being written
+// when the writer stopped
+void TrajectoryReader::ScanFrames(std::uint64_t begin) {
+    std::uint32_t frameTag = encoding == Trajectory::rawEncoding ? Trajectory::frameTag : Trajectory::quantizedFrameTag;
+    std::uint64_t offset = begin;
+    std::uint64_t bytes;
+    while (ChunkBytes(offset, bytes)) {
+        if (Load<std::uint32_t>(offset) == frameTag) {
+            scannedOffsets.push_back(offset);
+        }
+        offset += chunkHeaderBytes + bytes;
+    }
+    frameCount = scannedOffsets.size();
+}
+
+bool TrajectoryReader::DecodeQuantized(std::uint64_t offset, const QuantizedFrame* key, QuantizedFrame& target) {
+    std::uint64_t bytes;
+    if (!ChunkBytes(offset, bytes) || bytes < blocksField || Load<std::uint32_t>(offset) != Trajectory::quantizedFrameTag) return false;
+    std::uint64_t payload = offset + chunkHeaderBytes;
+    // A keyframe is coded against nothing, and says so in its flags
+    bool isKeyframe = (Load<std::uint32_t>(offset + 4) & Trajectory::keyframeFlag) != 0;
+    if (isKeyframe != (key == nullptr)) return false;
+    return codec->Decode(data + payload + blocksField, std::size_t(bytes - blocksField), Load<std::uint32_t>(payload + countField),
+                         Load<double>(payload + timeField), key, target);
+}
+
+// ----
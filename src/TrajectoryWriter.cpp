@@ -0,0 +1,252 @@
+#include "TrajectoryWriter.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// Constructor
+TrajectoryWriter::TrajectoryWriter() { }
+
+// Destructor
+TrajectoryWriter::~TrajectoryWriter() {
+    Close();
+}
+
+bool TrajectoryWriter::Open(const std::string& path, const SolverConfig& config, const TrajectoryOptions& u_options) {
+    Close();
+    file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        std::cerr << "Could not create trajectory file " << path << std::endl;
+        return false;
+    }
+
+    offset = 0;
+    frameOffsets.clear();
+    failed = false;
+    closing = false;
+    captured = 0;
+    written = 0;
+    dropped = 0;
+    maxQueueDepth = 0;
+    bytesWritten = 0;
+    rawBytes = 0;
+    writeNanoseconds = 0;
+
+    options = u_options;
+    codec.reset();
+    sinceKeyframe = 0;
+    if (options.quantize) {
+        TrajectoryQuantization quantization;
+        quantization.width = config.width;
+        quantization.height = config.height;
+        quantization.velocityStep = options.velocityStep;
+        quantization.densityStep = options.densityStep;
+        codec.reset(new TrajectoryCodec(quantization, options.blockParticles, options.threads));
+    }
+
+    std::uint32_t header[2] = {Trajectory::version, options.quantize ? Trajectory::quantizedEncoding : Trajectory::rawEncoding};
+    double domain[3] = {config.width, config.height, config.deltaTime};
+    double steps[2] = {options.velocityStep, options.densityStep};
+    if (!WriteBytes(Trajectory::fileMagic, sizeof(Trajectory::fileMagic)) || !WriteBytes(header, sizeof(header)) || !WriteBytes(domain, sizeof(domain))
+        || (options.quantize && !WriteBytes(steps, sizeof(steps)))) {
+        std::cerr << "Could not write to trajectory file " << path << std::endl;
+        std::fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    // Every buffer starts free; the queues are empty again after a Close
+    int index;
+    while (freeFrames.Pop(index)) { }
+    frames.resize(std::min(std::max(options.buffers, 1), maxBuffers));
+    for (int i = 0; i < int(frames.size()); i++) {
+        freeFrames.Push(i);
+    }
+    writer = std::thread(&TrajectoryWriter::WriterLoop, this);
+    return true;
+}
+
+// Runs on the thread stepping the solver, so it reads the solver safely
+bool TrajectoryWriter::Capture(const IFluidSolver& solver, long long step, double time) {
+    if (file == nullptr || failed) return false;
+    PROFILE_ZONE("Capture frame");
+    captured++;
+
+    int index;
+    if (!freeFrames.Pop(index)) {
+        dropped++;
+        return false;
+    }
+
+    TrajectoryFrame& frame = frames[index];
+    std::size_t count = solver.ParticleCount();
+    frame.step = step;
+    frame.time = time;
+    frame.positions.resize(2 * count);
+    frame.velocities.resize(2 * count);
+    frame.densities.resize(count);
+    frame.ids.resize(count);
+    for (std::size_t i = 0; i < count; i++) {
+        glm::vec3 position = solver.Position(i);
+        glm::vec3 velocity = solver.Velocity(i);
+        frame.positions[2 * i] = position.x;
+        frame.positions[2 * i + 1] = position.y;
+        frame.velocities[2 * i] = velocity.x;
+        frame.velocities[2 * i + 1] = velocity.y;
+        frame.densities[i] = solver.Density(i);
+        frame.ids[i] = solver.ParticleId(i);
+    }
+
+    // There are never more buffers than the queue holds, so this cannot fail
+    queuedFrames.Push(index);
+    Wake();
+    // With the last buffer taken, give the writer the core before the next
+    // capture needs one. A writer blocked on the disk cannot take it, so
+    // this never waits for a write
+    if (freeFrames.Size() == 0) std::this_thread::yield();
+    maxQueueDepth = std::max(maxQueueDepth.load(), queuedFrames.Size());
+    return true;
+}
+
+// The writer checks its wake condition under the mutex, so holding it for
+// an instant before signalling means the writer is either yet to check, and
+// sees the new frame, or already asleep, and gets the signal
+void TrajectoryWriter::Wake() {
+    { std::lock_guard<std::mutex> lock(wakeMutex); }
+    wake.notify_one();
+}
+
+// The closing flag is read before the queue, so an empty queue after it
+// was set means every frame is out
+void TrajectoryWriter::WriterLoop() {
+    PROFILE_THREAD("Trajectory writer");
+    while (true) {
+        bool finishing = closing.load(std::memory_order_acquire);
+        int index;
+        if (!queuedFrames.Pop(index)) {
+            if (finishing) break;
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait(lock, [this] { return queuedFrames.Size() > 0 || closing; });
+            continue;
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        if (!failed) {
+            PROFILE_ZONE("Write frame");
+            const TrajectoryFrame& frame = frames[index];
+            if (codec ? WriteQuantizedFrame(frame) : WriteFrame(frame)) {
+                written++;
+                rawBytes += 2 * sizeof(std::uint32_t) + sizeof(std::uint64_t) + RawFrameBytes(frame.densities.size());
+            } else {
+                std::cerr << "Could not write trajectory frame " << frames[index].step << ", recording stopped" << std::endl;
+                failed = true;
+            }
+        }
+        writeNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        freeFrames.Push(index);
+    }
+}
+
+bool TrajectoryWriter::Close() {
+    if (file == nullptr) return true;
+
+    closing = true;
+    Wake();
+    writer.join();
+
+    // The index and trailer make frames seekable, a failed file gets neither
+    bool ok = !failed;
+    if (ok) {
+        std::uint64_t indexOffset = offset;
+        std::uint64_t frameCount = frameOffsets.size();
+        ok = WriteChunkHeader(Trajectory::indexTag, sizeof(frameCount) + frameCount * sizeof(std::uint64_t))
+            && WriteBytes(&frameCount, sizeof(frameCount))
+            && WriteBytes(frameOffsets.data(), frameCount * sizeof(std::uint64_t))
+            && WriteBytes(&indexOffset, sizeof(indexOffset))
+            && WriteBytes(Trajectory::endMagic, sizeof(Trajectory::endMagic));
+    }
+    if (std::fclose(file) != 0) ok = false;
+    file = nullptr;
+    if (!ok) {
+        std::cerr << "Trajectory file is incomplete, it has no index" << std::endl;
+    }
+    return ok;
+}
+
+TrajectoryStats TrajectoryWriter::Stats() const {
+    TrajectoryStats stats;
+    stats.captured = captured;
+    stats.written = written;
+    stats.dropped = dropped;
+    stats.queueDepth = queuedFrames.Size();
+    stats.maxQueueDepth = maxQueueDepth;
+    stats.bytesWritten = bytesWritten;
+    stats.rawBytes = rawBytes;
+    stats.writeSeconds = writeNanoseconds / 1e9;
+    return stats;
+}
+
+// WRITING
+// ----
+
+bool TrajectoryWriter::WriteFrame(const TrajectoryFrame& frame) {
+    std::uint32_t count = std::uint32_t(frame.densities.size());
+    std::int64_t step = frame.step;
+    std::uint32_t countAndPad[2] = {count, 0};
+
+    frameOffsets.push_back(offset);
+    return WriteChunkHeader(Trajectory::frameTag, RawFrameBytes(count))
+        && WriteBytes(&step, sizeof(step))
+        && WriteBytes(&frame.time, sizeof(frame.time))
+        && WriteBytes(countAndPad, sizeof(countAndPad))
+        && WriteBytes(frame.positions.data(), frame.positions.size() * sizeof(float))
+        && WriteBytes(frame.velocities.data(), frame.velocities.size() * sizeof(float))
+        && WriteBytes(frame.densities.data(), frame.densities.size() * sizeof(float))
+        && WriteBytes(frame.ids.data(), frame.ids.size() * sizeof(std::int32_t));
+}
+
+// Keyframes are quantized into keyframe and coded alone, the frames after
+// them are coded against it
+bool TrajectoryWriter::WriteQuantizedFrame(const TrajectoryFrame& frame) {
+    bool isKeyframe = sinceKeyframe == 0;
+    sinceKeyframe = (sinceKeyframe + 1) % std::max(options.keyframeInterval, 1);
+    if (isKeyframe) {
+        keyframeOffset = offset;
+    }
+    QuantizedFrame& target = isKeyframe ? keyframe : quantized;
+    codec->Quantize(frame, target);
+
+    std::int64_t step = frame.step;
+    std::uint32_t countAndPad[2] = {std::uint32_t(frame.densities.size()), 0};
+    payload.clear();
+    codec->Encode(target, isKeyframe ? nullptr : &keyframe, payload);
+    std::uint64_t bytes = sizeof(step) + sizeof(frame.time) + sizeof(countAndPad) + sizeof(keyframeOffset) + payload.size();
+
+    frameOffsets.push_back(offset);
+    return WriteChunkHeader(Trajectory::quantizedFrameTag, bytes, isKeyframe ? Trajectory::keyframeFlag : 0)
+        && WriteBytes(&step, sizeof(step))
+        && WriteBytes(&frame.time, sizeof(frame.time))
+        && WriteBytes(countAndPad, sizeof(countAndPad))
+        && WriteBytes(&keyframeOffset, sizeof(keyframeOffset))
+        && WriteBytes(payload.data(), payload.size());
+}
+
+std::uint64_t TrajectoryWriter::RawFrameBytes(std::size_t count) {
+    return sizeof(std::int64_t) + sizeof(double) + 2 * sizeof(std::uint32_t) + count * (5 * sizeof(float) + sizeof(std::int32_t));
+}
+
+bool TrajectoryWriter::WriteChunkHeader(std::uint32_t tag, std::uint64_t bytes, std::uint32_t flags) {
+    std::uint32_t tagAndFlags[2] = {tag, flags};
+    return WriteBytes(tagAndFlags, sizeof(tagAndFlags)) && WriteBytes(&bytes, sizeof(bytes));
+}
+
+bool TrajectoryWriter::WriteBytes(const void* data, std::size_t size) {
+    if (size == 0) return true;
+    if (std::fwrite(data, 1, size, file) != size) return false;
+    offset += size;
+    bytesWritten += size;
+    return true;
+}
+
+// ----
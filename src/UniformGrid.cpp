@@ -0,0 +1,192 @@
+#include "UniformGrid.hpp"
+
+#include <cmath>
+
+// Constructor
+UniformGrid::UniformGrid(double u_width, double u_height, double smoothingDistance, bool u_sparse, int levelCount) {
+    sparse = u_sparse;
+    width = u_width;
+    height = u_height;
+
+    denseCells = 0;
+    for (int l = 0; l < std::max(1, levelCount); l++) {
+        Level level;
+        level.size = smoothingDistance * std::pow(2.0, l / 2.0);
+
+        // Round down so cells are never narrower than the support
+        level.cols = std::max(1, int(std::floor(2 * width / level.size)));
+        level.rows = std::max(1, int(std::floor(2 * height / level.size)));
+        level.cellWidth = 2 * width / level.cols;
+        level.cellHeight = 2 * height / level.rows;
+
+        // Sparse cells have no tank to fit, they are exactly as wide as the support
+        if (sparse) {
+            level.cellWidth = level.size;
+            level.cellHeight = level.size;
+        }
+
+        level.offset = denseCells;
+        level.count = 0;
+        denseCells += level.cols * level.rows;
+        levels.push_back(level);
+    }
+
+    cellStart.assign(CellCount() + 1, 0);
+}
+
+// Supports are computed in the solver's precision, a little slack keeps
+// one of exactly a level's size on that level
+int UniformGrid::LevelFor(double support) const {
+    for (int level = 0; level < int(levels.size()); level++) {
+        if (support <= levels[level].size * (1 + 1e-6)) return level;
+    }
+    return int(levels.size()) - 1;
+}
+
+// Given a position, calculate the cell it's in
+int UniformGrid::CalculatePosition(double x, double y, int level) const {
+    const Level& cells = levels[level];
+    if (sparse) {
+        return Find(Key(int(std::floor(x / cells.cellWidth)), int(std::floor(y / cells.cellHeight))), level);
+    }
+
+    int col = int(std::floor((x + width) / cells.cellWidth));
+    int row = int(std::floor((y + height) / cells.cellHeight));
+
+    // Particles on or past the walls belong to the border cells
+    col = std::min(std::max(col, 0), cells.cols - 1);
+    row = std::min(std::max(row, 0), cells.rows - 1);
+
+    return cells.offset + col + (cells.cols * row);
+}
+
+int UniformGrid::LevelOf(int cell) const {
+    if (sparse) return slotLevels[cell];
+
+    int level = int(levels.size()) - 1;
+    while (level > 0 && cell < levels[level].offset) {
+        level--;
+    }
+    return level;
+}
+
+void UniformGrid::CellCorner(int cell, double& x, double& y) const {
+    const Level& cells = levels[LevelOf(cell)];
+    if (sparse) {
+        x = KeyCol(slotKeys[cell]) * cells.cellWidth;
+        y = KeyRow(slotKeys[cell]) * cells.cellHeight;
+        return;
+    }
+
+    int local = cell - cells.offset;
+    x = -width + (local % cells.cols) * cells.cellWidth;
+    y = -height + (local / cells.cols) * cells.cellHeight;
+}
+
+// Count the particles per cell, turn the counts into offsets and scatter the indices.
+// Resized rather than assigned: a sparse grid gains cells a few at a time, and
+// assign would reallocate to the exact new size every step it does
+void UniformGrid::SortParticles(int cells) {
+    int count = static_cast<int>(particleCells.size());
+    cellStart.resize(cells + 1);
+    std::fill(cellStart.begin(), cellStart.end(), 0);
+    sortedIndices.resize(count);
+
+    for (int i = 0; i < count; i++) {
+        cellStart[particleCells[i] + 1]++;
+    }
+    for (int cell = 0; cell < cells; cell++) {
+        cellStart[cell + 1] += cellStart[cell];
+    }
+
+    cellCursor.resize(cells);
+    std::copy(cellStart.begin(), cellStart.end() - 1, cellCursor.begin());
+    for (int i = 0; i < count; i++) {
+        sortedIndices[cellCursor[particleCells[i]]++] = i;
+    }
+}
+
+// Fibonacci hashing, the top bits of the product index the table. The
+// level is mixed in first so the same cell on two levels lands apart
+int UniformGrid::Home(long long key, int level) const {
+    unsigned long long hash = (static_cast<unsigned long long>(key) + static_cast<unsigned long long>(level) * 0xD6E8FEB86659FD93ull) * 0x9E3779B97F4A7C15ull;
+    return static_cast<int>(hash >> 32) & (int(table.size()) - 1);
+}
+
+int UniformGrid::Find(long long key, int level) const {
+    if (table.empty()) return -1;
+
+    int mask = int(table.size()) - 1;
+    for (int i = Home(key, level); ; i = (i + 1) & mask) {
+        if (table[i].slot < 0) return -1;
+        if (table[i].key == key && table[i].level == level) return table[i].slot;
+    }
+}
+
+int UniformGrid::FindOrInsert(long long key, int level) {
+    // Keep the table at most half full so probe runs stay short
+    int live = int(slotKeys.size() - freeSlots.size());
+    if (2 * (live + 1) > int(table.size())) Grow();
+
+    int mask = int(table.size()) - 1;
+    int i = Home(key, level);
+    for (; table[i].slot >= 0; i = (i + 1) & mask) {
+        if (table[i].key == key && table[i].level == level) return table[i].slot;
+    }
+
+    int slot;
+    if (freeSlots.empty()) {
+        slot = int(slotKeys.size());
+        slotKeys.push_back(key);
+        slotLevels.push_back(static_cast<unsigned char>(level));
+        slotLive.push_back(1);
+    } else {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+        slotKeys[slot] = key;
+        slotLevels[slot] = static_cast<unsigned char>(level);
+        slotLive[slot] = 1;
+    }
+    table[i].key = key;
+    table[i].slot = slot;
+    table[i].level = level;
+    createdCells.push_back(slot);
+    return slot;
+}
+
+// Linear probing has no tombstones: every entry after the hole that probes
+// from at or before it moves back into it, until an empty entry ends the run
+void UniformGrid::Erase(long long key, int level) {
+    int mask = int(table.size()) - 1;
+    int hole = Home(key, level);
+    while (table[hole].key != key || table[hole].level != level || table[hole].slot < 0) {
+        hole = (hole + 1) & mask;
+    }
+    table[hole].slot = -1;
+
+    for (int i = (hole + 1) & mask; table[i].slot >= 0; i = (i + 1) & mask) {
+        int home = Home(table[i].key, table[i].level);
+        // Distance probed from home to i, and from home to the hole
+        if (((i - home) & mask) >= ((hole - home) & mask)) {
+            table[hole] = table[i];
+            table[i].slot = -1;
+            hole = i;
+        }
+    }
+}
+
+void UniformGrid::Grow() {
+    std::vector<Entry> old;
+    old.swap(table);
+    table.assign(std::max<std::size_t>(16, 2 * old.size()), Entry());
+
+    int mask = int(table.size()) - 1;
+    for (const Entry& entry : old) {
+        if (entry.slot < 0) continue;
+        int i = Home(entry.key, entry.level);
+        while (table[i].slot >= 0) {
+            i = (i + 1) & mask;
+        }
+        table[i] = entry;
+    }
+}
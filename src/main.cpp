@@ -11,7 +11,10 @@
 // Functionality that we created
 #include "SDLGraphicsProgram.hpp"
 #include "Application.hpp"
+#include "FluidScene.hpp"
 #include "FluidSimulation.hpp"
+#include "Profiler.hpp"
+#include "ReplaySimulation.hpp"
 #include <iostream>
 
 // Create an instance of an object for a SDLGraphicsProgram
@@ -58,6 +61,36 @@ void Render(void){
 int main(int argc, char* argv[]){
     // Starting program
     std::cout << "Entry Point to Program\n";
+    // Read the solver options from the command line
+    SolverConfig config;
+    SceneOptions scene;
+    std::string tracePath;
+    std::string replayPath;
+    double replaySpeed = 1;
+    bool replayLoop = true;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        ArgumentResult result = ParseSceneArgument(arg, config, scene);
+        if (result == ArgumentResult::Invalid) {
+            return 1;
+        } else if (result == ArgumentResult::Parsed) {
+            continue;
+        }
+        if (arg.rfind("--trace=", 0) == 0) {
+            tracePath = arg.substr(8);
+        } else if (arg.rfind("--replay=", 0) == 0) {
+            replayPath = arg.substr(9);
+        } else if (arg.rfind("--replay-speed=", 0) == 0) {
+            if (!ParseDoubleArgument(arg, replaySpeed)) {
+                return 1;
+            }
+        } else if (arg == "--no-loop") {
+            replayLoop = false;
+        } else {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
     // Confirm our OpenGL Version Number
     gSDLGraphicsProgram.GetOpenGLVersionInfo();
     // Setup each of your function pointers before
@@ -132,8 +165,21 @@ int main(int argc, char* argv[]){
     // gApplication.AddObject(circle3);
     // gApplication.AddObject(circle4);
     // gApplication.AddObject(circle5);
-    Simulation* fluidSim = new FluidSimulation(2.4, 2.4, 0.4, gApplication);
-    gApplication.AddSimulation(fluidSim);
+    // A recording plays back instead of the fluid, with no solver at all
+    std::unique_ptr<ReplaySimulation> replay;
+    if (!replayPath.empty()) {
+        replay.reset(new ReplaySimulation(gApplication));
+        if (!replay->Open(replayPath)) {
+            return 1;
+        }
+        replay->SetSpeed(replaySpeed);
+        replay->SetLooping(replayLoop);
+        gApplication.AddSimulation(replay.get());
+    } else {
+        ConfigureScene(config, scene);
+        FluidSimulation* fluidSim = new FluidSimulation(config, scene, gApplication);
+        gApplication.AddSimulation(fluidSim);
+    }
 
     /* ---------------------------------------------------------------------------------------
     Keep them between these lines
@@ -141,6 +187,9 @@ int main(int argc, char* argv[]){
     */
 
     gSDLGraphicsProgram.Loop();
+    if (!tracePath.empty()) {
+        Profiler::WriteChromeTrace(tracePath);
+    }
     // When our program ends, it will exit scope, the
     // destructor will then be called and clean up the program.
 